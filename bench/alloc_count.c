@@ -0,0 +1,138 @@
+// Allocation Counter Implementation
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <dlfcn.h>
+
+#include "alloc_count.h"
+
+#define BOOTSTRAP_SIZE 4096
+
+atomic_ulong alloc_count_mallocs;
+atomic_ulong alloc_count_frees;
+
+#ifdef __GLIBC__
+
+// glibc exports the real allocator under these names
+void *__libc_malloc(size_t size);
+void *__libc_calloc(size_t count, size_t size);
+void *__libc_realloc(void *ptr, size_t size);
+void __libc_free(void *ptr);
+
+#define real_malloc __libc_malloc
+#define real_calloc __libc_calloc
+#define real_realloc __libc_realloc
+#define real_free __libc_free
+
+#else
+
+void *(*real_malloc)(size_t);
+void *(*real_calloc)(size_t, size_t);
+void *(*real_realloc)(void *, size_t);
+void (*real_free)(void *);
+
+// dlsym may allocate before the real allocator is found
+char alloc_count_bootstrap[BOOTSTRAP_SIZE];
+size_t alloc_count_bootstrap_used;
+bool alloc_count_finding;
+
+bool find_real_allocator(void);
+void *bootstrap_alloc(size_t size);
+
+#endif
+
+////////////////////////////////// FUNCTIONS ///////////////////////////////////
+
+void AllocCountReset(void) {
+    atomic_store(&alloc_count_mallocs, 0);
+    atomic_store(&alloc_count_frees, 0);
+}
+
+AllocCount AllocCountGet(void) {
+    AllocCount count;
+    count.mallocs = atomic_load(&alloc_count_mallocs);
+    count.frees = atomic_load(&alloc_count_frees);
+    return count;
+}
+
+///////////////////////////////// INTERPOSERS //////////////////////////////////
+
+void *malloc(size_t size) {
+#ifndef __GLIBC__
+    if (!find_real_allocator()) return bootstrap_alloc(size);
+#endif
+    atomic_fetch_add_explicit(&alloc_count_mallocs, 1, memory_order_relaxed);
+    return real_malloc(size);
+}
+
+void *calloc(size_t count, size_t size) {
+#ifndef __GLIBC__
+    if (!find_real_allocator()) return bootstrap_alloc(count * size);
+#endif
+    atomic_fetch_add_explicit(&alloc_count_mallocs, 1, memory_order_relaxed);
+    return real_calloc(count, size);
+}
+
+void *realloc(void *ptr, size_t size) {
+#ifndef __GLIBC__
+    if (!find_real_allocator()) return bootstrap_alloc(size);
+#endif
+    if (ptr == NULL) {
+        atomic_fetch_add_explicit(&alloc_count_mallocs, 1, memory_order_relaxed);
+    }
+    return real_realloc(ptr, size);
+}
+
+void free(void *ptr) {
+    if (ptr == NULL) return;
+
+#ifndef __GLIBC__
+    // Bootstrap allocations are never freed
+    char *p = ptr;
+    if (p >= alloc_count_bootstrap && p < alloc_count_bootstrap + BOOTSTRAP_SIZE) return;
+#endif
+
+    atomic_fetch_add_explicit(&alloc_count_frees, 1, memory_order_relaxed);
+    real_free(ptr);
+}
+
+////////////////////////////// HELPER FUNCTIONS ////////////////////////////////
+
+#ifndef __GLIBC__
+
+/**
+ * Looks up the allocator functions that come after this file, once.
+ * Returns false while the lookup is running (or if it failed).
+ */
+bool find_real_allocator(void) {
+    if (real_malloc != NULL) return true;
+    if (alloc_count_finding) return false;
+
+    alloc_count_finding = true;
+    real_calloc = dlsym(RTLD_NEXT, "calloc");
+    real_realloc = dlsym(RTLD_NEXT, "realloc");
+    real_free = dlsym(RTLD_NEXT, "free");
+    real_malloc = dlsym(RTLD_NEXT, "malloc");
+    alloc_count_finding = false;
+
+    return real_malloc != NULL;
+}
+
+/**
+ * Allocates zeroed memory from a static buffer, used while dlsym runs.
+ */
+void *bootstrap_alloc(size_t size) {
+    size = (size + 15) & ~(size_t)15;
+    if (alloc_count_bootstrap_used + size > BOOTSTRAP_SIZE) return NULL;
+
+    void *ptr = alloc_count_bootstrap + alloc_count_bootstrap_used;
+    alloc_count_bootstrap_used += size;
+    return ptr;
+}
+
+#endif
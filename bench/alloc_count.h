@@ -0,0 +1,29 @@
+// Allocation Counter Interface
+
+/**
+ * Linking the allocation counter replaces malloc, calloc, realloc and free
+ * with versions that count their calls before calling the real ones,
+ * so benchmarks can report allocations per operation.
+ */
+
+#ifndef ALLOC_COUNT_H
+#define ALLOC_COUNT_H
+
+typedef struct alloc_count AllocCount;
+
+struct alloc_count {
+    unsigned long mallocs; // Includes calloc, and realloc of NULL
+    unsigned long frees;
+};
+
+/**
+ * Sets the counts back to zero.
+ */
+void AllocCountReset(void);
+
+/**
+ * Returns the counts since the last reset.
+ */
+AllocCount AllocCountGet(void);
+
+#endif
@@ -0,0 +1,156 @@
+// GDMP Codec Benchmark
+
+/**
+ * Measures GDMPParse, GDMPStringify, GDMPCopy and GDMPValidate over a few
+ * corpora, reporting time and allocations per operation. An operation
+ * includes freeing what it returns, so its mallocs and frees should match.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "gdmp.h"
+#include "alloc_count.h"
+
+#define ITERATIONS 200000
+
+typedef struct corpus Corpus;
+
+struct corpus {
+    char *name;
+    char *str;
+};
+
+Corpus corpora[] = {
+    {
+        "short chat",
+        "GDMP_TEXT_MESSAGE\n"
+        "Username: Will\n"
+        "Content: G'day mate!\n"
+        "Timestamp: 14:18\n"
+        "\n"
+    },
+    {
+        "max-length content",
+        "GDMP_TEXT_MESSAGE\n"
+        "Username: Charlotte\n"
+        "Content: Heading to the beach this arvo, who is keen to c\n"
+        "Timestamp: 14:18\n"
+        "\n"
+    },
+    {
+        "many headers",
+        "GDMP_TEXT_MESSAGE\n"
+        "Username: Will\n"
+        "Content: G'day mate!\n"
+        "Timestamp: 14:18\n"
+        "Room: general\n"
+        "Client: gdaymate-cli\n"
+        "Version: 1\n"
+        "Locale: en-AU\n"
+        "Reply-To: Jack\n"
+        "Priority: normal\n"
+        "Trace: 0f3a9c\n"
+        "\n"
+    },
+};
+
+double now_ns(void);
+void report(char *op, Corpus *corpus, double elapsed_ns, AllocCount count);
+void bench_parse(Corpus *corpus);
+void bench_stringify(Corpus *corpus);
+void bench_copy(Corpus *corpus);
+void bench_validate(Corpus *corpus);
+
+int main(void) {
+    printf("%-10s %-20s %10s %10s %10s %10s\n",
+        "operation", "corpus", "ns/op", "MB/s", "mallocs", "frees");
+
+    int corpus_count = sizeof(corpora) / sizeof(corpora[0]);
+    for (int i = 0; i < corpus_count; i++) {
+        bench_parse(&corpora[i]);
+        bench_stringify(&corpora[i]);
+        bench_copy(&corpora[i]);
+        bench_validate(&corpora[i]);
+    }
+
+    return 0;
+}
+
+void bench_parse(Corpus *corpus) {
+    AllocCountReset();
+    double start = now_ns();
+
+    for (int i = 0; i < ITERATIONS; i++) {
+        GDMPMessage msg = GDMPParse(corpus->str);
+        GDMPFree(msg);
+    }
+
+    report("parse", corpus, now_ns() - start, AllocCountGet());
+}
+
+void bench_stringify(Corpus *corpus) {
+    GDMPMessage msg = GDMPParse(corpus->str);
+
+    AllocCountReset();
+    double start = now_ns();
+
+    for (int i = 0; i < ITERATIONS; i++) {
+        char *str = GDMPStringify(msg);
+        free(str);
+    }
+
+    report("stringify", corpus, now_ns() - start, AllocCountGet());
+    GDMPFree(msg);
+}
+
+void bench_copy(Corpus *corpus) {
+    GDMPMessage msg = GDMPParse(corpus->str);
+
+    AllocCountReset();
+    double start = now_ns();
+
+    for (int i = 0; i < ITERATIONS; i++) {
+        GDMPMessage copy = GDMPCopy(msg);
+        GDMPFree(copy);
+    }
+
+    report("copy", corpus, now_ns() - start, AllocCountGet());
+    GDMPFree(msg);
+}
+
+void bench_validate(Corpus *corpus) {
+    GDMPMessage msg = GDMPParse(corpus->str);
+
+    AllocCountReset();
+    double start = now_ns();
+
+    int valid = 0;
+    for (int i = 0; i < ITERATIONS; i++) {
+        valid += GDMPValidate(msg, GDMP_TEXT_MESSAGE);
+    }
+
+    report("validate", corpus, now_ns() - start, AllocCountGet());
+    if (valid != ITERATIONS) fprintf(stderr, "validate: unexpected result\n");
+    GDMPFree(msg);
+}
+
+double now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/**
+ * Prints a result line. Throughput is measured over the corpus' serialized length.
+ */
+void report(char *op, Corpus *corpus, double elapsed_ns, AllocCount count) {
+    double ns_per_op = elapsed_ns / ITERATIONS;
+    double mb_per_sec = (strlen(corpus->str) / ns_per_op) * 1e9 / (1024 * 1024);
+
+    printf("%-10s %-20s %10.1f %10.1f %10.2f %10.2f\n",
+        op, corpus->name, ns_per_op, mb_per_sec,
+        (double)count.mallocs / ITERATIONS, (double)count.frees / ITERATIONS);
+}
@@ -0,0 +1,114 @@
+// GDMP Scanner Benchmark
+
+/**
+ * Compares the cost of finding line breaks and header separators
+ * with strchr/strsep/strstr (the original parser) against the GDMP scanner,
+ * over a buffer of many back-to-back frames.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <time.h>
+
+#include "gdmp_scan.h"
+
+#define BUFFER_SIZE (64 * 1024)
+#define ROUNDS 2000
+#define MAX_DELIMS BUFFER_SIZE
+
+char *make_buffer(size_t *len);
+size_t scan_strsep(const char *str, size_t len);
+size_t scan_delims(const char *str, size_t len, GDMPDelim *delims, bool scalar);
+double now_ns(void);
+void report(const char *name, double elapsed_ns, size_t len, size_t found);
+
+int main(void) {
+    size_t len;
+    char *buffer = make_buffer(&len);
+    GDMPDelim *delims = malloc(MAX_DELIMS * sizeof(GDMPDelim));
+
+    size_t found = 0;
+    double start = now_ns();
+    for (int i = 0; i < ROUNDS; i++) found = scan_strsep(buffer, len);
+    report("strchr/strsep/strstr", now_ns() - start, len, found);
+
+    start = now_ns();
+    for (int i = 0; i < ROUNDS; i++) found = scan_delims(buffer, len, delims, true);
+    report("scalar", now_ns() - start, len, found);
+
+    start = now_ns();
+    for (int i = 0; i < ROUNDS; i++) found = scan_delims(buffer, len, delims, false);
+    report(GDMPScanName(), now_ns() - start, len, found);
+
+    free(delims);
+    free(buffer);
+    return 0;
+}
+
+/**
+ * Fills a buffer with text messages, as seen on a busy connection.
+ */
+char *make_buffer(size_t *len) {
+    char *buffer = malloc(BUFFER_SIZE + 1);
+    size_t used = 0;
+
+    for (int i = 0; ; i++) {
+        char frame[256];
+        int frame_len = snprintf(
+            frame, sizeof(frame),
+            "GDMP_TEXT_MESSAGE\nUsername: user%d\nContent: message number %d from a busy room\nTimestamp: 14:%02d\n",
+            i % 100, i, i % 60
+        );
+        if (used + frame_len > BUFFER_SIZE) break;
+        memcpy(buffer + used, frame, frame_len);
+        used += frame_len;
+    }
+
+    buffer[used] = '\0';
+    *len = used;
+    return buffer;
+}
+
+/**
+ * Finds delimiters the way the original parser did, a line at a time.
+ */
+size_t scan_strsep(const char *str, size_t len) {
+    char *copy = strndup(str, len);
+    char *rest = copy;
+    char *line;
+    size_t found = 0;
+
+    while ((line = strsep(&rest, "\n")) != NULL) {
+        if (rest != NULL) found++;
+        char *pos = line;
+        while ((pos = strstr(pos, ": ")) != NULL) {
+            found++;
+            pos++;
+        }
+    }
+
+    free(copy);
+    return found;
+}
+
+/**
+ * Finds delimiters with the GDMP scanner.
+ */
+size_t scan_delims(const char *str, size_t len, GDMPDelim *delims, bool scalar) {
+    if (scalar) return GDMPScanScalar(str, len, delims, MAX_DELIMS);
+    return GDMPScan(str, len, delims, MAX_DELIMS);
+}
+
+double now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+void report(const char *name, double elapsed_ns, size_t len, size_t found) {
+    double ns_per_round = elapsed_ns / ROUNDS;
+    double mb_per_sec = (len / ns_per_round) * 1e9 / (1024 * 1024);
+    printf("%-22s %10.0f ns/op %10.1f MB/s %8zu delimiters\n", name, ns_per_round, mb_per_sec, found);
+}
@@ -5,13 +5,18 @@
 #define CLIENT_SERVER_PORT 8080
 #define CLIENT_TIMESTAMP_FORMAT "%H:%M"
 #define CLIENT_COMMAND_CHAR '/'
+#define CLIENT_DEFAULT_ROOM "general"
+#define CLIENT_RECONNECT_MIN_MS 1000
+#define CLIENT_RECONNECT_MAX_MS 30000
+#define CLIENT_TYPING_INTERVAL_MS 3000
 
 typedef struct client *Client;
 
 /**
- * Creates a client. Returns NULL on error.
+ * Creates a client, connected to the server on the given port.
+ * Returns NULL on error.
  */
-Client ClientNew(void);
+Client ClientNew(int port);
 
 /**
  * Frees a client.
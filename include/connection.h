@@ -0,0 +1,111 @@
+#ifndef CONNECTION_H
+#define CONNECTION_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <pthread.h>
+
+#include "gdmp.h"
+#include "gdmp_compress.h"
+#include "frame.h"
+#include "token_bucket.h"
+#include "stats.h"
+
+#define CONNECTION_SEND_QUEUE_SIZE 256
+#define CONNECTION_BATCH_HEADER_LEN 128
+#define CONNECTION_MAX_ROOMS 8
+
+typedef struct connection *Connection;
+typedef struct thread_pool *ThreadPool; // Prevent circular dependency
+typedef struct room *Room;
+
+/**
+ * A connection is the server side state of a client.
+ * Frames sent to a connection are queued, and written to its socket
+ * by a flush task, which packs queued text messages into batch messages,
+ * and compresses them if the client supports it.
+ * The socket is closed once the last reference to the connection is released.
+ */
+struct connection {
+    int sockfd;
+    GDMPParser parser;
+    ThreadPool pool;
+    Stats stats; // The server's, counting what is sent
+    atomic_int refs;
+    pthread_mutex_t send_lock;
+    Frame send_queue[CONNECTION_SEND_QUEUE_SIZE];
+    uint64_t queued_at[CONNECTION_SEND_QUEUE_SIZE]; // When each frame was queued (in us)
+    int send_head;
+    int send_count;
+    char *unsent; // Bytes of a flush the socket didn't take yet
+    size_t unsent_len;
+    GDMPCompressor compressor; // NULL unless negotiated
+    char username[GDMP_USERNAME_MAX_LEN]; // Empty until the client joins
+    Room rooms[CONNECTION_MAX_ROOMS]; // Only used by the client's receive tasks
+    int room_count;
+    bool peer; // A link to another server, rather than a client
+    char peer_id[GDMP_USERNAME_MAX_LEN]; // Empty until the other server says hello
+    TokenBucket message_rate; // Only used by the client's receive tasks
+    TokenBucket byte_rate;
+    unsigned long received; // Messages processed (only used by the receive tasks)
+    bool flushing;
+    bool closed;
+};
+
+/**
+ * Creates a connection for the given client socket, 
+ * flushed by tasks in the given thread pool, and counted in the given stats.
+ * Returns NULL on error.
+ */
+Connection ConnectionNew(int sockfd, ThreadPool pool, Stats stats);
+
+/**
+ * Adds a reference to a connection.
+ */
+void ConnectionRetain(Connection conn);
+
+/**
+ * Removes a reference to a connection. 
+ * Closes its socket and frees it after the last one.
+ */
+void ConnectionRelease(Connection conn);
+
+/**
+ * Shuts down a connection's socket, and drops its queued frames.
+ */
+void ConnectionClose(Connection conn);
+
+/**
+ * Queues a frame to be sent on a connection, and schedules a flush.
+ * Returns -1 if the frame was dropped (the queue is full, or it is closed).
+ */
+int ConnectionSend(Connection conn, Frame frame);
+
+/**
+ * Queues several frames to be sent on a connection, in order, 
+ * so they are written together by the same flush.
+ * Returns -1 if they were dropped (the queue can't hold them all, or it is closed).
+ */
+int ConnectionSendFrames(Connection conn, Frame *frames, int count);
+
+/**
+ * Serializes a message and queues it to be sent on a connection.
+ * Returns -1 on error, or if the message was dropped.
+ */
+int ConnectionSendMessage(Connection conn, GDMPMessage msg);
+
+/**
+ * Returns whether a connection has sent everything queued on it
+ * (and isn't closed).
+ */
+bool ConnectionIdle(Connection conn);
+
+/**
+ * Compresses what is sent on a connection from now on,
+ * once enough bytes are sent at a time. Returns -1 on error.
+ */
+int ConnectionEnableCompression(Connection conn);
+
+#endif
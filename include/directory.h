@@ -0,0 +1,58 @@
+// Directory Interface
+
+/**
+ * A directory is a concurrent map from names (such as usernames) to values
+ * (such as connections). Names are spread over stripes, each a hash table
+ * behind its own read-write lock, so lookups from different threads rarely
+ * wait on each other, and never on a single global lock.
+ */
+
+#ifndef DIRECTORY_H
+#define DIRECTORY_H
+
+#include <stdbool.h>
+
+#define DIRECTORY_STRIPE_COUNT 16
+
+typedef struct directory *Directory;
+
+/**
+ * Called on a value while it is looked up, before it can be removed.
+ */
+typedef void (*DirectoryRetain)(void *value);
+
+/**
+ * Creates a directory. Values returned by DirectoryGet are passed to retain
+ * first (unless it is NULL), so they outlive their removal.
+ * Returns NULL on error.
+ */
+Directory DirectoryNew(DirectoryRetain retain);
+
+/**
+ * Frees a directory. The values are not freed.
+ */
+void DirectoryFree(Directory dir);
+
+/**
+ * Maps a name to a value, copying the name.
+ * Returns -1 if the name is already taken, or on error.
+ */
+int DirectoryAdd(Directory dir, char *name, void *value);
+
+/**
+ * Returns the value the name maps to (retained), or NULL if there is none.
+ */
+void *DirectoryGet(Directory dir, char *name);
+
+/**
+ * Removes a name, if it still maps to the given value.
+ * Returns whether it was removed.
+ */
+bool DirectoryRemove(Directory dir, char *name, void *value);
+
+/**
+ * Returns the number of names in a directory.
+ */
+int DirectoryCount(Directory dir);
+
+#endif
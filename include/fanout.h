@@ -0,0 +1,80 @@
+#ifndef FANOUT_H
+#define FANOUT_H
+
+#include <stdbool.h>
+#include <stdatomic.h>
+
+#include "frame.h"
+#include "stats.h"
+
+#define FANOUT_CHUNK_SIZE 256 // Members sent to by a single task
+#define FANOUT_WIDTH 16 // Tasks a task splits its members into
+
+/**
+ * A fan-out sends frames to the members of a large room with tasks in the
+ * thread pool, so the sender doesn't send to each member itself. A frame's
+ * members are split into chunks (FANOUT_CHUNK_SIZE members), which tasks
+ * split between them (FANOUT_WIDTH at a time), so sending to a room takes
+ * time in proportion to its members divided by the workers.
+ *
+ * Frames are sent in the order they were queued: the members of one frame
+ * are all sent to before the next frame's tasks start.
+ * A fan-out is freed once its owner frees it, and the frames queued on it
+ * are sent.
+ */
+typedef struct fanout *Fanout;
+typedef struct fanout_job *FanoutJob;
+typedef struct snapshot *Snapshot;
+typedef struct connection *Connection; // Prevent circular dependency
+typedef struct thread_pool *ThreadPool;
+
+/**
+ * The members of a room at one point in time (each retained, so they stay
+ * while a frame is sent to them), shared by the frames sent to them.
+ */
+struct snapshot {
+    atomic_int refs;
+    Connection *members;
+    int count;
+};
+
+/**
+ * Creates an empty fan-out, sending frames with tasks in the given pool,
+ * and timing them in the given stats. Returns NULL on error.
+ */
+Fanout FanoutNew(ThreadPool pool, Stats stats);
+
+/**
+ * Frees a fan-out, once the frames queued on it are sent.
+ */
+void FanoutFree(Fanout fanout);
+
+/**
+ * Returns whether frames are still being sent (so a frame sent any other way
+ * would overtake them).
+ */
+bool FanoutBusy(Fanout fanout);
+
+/**
+ * Queues a frame to be sent to the members of a snapshot, except the given
+ * connection. Returns -1 on error.
+ */
+int FanoutSend(Fanout fanout, Snapshot members, Frame frame, Connection except);
+
+/**
+ * Creates a snapshot of the given members, retaining each of them.
+ * Returns NULL on error.
+ */
+Snapshot SnapshotNew(Connection *members, int count);
+
+/**
+ * Adds a reference to a snapshot.
+ */
+void SnapshotRetain(Snapshot snapshot);
+
+/**
+ * Removes a reference to a snapshot, releasing its members after the last one.
+ */
+void SnapshotRelease(Snapshot snapshot);
+
+#endif
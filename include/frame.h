@@ -0,0 +1,39 @@
+#ifndef FRAME_H
+#define FRAME_H
+
+#include <stddef.h>
+#include <stdatomic.h>
+
+#include "gdmp.h"
+
+typedef struct frame *Frame;
+
+/**
+ * A frame is a serialized GDMP message, shared by every connection
+ * it is queued on, and freed when the last one releases it.
+ */
+struct frame {
+    MessageType type;
+    atomic_int refs;
+    size_t len;
+    size_t type_len; // Length of the type line
+    char data[];
+};
+
+/**
+ * Creates a frame holding a copy of the serialized message.
+ * Returns NULL on error.
+ */
+Frame FrameNew(MessageType type, const char *data, size_t len);
+
+/**
+ * Adds a reference to a frame.
+ */
+void FrameRetain(Frame frame);
+
+/**
+ * Removes a reference to a frame, freeing it after the last one.
+ */
+void FrameRelease(Frame frame);
+
+#endif
@@ -4,24 +4,40 @@
 #define GDMP_H
 
 #include <stdbool.h>
+#include <stddef.h>
+#include <sys/types.h>
 
 #define GDMP_MESSAGE_MAX_LEN 1024
+#define GDMP_PARSER_BUFFER_SIZE (16 * GDMP_MESSAGE_MAX_LEN)
+#define GDMP_BATCH_MAX_COUNT 64
+#define GDMP_BATCH_MAX_LEN (8 * GDMP_MESSAGE_MAX_LEN)
 #define GDMP_HEADERS_MAX_COUNT 10
 #define GDMP_USERNAME_MAX_LEN 10
 #define GDMP_CONTENT_MAX_LEN 50
 #define GDMP_TIMESTAMP_MAX_LEN 10
+#define GDMP_ROOM_MAX_LEN 20
 
 enum message_type {
     GDMP_TEXT_MESSAGE,
     GDMP_JOIN_MESSAGE,
+    GDMP_BATCH_MESSAGE,
+    GDMP_HELLO_MESSAGE,
+    GDMP_COMPRESSED_MESSAGE,
+    GDMP_LEAVE_MESSAGE,
+    GDMP_DIRECT_MESSAGE,
+    GDMP_REJECT_MESSAGE,
+    GDMP_TYPING_MESSAGE,
+    GDMP_PRESENCE_MESSAGE,
+    GDMP_PEER_MESSAGE,
     GDMP_ERROR_MESSAGE,
 };
 
 typedef struct gdmp_message *GDMPMessage;
+typedef struct gdmp_parser *GDMPParser;
 typedef enum message_type MessageType;
 
 /**
- * Creates a GDMP message.
+ * Creates a GDMP message, with room for GDMP_MESSAGE_MAX_LEN bytes of headers.
  */
 GDMPMessage GDMPNew(MessageType type);
 
@@ -31,10 +47,11 @@ GDMPMessage GDMPNew(MessageType type);
 void GDMPFree(GDMPMessage msg);
 
 /**
- * Adds a header with the given value to a GDMP message.
- * Replaces the value if header already exists.
+ * Adds a header with the given value to a GDMP message, which keeps its own
+ * copy of both. Replaces the value if header already exists.
+ * Returns -1 if the message has no room left for them.
  */
-void GDMPAddHeader(GDMPMessage msg, char *header, char *value);
+int GDMPAddHeader(GDMPMessage msg, char *header, char *value);
 
 /**
  * Returns the message type of the gdmp message.
@@ -42,13 +59,15 @@ void GDMPAddHeader(GDMPMessage msg, char *header, char *value);
 MessageType GDMPGetType(GDMPMessage msg);
 
 /**
- * Returns a header's value in the GDMP message.
+ * Returns a header's value in the GDMP message, owned by the message.
  * Returns NULL if it doesn't exist.
  */
 char *GDMPGetValue(GDMPMessage msg, char *header);
 
 /**
- * Serializes a GDMP message into a string.
+ * Serializes a GDMP message into a string, with its headers in the order
+ * they were added. The string ends with an empty line, which marks the end
+ * of the message.
  */
 char *GDMPStringify(GDMPMessage msg);
 
@@ -65,8 +84,78 @@ GDMPMessage GDMPParse(char *str);
 bool GDMPValidate(GDMPMessage msg, MessageType type);
 
 /**
- * Creates a deep copy of a GDMP message.
+ * Creates a deep copy of a GDMP message. The copy is independent of the
+ * original, and made with a single allocation unless it has many headers.
  */
 GDMPMessage GDMPCopy(GDMPMessage msg);
 
+/**
+ * Creates a GDMP stream parser. Returns NULL on error.
+ * A parser is fed the bytes of a stream in chunks of any size,
+ * and returns each message once all of its bytes have arrived.
+ */
+GDMPParser GDMPParserNew(void);
+
+/**
+ * Frees a GDMP stream parser, along with any partially received message.
+ */
+void GDMPParserFree(GDMPParser parser);
+
+/**
+ * Copies the given bytes into the parser.
+ * Returns -1 if they don't fit (the current message is too long).
+ */
+int GDMPParserFeed(GDMPParser parser, const char *data, size_t len);
+
+/**
+ * Returns the free space at the end of the parser's buffer and stores its size
+ * in len, so bytes can be received into the parser without an extra copy.
+ * The size is 0 if the current message is too long to ever complete.
+ */
+char *GDMPParserBuffer(GDMPParser parser, size_t *len);
+
+/**
+ * Marks len bytes written into the space returned by GDMPParserBuffer
+ * as received.
+ */
+void GDMPParserCommit(GDMPParser parser, size_t len);
+
+/**
+ * Returns the next complete message received by the parser,
+ * or NULL if more bytes are needed.
+ * Messages packed in a batch or compressed message are returned one at a time.
+ */
+GDMPMessage GDMPParserNext(GDMPParser parser);
+
+/**
+ * Stores a pointer to the bytes received but not parsed yet in data, so
+ * another parser can be fed them to carry on with the stream.
+ * Returns their length, or -1 if the parser is in the middle of a message
+ * (its headers are parsed, or a batch or compressed message is unpacked).
+ */
+ssize_t GDMPParserPending(GDMPParser parser, const char **data);
+
+/**
+ * Copies the parser's decompression window into buf (of at least
+ * GDMP_COMPRESSION_WINDOW_SIZE bytes), so another parser can carry on with
+ * a compressed stream. Returns its length (0 if nothing was compressed),
+ * or -1 on error.
+ */
+ssize_t GDMPParserWindow(GDMPParser parser, char *buf);
+
+/**
+ * Sets the decompression window of a new parser, carrying on with a stream
+ * another parser started. Returns -1 on error.
+ */
+int GDMPParserSetWindow(GDMPParser parser, const char *window, size_t len);
+
+/**
+ * Writes the headers of a batch message into buf (of the given size),
+ * for count messages of the given type whose serializations without their
+ * type line add up to body_len bytes. The batch is sent as these headers
+ * followed by those serializations.
+ * Returns the length of the headers, or -1 if they don't fit.
+ */
+int GDMPBatchHeader(char *buf, size_t size, MessageType type, int count, size_t body_len);
+
 #endif
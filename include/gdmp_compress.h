@@ -0,0 +1,90 @@
+// GDMP Compression Interface
+
+/**
+ * GDMP compression packs serialized messages into the body of a compressed
+ * message. It uses raw deflate with one window for the whole connection,
+ * so headers repeated across messages compress to a few bytes. Each
+ * compressed message is flushed, so it can be decompressed as soon as it
+ * arrives. The window is kept small, since every connection has its own.
+ */
+
+#ifndef GDMP_COMPRESS_H
+#define GDMP_COMPRESS_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+
+#define GDMP_COMPRESSION_NAME "deflate"
+#define GDMP_COMPRESSION_MIN_LEN 256
+#define GDMP_COMPRESSION_LEVEL 6
+#define GDMP_COMPRESSION_WINDOW_BITS 12
+#define GDMP_COMPRESSION_WINDOW_SIZE (1 << GDMP_COMPRESSION_WINDOW_BITS)
+#define GDMP_COMPRESSION_MEM_LEVEL 5
+
+typedef struct gdmp_compressor *GDMPCompressor;
+typedef struct gdmp_decompressor *GDMPDecompressor;
+
+/**
+ * Creates a compressor for one direction of a connection.
+ * Returns NULL on error.
+ */
+GDMPCompressor GDMPCompressorNew(void);
+
+/**
+ * Frees a compressor.
+ */
+void GDMPCompressorFree(GDMPCompressor comp);
+
+/**
+ * Compresses the bytes of the given iovecs (one or more serialized
+ * messages) into a compressed message, and stores its length in len.
+ * Returns the message (to be freed by the caller), or NULL on error.
+ */
+char *GDMPCompress(GDMPCompressor comp, const struct iovec *iov, int iov_count, size_t *len);
+
+/**
+ * Creates a decompressor for one direction of a connection.
+ * Returns NULL on error.
+ */
+GDMPDecompressor GDMPDecompressorNew(void);
+
+/**
+ * Frees a decompressor.
+ */
+void GDMPDecompressorFree(GDMPDecompressor decomp);
+
+/**
+ * Sets the body of a compressed message as the bytes to decompress.
+ * The bytes must stay in place until they are fully decompressed
+ * (or be followed with GDMPDecompressorMoveInput).
+ */
+void GDMPDecompressorInput(GDMPDecompressor decomp, const char *data, size_t len);
+
+/**
+ * Follows the bytes being decompressed, once the caller moved them back by
+ * offset bytes (to the front of its buffer).
+ */
+void GDMPDecompressorMoveInput(GDMPDecompressor decomp, size_t offset);
+
+/**
+ * Decompresses into buf (of the given size), returns the number of bytes
+ * written, or -1 on error. Sets done once all the input is decompressed.
+ */
+ssize_t GDMPDecompress(GDMPDecompressor decomp, char *buf, size_t size, bool *done);
+
+/**
+ * Copies the window (the last bytes decompressed, which later compressed
+ * messages can refer back to) into buf, of at least
+ * GDMP_COMPRESSION_WINDOW_SIZE bytes. Returns its length, or -1 on error.
+ */
+ssize_t GDMPDecompressorWindow(GDMPDecompressor decomp, char *buf);
+
+/**
+ * Sets the window of a new decompressor, so it carries on decompressing
+ * a stream another one started. Returns -1 on error.
+ */
+int GDMPDecompressorSetWindow(GDMPDecompressor decomp, const char *window, size_t len);
+
+#endif
@@ -0,0 +1,46 @@
+// GDMP Scanner Interface
+
+/**
+ * The GDMP scanner finds every line break and header separator (": ")
+ * of a frame in a single pass. It uses AVX2 or SSE2 when the CPU supports
+ * them (chosen once at runtime), and a scalar loop otherwise.
+ */
+
+#ifndef GDMP_SCAN_H
+#define GDMP_SCAN_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+enum delim_type {
+    GDMP_DELIM_NEWLINE,
+    GDMP_DELIM_SEPARATOR,
+};
+
+typedef enum delim_type DelimType;
+
+struct gdmp_delim {
+    uint32_t offset;
+    DelimType type;
+};
+
+typedef struct gdmp_delim GDMPDelim;
+
+/**
+ * Scans the first len bytes of str, storing the delimiters found in order.
+ * Stops after max_delims delimiters, returns the number stored.
+ * A separator's offset is the offset of its ':'.
+ */
+size_t GDMPScan(const char *str, size_t len, GDMPDelim *delims, size_t max_delims);
+
+/**
+ * Same as GDMPScan, but always uses the scalar implementation.
+ */
+size_t GDMPScanScalar(const char *str, size_t len, GDMPDelim *delims, size_t max_delims);
+
+/**
+ * Returns the name of the implementation used by GDMPScan.
+ */
+const char *GDMPScanName(void);
+
+#endif
@@ -1,16 +1,28 @@
 // Hash Table Interface
 
+/**
+ * A hash table maps string keys to values. Keys and values are not copied,
+ * so they must outlive their entry. The table grows as keys are inserted.
+ */
+
 #ifndef HASH_TABLE_H
 #define HASH_TABLE_H
 
 #include <stdbool.h>
 
 typedef struct hash_table *HashTable;
+typedef struct hash_table_iterator HashTableIterator;
 typedef char *Key;
-typedef char *Value;
+typedef void *Value;
+
+struct hash_table_iterator {
+    HashTable table;
+    int idx;
+};
 
 /**
- * Creates a new hash table.
+ * Creates a new hash table, with room for the given number of keys
+ * before it needs to grow.
  */
 HashTable HashTableNew(int num_slots);
 
@@ -32,13 +44,35 @@ bool HashTableContains(HashTable table, Key key);
 
 /**
  * Returns the value that the given key maps to in the hash table.
- * Assumes that the key exists.
+ * Returns NULL if the key doesn't exist.
  */
 Value HashTableGet(HashTable table, Key key);
 
 /**
- * Creates a deep copy of a hash table.
+ * Removes a key from a hash table. Returns false if it didn't exist.
+ */
+bool HashTableDelete(HashTable table, Key key);
+
+/**
+ * Returns the number of keys in a hash table.
+ */
+int HashTableSize(HashTable table);
+
+/**
+ * Creates a copy of a hash table. The keys and values themselves are shared.
  */
 HashTable HashTableCopy(HashTable table);
 
+/**
+ * Returns an iterator over the key value pairs of a hash table,
+ * which must not be modified while iterating.
+ */
+HashTableIterator HashTableIterate(HashTable table);
+
+/**
+ * Stores the next key value pair of the iteration in key and value.
+ * Returns false once every pair has been visited.
+ */
+bool HashTableNext(HashTableIterator *it, Key *key, Value *value);
+
 #endif
@@ -0,0 +1,81 @@
+// Logger Interface
+
+/**
+ * A logger writes log lines from a background thread, so the threads logging
+ * never wait on the output (or on each other). Each thread logs into a ring
+ * of its own, as binary records: the format string (kept by pointer, so it
+ * must be a string literal) and a copy of the arguments. The background
+ * thread takes the records from every ring in the order they were logged,
+ * formats them, and writes them.
+ *
+ * A thread whose ring is full drops the record rather than waiting, and
+ * counts it. Records below the logger's level (which can be changed at any
+ * time) aren't logged at all.
+ *
+ * Formats take the printf conversions d, i, u, x, X, o, c, s, p, f, e and g
+ * (with flags, a width and a precision, but not *), and the length modifiers
+ * hh, h, l, ll, z, j and t. Strings are cut short to fit in the record.
+ */
+
+#ifndef LOGGER_H
+#define LOGGER_H
+
+#include <stdio.h>
+
+#define LOGGER_RING_SIZE 1024 // Records per thread
+#define LOGGER_ARGS_SIZE 256 // Bytes of a record's arguments
+#define LOGGER_MAX_THREADS 64 // Threads beyond this drop their records
+#define LOGGER_LINE_MAX_LEN 1024
+#define LOGGER_FLUSH_MS 10 // How often the background thread writes
+
+typedef enum log_level {
+    LOG_DEBUG,
+    LOG_INFO,
+    LOG_WARN, // Warnings and errors are written to the error stream
+    LOG_ERROR,
+} LogLevel;
+
+typedef struct logger *Logger;
+
+/**
+ * Creates a logger writing records at the given level and above, to out
+ * (or to err, from LOG_WARN up), and starts its background thread.
+ * Returns NULL on error.
+ */
+Logger LoggerNew(FILE *out, FILE *err, LogLevel level);
+
+/**
+ * Writes every record logged so far, stops the background thread,
+ * and frees a logger.
+ */
+void LoggerFree(Logger logger);
+
+/**
+ * Logs a record at the given level (if it's at the logger's level or above).
+ * Never waits: the record is dropped if the calling thread's ring is full.
+ */
+void LoggerLog(Logger logger, LogLevel level, const char *format, ...)
+    __attribute__((format(printf, 3, 4)));
+
+/**
+ * Changes the level records must be at to be logged.
+ */
+void LoggerSetLevel(Logger logger, LogLevel level);
+
+/**
+ * Returns the level records must be at to be logged.
+ */
+LogLevel LoggerLevel(Logger logger);
+
+/**
+ * Returns the level with the given name (debug, info, warn or error),
+ * or -1 if there is none.
+ */
+int LoggerLevelNamed(const char *name);
+
+/**
+ * Returns the number of records dropped, since a ring was full.
+ */
+unsigned long LoggerDropped(Logger logger);
+
+#endif
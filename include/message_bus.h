@@ -0,0 +1,62 @@
+// Message Bus Interface
+
+/**
+ * A message bus broadcasts messages between the processes of one host,
+ * through a ring in shared memory (a file in /dev/shm). Every process that
+ * opens the bus is both a publisher and a consumer, with its own cursor.
+ *
+ * Publishers take turns (behind a process-shared lock) and never wait on
+ * consumers: a consumer that falls a whole ring behind skips ahead, and
+ * counts the messages it lost. Consumers never take a lock. They wait for
+ * new messages on a futex in the ring, which publishers only wake when
+ * someone is waiting.
+ */
+
+#ifndef MESSAGE_BUS_H
+#define MESSAGE_BUS_H
+
+#include <stddef.h>
+
+#define MESSAGE_BUS_DIR "/dev/shm/"
+#define MESSAGE_BUS_MAX_CONSUMERS 16
+#define MESSAGE_BUS_RECORD_MAX_LEN 4096
+
+typedef struct message_bus *MessageBus;
+
+/**
+ * Called for each message read from the bus, with its data (null terminated,
+ * valid until the visit returns).
+ */
+typedef void (*BusVisit)(const char *data, size_t len, void *arg);
+
+/**
+ * Opens the bus with the given name, creating it with a ring of size bytes
+ * (a power of two) if it doesn't exist, and joins it as a consumer
+ * (reading the messages published from then on). Returns NULL on error.
+ */
+MessageBus MessageBusOpen(const char *name, size_t size);
+
+/**
+ * Leaves a bus (which stays for the other processes).
+ */
+void MessageBusClose(MessageBus bus);
+
+/**
+ * Publishes a copy of the data to every other consumer of the bus.
+ * Returns -1 on error (it's longer than MESSAGE_BUS_RECORD_MAX_LEN).
+ */
+int MessageBusPublish(MessageBus bus, const char *data, size_t len);
+
+/**
+ * Reads the messages published by other consumers since the last read,
+ * waiting up to timeout_ms for one if there are none.
+ * Returns the number of messages read.
+ */
+int MessageBusRead(MessageBus bus, BusVisit visit, void *arg, int timeout_ms);
+
+/**
+ * Returns the number of messages this consumer lost by falling behind.
+ */
+unsigned long MessageBusLost(MessageBus bus);
+
+#endif
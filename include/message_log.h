@@ -0,0 +1,111 @@
+// Message Log Interface
+
+/**
+ * A message log durably stores messages, in the order they are appended,
+ * in a directory of append-only segment files. Appending only queues the
+ * message (without locks). A writer thread writes what is queued in batches,
+ * syncing each batch to disk with one call (group commit).
+ * Each record has a sequence number, a timestamp and a CRC, so a record
+ * torn by a crash is detected (and truncated) when the log is reopened.
+ *
+ * Segments are mapped read-only, with a sparse index of every
+ * MESSAGE_LOG_INDEX_INTERVAL-th record's sequence number and time, so history
+ * is read straight from the page cache: a binary search of the index, then
+ * a scan of contiguous records. Reads never take a lock, and never wait on
+ * the writer.
+ */
+
+#ifndef MESSAGE_LOG_H
+#define MESSAGE_LOG_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#define MESSAGE_LOG_BATCH_MAX 256
+#define MESSAGE_LOG_RECORD_MAX_LEN (1024 * 1024)
+#define MESSAGE_LOG_MAX_SEGMENTS 4096
+#define MESSAGE_LOG_INDEX_INTERVAL 64
+
+enum message_log_sync {
+    MESSAGE_LOG_SYNC_NONE,  // Never sync, leave it to the OS
+    MESSAGE_LOG_SYNC_BATCH, // Sync after each batch
+    MESSAGE_LOG_SYNC_EACH,  // Sync after each record
+};
+
+typedef enum message_log_sync MessageLogSync;
+typedef struct message_log *MessageLog;
+
+/**
+ * The header of a record, followed by len bytes of data in a segment.
+ * A segment is named after the sequence number of its first record.
+ */
+struct log_record {
+    uint32_t crc; // Of the rest of the header, and the data
+    uint32_t len;
+    uint64_t seq;
+    int64_t time; // Nanoseconds since the epoch
+};
+
+typedef struct log_record LogRecord;
+
+/**
+ * Called for each record read, with its header and data (valid until the log
+ * is freed). Returns false to stop reading.
+ */
+typedef bool (*LogVisit)(LogRecord *record, const char *data, void *arg);
+
+/**
+ * Opens the message log in the given directory (creating it if needed),
+ * starting a new segment file once one reaches segment_size bytes.
+ * Returns NULL on error.
+ */
+MessageLog MessageLogNew(const char *dir, MessageLogSync sync, size_t segment_size);
+
+/**
+ * Writes everything appended so far, and frees a message log.
+ */
+void MessageLogFree(MessageLog log);
+
+/**
+ * Queues a copy of the data to be written as a record. Never waits on disk.
+ * Returns -1 on error.
+ */
+int MessageLogAppend(MessageLog log, const char *data, size_t len);
+
+/**
+ * Waits until everything appended so far is written (and synced, unless
+ * the log never syncs).
+ */
+void MessageLogFlush(MessageLog log);
+
+/**
+ * Returns the sequence number of the last record written, 0 if there is none.
+ */
+uint64_t MessageLogLastSeq(MessageLog log);
+
+/**
+ * Returns the sequence number of the first record written at or after
+ * the given time (in nanoseconds since the epoch), or the one following
+ * the last record if there is none.
+ */
+uint64_t MessageLogFindTime(MessageLog log, int64_t time);
+
+/**
+ * Visits the records written so far from the given sequence number onwards,
+ * oldest first.
+ */
+void MessageLogRead(MessageLog log, uint64_t seq, LogVisit visit, void *arg);
+
+/**
+ * Visits the records written so far up to the given sequence number,
+ * newest first.
+ */
+void MessageLogReadBack(MessageLog log, uint64_t seq, LogVisit visit, void *arg);
+
+/**
+ * Returns the CRC of a record, for the given header and data.
+ */
+uint32_t LogRecordCRC(LogRecord *record, const char *data);
+
+#endif
@@ -0,0 +1,37 @@
+// Probes Interface
+
+/**
+ * Probes are static tracepoints (USDT, as used by SystemTap, bpftrace and perf)
+ * in the server's hot paths, under the gdaymate provider. A probe compiles to a
+ * single nop (and a note in the binary saying where it is), which a tracer
+ * swaps for a breakpoint while it is attached, so probes cost nothing otherwise.
+ * Their arguments should be values already at hand, since they're computed
+ * either way.
+ *
+ * Without sys/sdt.h (from systemtap-sdt-dev), or with GDAYMATE_NO_PROBES
+ * defined, probes compile to nothing at all.
+ */
+
+#ifndef PROBES_H
+#define PROBES_H
+
+#if defined(__has_include) && !defined(GDAYMATE_NO_PROBES)
+#if __has_include(<sys/sdt.h>)
+#include <sys/sdt.h>
+#define GDAYMATE_PROBES 1
+#endif
+#endif
+
+#ifdef GDAYMATE_PROBES
+#define PROBE(name) DTRACE_PROBE(gdaymate, name)
+#define PROBE1(name, a) DTRACE_PROBE1(gdaymate, name, a)
+#define PROBE2(name, a, b) DTRACE_PROBE2(gdaymate, name, a, b)
+#define PROBE3(name, a, b, c) DTRACE_PROBE3(gdaymate, name, a, b, c)
+#else
+#define PROBE(name) do {} while (0)
+#define PROBE1(name, a) do { (void)sizeof(a); } while (0)
+#define PROBE2(name, a, b) do { (void)sizeof(a); (void)sizeof(b); } while (0)
+#define PROBE3(name, a, b, c) do { (void)sizeof(a); (void)sizeof(b); (void)sizeof(c); } while (0)
+#endif
+
+#endif
@@ -0,0 +1,185 @@
+#ifndef ROOM_H
+#define ROOM_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <pthread.h>
+
+#include "gdmp.h"
+#include "frame.h"
+#include "message_log.h"
+#include "message_bus.h"
+#include "fanout.h"
+#include "stats.h"
+
+#define ROOM_INITIAL_CAPACITY 8
+#define ROOM_HISTORY_SIZE 32
+#define ROOM_HISTORY_MAX_LEN GDMP_BATCH_MAX_LEN // Replayed by a single flush
+#define ROOM_RESUME_MAX 128 // Fits in a connection's send queue
+#define ROOM_RESUME_SCAN_MAX 65536 // Log records looked at when resuming
+#define ROOM_PRESENCE_MAX 16 // Usernames per list in a presence message
+#define ROOM_MAX_PEERS 16 // Links to other servers
+
+typedef struct presence_set PresenceSet;
+typedef struct room *Room;
+typedef struct rooms *Rooms;
+typedef struct connection *Connection; // Prevent circular dependency
+typedef struct thread_pool *ThreadPool;
+
+/**
+ * A set of usernames.
+ */
+struct presence_set {
+    char (*names)[GDMP_USERNAME_MAX_LEN];
+    int count;
+    int capacity;
+};
+
+/**
+ * A room is a named group of connections, which text messages are sent to.
+ * Members are kept in a dense array, so sending to them is a single scan.
+ * The last messages sent to the room are kept (as frames, in a ring bounded
+ * by count and bytes), and replayed to each client that joins.
+ * A room exists while it has members.
+ *
+ * Each message sent to a room is numbered with a sequence number, higher than
+ * the last one sent to it: the time in microseconds, or the last one plus one
+ * if that's higher. So numbers keep increasing after a room is freed,
+ * or the server restarts. A client resuming after a dropped connection only
+ * gets the messages after the last one it saw, from the history (or the
+ * message log, if the history doesn't go back far enough).
+ *
+ * Joins, leaves and typing aren't sent as they happen: they're collected in
+ * sets (a leave cancels a join in the same tick, and the other way around),
+ * and each tick a room with changes sends one presence message to each member.
+ *
+ * A room can span servers linked to each other (peers). Each server tells its
+ * peers which rooms it has members in, and a room also sends its members'
+ * messages to the peers with members in it. Messages relayed by a peer are
+ * only sent to the room's own members, never on to other peers, so with every
+ * server linked to every other one, a message crosses a single link and can't
+ * loop. A room exists while it has members, or peers with members in it.
+ * Server processes on the same host can share a message bus instead, where
+ * a room publishes its members' messages for every other process (the same
+ * way, messages read from the bus are only sent to the room's own members).
+ *
+ * A room with more members than fit in a fan-out chunk doesn't send to them
+ * itself: it hands each message to its fan-out, with a snapshot of its members
+ * (taken once, and shared by every message until the members change).
+ */
+struct room {
+    char name[GDMP_ROOM_MAX_LEN];
+    pthread_rwlock_t lock; // Held for reading while sending to members
+    Connection *members;
+    int member_count;
+    int member_capacity;
+    Connection peers[ROOM_MAX_PEERS]; // Links to servers with members in the room
+    int peer_count;
+    Fanout fanout; // Sends to the members of a large room
+    Snapshot snapshot; // Of the members (NULL until a large send, or once they change)
+    pthread_mutex_t history_lock; // Senders hold the room lock for reading
+    uint64_t seq; // Of the last message sent
+    MessageLog log;
+    MessageBus bus; // NULL unless the server shares one
+    Stats stats; // The server's, timing sends to the members
+    Frame history[ROOM_HISTORY_SIZE];
+    uint64_t history_seqs[ROOM_HISTORY_SIZE];
+    pthread_mutex_t presence_lock;
+    PresenceSet joined; // Since the last tick
+    PresenceSet left;
+    PresenceSet typing;
+    int history_head;
+    int history_count;
+    size_t history_len;
+};
+
+/**
+ * Creates an empty set of rooms, storing their messages in the given log,
+ * and publishing them on the given bus (unless it's NULL). Large rooms send
+ * messages to their members with tasks in the given thread pool, and time
+ * sends in the given stats. The server's id is sent to its peers with each
+ * room it has members in. Returns NULL on error.
+ */
+Rooms RoomsNew(MessageLog log, MessageBus bus, ThreadPool pool, Stats stats, char *id);
+
+/**
+ * Frees a set of rooms, releasing their members.
+ */
+void RoomsFree(Rooms rooms);
+
+/**
+ * Adds a connection to the room with the given name, creating the room
+ * if it doesn't exist, and queues the room's history on it. If seq isn't 0,
+ * the connection is resuming: only the messages after seq (not sent by it)
+ * are queued. Returns the room, or NULL on error.
+ */
+Room RoomsJoin(Rooms rooms, char *name, Connection conn, uint64_t seq);
+
+/**
+ * Adds a connection taken over from another server process to the room with
+ * the given name, creating the room if it doesn't exist. Unlike a join,
+ * nothing is queued on it, and the room's members aren't told.
+ * Returns the room, or NULL on error.
+ */
+Room RoomsRejoin(Rooms rooms, char *name, Connection conn);
+
+/**
+ * Removes a connection from a room, freeing the room if it was the last member.
+ */
+void RoomsLeave(Rooms rooms, Room room, Connection conn);
+
+/**
+ * Notes that a member of a room is typing, for the next tick.
+ */
+void RoomTyping(Room room, char *username);
+
+/**
+ * Sends the presence changes of every room since the last tick to its members
+ * (one message per room with changes). Called once per tick.
+ */
+void RoomsFlushPresence(Rooms rooms);
+
+/**
+ * Adds a link to another server, and tells it which rooms have members here
+ * (and from then on, which rooms get their first member or lose their last).
+ * Returns -1 on error (too many links, or one to the same server).
+ */
+int RoomsAddPeer(Rooms rooms, Connection link);
+
+/**
+ * Removes a link to another server, from the set and from every room.
+ */
+void RoomsRemovePeer(Rooms rooms, Connection link);
+
+/**
+ * Notes that the server at the other end of a link has members in the room
+ * with the given name, creating the room if it doesn't exist.
+ */
+void RoomsPeerJoin(Rooms rooms, char *name, Connection link);
+
+/**
+ * Notes that the server at the other end of a link has no members left
+ * in the room with the given name.
+ */
+void RoomsPeerLeave(Rooms rooms, char *name, Connection link);
+
+/**
+ * Sends a text message relayed by a link (or read from the bus, if link is
+ * NULL) to the members of its room (numbered and stored like any other),
+ * if the room has any. Returns the number of members that dropped it,
+ * or -1 on error.
+ */
+int RoomsRelay(Rooms rooms, GDMPMessage msg, Connection link);
+
+/**
+ * Numbers a text message with the room's next sequence number (as its Seq
+ * header), stores it in the log and the room's history, and queues it on
+ * every member except the given connection (in a large room, tasks queue it
+ * after this returns). Unless the message was relayed from another server,
+ * it's also queued on the room's peers, and published on the bus.
+ * Returns the number of members that dropped it (that it queued it on itself),
+ * or -1 on error.
+ */
+int RoomSend(Room room, GDMPMessage msg, Connection except, bool relayed);
+
+#endif
@@ -4,33 +4,149 @@
 #include <poll.h>
 #include <pthread.h>
 #include <stdatomic.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "message_log.h"
+#include "message_bus.h"
+#include "stats.h"
+#include "logger.h"
+
+/**
+ * What happens to a client sending faster than its rate limit.
+ */
+typedef enum rate_policy {
+    RATE_POLICY_DROP, // Read and discard its messages
+    RATE_POLICY_DELAY, // Stop reading from it until it is back under the limit
+    RATE_POLICY_DISCONNECT,
+} RatePolicy;
 
 #define SERVER_PORT 8080
 #define SERVER_THREAD_COUNT 5
 #define SERVER_MAX_BACKLOG 5
 #define SERVER_MAX_CLIENT_COUNT 1024
 #define SERVER_MAX_POLL_COUNT 1024
+#define SERVER_MAX_FD 4096
 #define SERVER_POLL_TIMEOUT 0
 #define SERVER_DEBUG_MODE 1
+#define SERVER_LOG_LEVEL (SERVER_DEBUG_MODE ? LOG_DEBUG : LOG_INFO) // Until changed
+#define SERVER_LOG_DIR "messages"
+#define SERVER_LOG_SYNC MESSAGE_LOG_SYNC_BATCH
+#define SERVER_LOG_SEGMENT_SIZE (64 * 1024 * 1024)
+#define SERVER_PRESENCE_TICK_MS 500
+#define SERVER_BUS_SIZE (4 * 1024 * 1024)
+#define SERVER_BUS_WAIT_MS 100
+#define SERVER_MAX_PEERS 8 // Servers this one links with
+#define SERVER_PEER_RETRY_MS 1000
+#define SERVER_ID_LEN 9 // Hex digits, and the null terminator (fits in a username)
+#define SERVER_RATE_POLICY RATE_POLICY_DELAY
+#define SERVER_RATE_MESSAGES 20 // Per second, per client
+#define SERVER_RATE_MESSAGES_BURST 40
+#define SERVER_RATE_BYTES (16 * 1024) // Per second, per client
+#define SERVER_RATE_BYTES_BURST (64 * 1024)
+#define SERVER_UPGRADE_PATH "upgrade.sock" // In the working directory
+#define SERVER_DRAIN_MS 2000 // Longest wait for clients to go quiet before a handoff
+#define SERVER_STATS_TIMEOUT_MS 100 // Longest wait for a stats request
+#define SERVER_STATS_MAX_LEN 8192 // Of a stats request, and of the stats
 
 typedef struct server *Server;
 typedef struct thread_pool *ThreadPool; // Prevent circular dependency
+typedef struct connection *Connection;
+typedef struct directory *Directory;
+typedef struct rooms *Rooms;
+
+/**
+ * The address of a server to link with.
+ */
+struct peer_address {
+    char host[64]; // An IPv4 address
+    int port;
+    int sockfd; // Of the link, or -1 while there isn't one
+};
+
+struct delayed_client {
+    int sockfd;
+    uint64_t until; // When to read from it again (in ms)
+};
 
 struct server {
+    char id[SERVER_ID_LEN]; // Random, identifies this server to its peers
+    int port;
     int sockfd;
     int *clients;
     int client_count;
+    Connection *connections; // Indexed by client socket file descriptor
+    Directory users; // Maps usernames to connections (once joined)
+    Rooms rooms;
+    MessageLog log; // Every text message sent to a room
+    MessageBus bus; // Shared with the other server processes on the host (or NULL)
+    pthread_t bus_reader;
+    struct peer_address peers[SERVER_MAX_PEERS];
+    int peer_count;
+    char allowed_peers[SERVER_MAX_PEERS][64]; // Hosts that can link with this server, besides its peers
+    int allowed_count;
     struct pollfd *poll_set;
     int poll_count;
+    struct delayed_client delayed[SERVER_MAX_CLIENT_COUNT]; // Held out of the poll set by the rate limit
+    int delayed_count;
+    RatePolicy rate_policy;
+    Stats stats; // Counted per thread (see server_stats.h)
+    int stats_sockfd; // Serves the stats on a local port (or -1)
+    int trace_every; // Trace one in this many messages of a client (or 0)
+    Logger logger; // Writes the server's logs off the threads logging them
     ThreadPool pool;
+    int upgrade_sockfd; // Where a new process asks to take over (-1 once it has)
+    bool handed_off; // The clients are the new process's now
     atomic_bool shutdown;
     pthread_mutex_t lock;
 };
 
 /**
- * Creates a server. Returns NULL on error.
+ * Creates a server, listening on the given port. If bus isn't NULL, it's the
+ * name of a message bus shared with other server processes on this host,
+ * which can then listen on the same port. If upgrade is true, the server takes
+ * over the listening socket and clients of the server running in the same
+ * directory (which exits), instead of binding the port itself.
+ * Returns NULL on error.
+ */
+Server ServerNew(int port, char *bus, bool upgrade);
+
+/**
+ * Adds a server to link with (at an IPv4 address and port), so rooms span both.
+ * The link is made once the server starts, and made again if it drops.
+ * Returns -1 on error.
+ */
+int ServerAddPeer(Server srv, char *host, int port);
+
+/**
+ * Lets a server at the given IPv4 address link with this one (the peers
+ * added with ServerAddPeer can already). A peer message from any other
+ * address is rejected, and its connection closed. Returns -1 on error.
+ */
+int ServerAllowPeer(Server srv, char *host);
+
+/**
+ * Serves the server's stats (in Prometheus text format, over HTTP) on the
+ * given port of the loopback address. Returns -1 on error.
+ */
+int ServerServeStats(Server srv, int port);
+
+/**
+ * Prints the latency of each stage of one in every messages of each client
+ * (or none, if every is 0).
+ */
+void ServerTrace(Server srv, int every);
+
+/**
+ * Changes the level a server's logs must be at to be written
+ * (safe to call from a signal handler).
+ */
+void ServerSetLogLevel(Server srv, LogLevel level);
+
+/**
+ * Returns the level a server's logs must be at to be written.
  */
-Server ServerNew(void);
+LogLevel ServerLogLevel(Server srv);
 
 /**
  * Frees a server.
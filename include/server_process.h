@@ -11,13 +11,63 @@
 void process_message(Server srv, GDMPMessage msg, int client_sockfd);
 
 /**
- * Processes a GDMP text message.
+ * Processes a GDMP text message, sending it to the other members of its room.
  */
 void process_text_message(Server srv, GDMPMessage msg, int client_sockfd);
 
 /**
- * Processes a GDMP join message.
+ * Processes a GDMP join message, registering the client's username 
+ * (unless it is taken) and adding the client to the room.
  */
 void process_join_message(Server srv, GDMPMessage msg, int client_sockfd);
 
+/**
+ * Processes a GDMP leave message, removing the client from the room.
+ */
+void process_leave_message(Server srv, GDMPMessage msg, int client_sockfd);
+
+/**
+ * Processes a GDMP direct message, sending it to the connection of its
+ * recipient (found in the users directory), or rejecting it if they're offline.
+ */
+void process_direct_message(Server srv, GDMPMessage msg, int client_sockfd);
+
+/**
+ * Processes a GDMP typing message, noting the client is typing in the room
+ * (sent to its members with the room's next presence message).
+ */
+void process_typing_message(Server srv, GDMPMessage msg, int client_sockfd);
+
+/**
+ * Processes a GDMP hello message, 
+ * replying with the compression chosen for the connection.
+ */
+void process_hello_message(Server srv, GDMPMessage msg, int client_sockfd);
+
+/**
+ * Processes a GDMP message from a link to another server: a text message
+ * it relays, a join or leave telling which rooms it has members in, or its hello.
+ */
+void process_link_message(Server srv, GDMPMessage msg, int client_sockfd);
+
+/**
+ * Processes a GDMP text message relayed by another server, sending it to the
+ * members of its room on this server (dropping it if it came from this one).
+ */
+void process_relayed_message(Server srv, GDMPMessage msg, int client_sockfd);
+
+/**
+ * Processes a GDMP text message read from the message bus (published by
+ * another server process on this host), sending it to the members of its
+ * room on this server.
+ */
+void process_bus_message(Server srv, GDMPMessage msg);
+
+/**
+ * Processes a GDMP peer message (the hello of a link to another server),
+ * replying with this server's own if the other server dialed this one,
+ * and starting to relay room messages over the link.
+ */
+void process_peer_message(Server srv, GDMPMessage msg, int client_sockfd);
+
 #endif
@@ -0,0 +1,51 @@
+#ifndef SERVER_STATS_H
+#define SERVER_STATS_H
+
+#include <stddef.h>
+
+#include "server.h"
+
+/**
+ * The counters a server keeps (in srv->stats).
+ */
+typedef enum server_stat {
+    STAT_CONNECTIONS, // Open (clients and links to other servers)
+    STAT_ACCEPTS,
+    STAT_MESSAGES_IN, // Parsed
+    STAT_MESSAGES_OUT, // Written to sockets
+    STAT_BYTES_IN,
+    STAT_BYTES_OUT,
+    STAT_SEND_DROPPED, // Not queued, since the connection's queue was full
+    STAT_RATE_DROPPED,
+    STAT_RATE_DELAYED,
+    STAT_RATE_DISCONNECTED,
+    STAT_BUS_LOST, // Published by other processes, but skipped by falling behind
+    STAT_COUNT,
+} ServerStat;
+
+/**
+ * The stages of a message's way through a server, whose latencies
+ * (in microseconds) a server keeps histograms of (in srv->stats).
+ */
+typedef enum server_latency {
+    LATENCY_QUEUE, // From its socket polling ready, to a worker receiving from it
+    LATENCY_PARSE, // From being received, to being parsed
+    LATENCY_PROCESS, // Processing it (including sending it to its room)
+    LATENCY_FANOUT, // From being sent to a room, to being queued on all its members
+    LATENCY_SEND, // From being queued on a connection, to being written to its socket
+    LATENCY_COUNT,
+} ServerLatency;
+
+/**
+ * Accepts a connection on the stats socket, and replies to its request
+ * (whatever it is) with the server's stats over HTTP. Returns -1 on error.
+ */
+int serve_stats(Server srv);
+
+/**
+ * Writes the server's stats into buf (of the given size), in Prometheus text
+ * format. Returns the length written.
+ */
+int write_stats(Server srv, char *buf, size_t size);
+
+#endif
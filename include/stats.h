@@ -0,0 +1,77 @@
+// Stats Interface
+
+/**
+ * Stats are counters and histograms updated by many threads, and read rarely
+ * (summed when they are). Each thread updates its own shard of them, which
+ * starts on a cache line of its own, so updates never write to a cache line
+ * another thread writes to (until there are more threads than shards, which
+ * then share). Counters are signed, so one can also be a gauge (added to and
+ * subtracted from).
+ *
+ * Histograms count values (such as latencies) in buckets whose width grows
+ * with the value: each power of two is split into STATS_HISTOGRAM_SUB_COUNT
+ * buckets, so a percentile is within 1/STATS_HISTOGRAM_SUB_COUNT of the value
+ * it stands for, whatever its size.
+ */
+
+#ifndef STATS_H
+#define STATS_H
+
+#include <stdint.h>
+
+#define STATS_MAX_COUNTERS 32
+#define STATS_MAX_HISTOGRAMS 8
+#define STATS_SHARD_COUNT 64 // Threads beyond this share shards
+#define STATS_CACHE_LINE 64
+#define STATS_HISTOGRAM_SUB_BITS 4
+#define STATS_HISTOGRAM_SUB_COUNT (1 << STATS_HISTOGRAM_SUB_BITS)
+#define STATS_HISTOGRAM_MAX_BITS 32 // Larger values are counted as the largest
+#define STATS_HISTOGRAM_BUCKET_COUNT ((STATS_HISTOGRAM_MAX_BITS - STATS_HISTOGRAM_SUB_BITS + 1) * STATS_HISTOGRAM_SUB_COUNT)
+
+typedef struct stats *Stats;
+
+/**
+ * Creates a set of count counters (up to STATS_MAX_COUNTERS), all 0, and of
+ * histogram_count histograms (up to STATS_MAX_HISTOGRAMS), all empty.
+ * Returns NULL on error.
+ */
+Stats StatsNew(int count, int histogram_count);
+
+/**
+ * Frees a set of counters.
+ */
+void StatsFree(Stats stats);
+
+/**
+ * Adds n (which can be negative) to a counter, in the calling thread's shard.
+ */
+void StatsAdd(Stats stats, int counter, long n);
+
+/**
+ * Returns the value of a counter (the sum of its shards).
+ */
+long StatsRead(Stats stats, int counter);
+
+/**
+ * Counts a value in a histogram, in the calling thread's shard.
+ */
+void StatsRecord(Stats stats, int histogram, uint64_t value);
+
+/**
+ * Returns the number of values counted in a histogram.
+ */
+uint64_t StatsRecorded(Stats stats, int histogram);
+
+/**
+ * Returns the given percentile (such as 99.9) of the values counted in a
+ * histogram: the largest value of the bucket it falls in (0 if it's empty).
+ */
+uint64_t StatsPercentile(Stats stats, int histogram, double percentile);
+
+/**
+ * Returns the time in microseconds, of a clock that never goes back
+ * (to measure latencies with).
+ */
+uint64_t StatsTime(void);
+
+#endif
@@ -40,4 +40,9 @@ Task TaskQueueDequeue(TaskQueue q);
  */
 bool TaskQueueIsEmpty(TaskQueue q); 
 
+/**
+ * Returns the number of tasks in a task queue.
+ */
+int TaskQueueLength(TaskQueue q);
+
 #endif
@@ -29,6 +29,11 @@ void ThreadPoolFree(ThreadPool pool);
  */
 void ThreadPoolAddTask(ThreadPool pool, Task task);
 
+/**
+ * Returns the number of tasks waiting for a worker thread.
+ */
+int ThreadPoolPending(ThreadPool pool);
+
 /**
  * Continuously executes tasks from the task pool, used by each worker thread.
  */
@@ -0,0 +1,52 @@
+// Token Bucket Interface
+
+/**
+ * A token bucket limits the rate of something (such as messages or bytes).
+ * It holds up to burst tokens, and refills at rate tokens per second.
+ * Taking tokens only succeeds when there are enough of them, while charging
+ * them always does, so a bucket can go into debt (for bytes already read),
+ * which is paid back before anything else is let through.
+ * Times are in milliseconds, from any monotonic clock.
+ */
+
+#ifndef TOKEN_BUCKET_H
+#define TOKEN_BUCKET_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+typedef struct token_bucket TokenBucket;
+
+struct token_bucket {
+    double rate; // Tokens per second
+    double burst;
+    double tokens; // Negative while in debt
+    uint64_t updated;
+};
+
+/**
+ * Sets up a full bucket.
+ */
+void TokenBucketInit(TokenBucket *bucket, double rate, double burst, uint64_t now);
+
+/**
+ * Refills a bucket, and returns its tokens (negative while in debt).
+ */
+double TokenBucketTokens(TokenBucket *bucket, uint64_t now);
+
+/**
+ * Takes tokens from a bucket if it has enough. Returns false otherwise.
+ */
+bool TokenBucketTake(TokenBucket *bucket, double tokens, uint64_t now);
+
+/**
+ * Takes tokens from a bucket, even if it goes into debt.
+ */
+void TokenBucketCharge(TokenBucket *bucket, double tokens, uint64_t now);
+
+/**
+ * Returns the milliseconds until a bucket has the given tokens (0 if it has).
+ */
+uint64_t TokenBucketWait(TokenBucket *bucket, double tokens, uint64_t now);
+
+#endif
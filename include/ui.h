@@ -15,6 +15,11 @@
 
 typedef struct ui *UI;
 
+/**
+ * Called after each key typed into the input, with the input so far.
+ */
+typedef void (*UIKeyCallback)(char *input, void *arg);
+
 /**
  * Creates a UI.
  */
@@ -36,6 +41,16 @@ void UIDisplayMessage(UI ui, char *message);
  */
 void UIDisplayInput(UI ui, char *prompt, char *buffer, size_t buffer_size);
 
+/**
+ * Sets the function called after each key typed into the input.
+ */
+void UISetKeyCallback(UI ui, UIKeyCallback callback, void *arg);
+
+/**
+ * Displays a status under the messages (NULL clears it).
+ */
+void UISetStatus(UI ui, char *status);
+
 /**
  * Clears all messages.
  */
@@ -1,8 +1,12 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <inttypes.h>
 #include <unistd.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
 #include <arpa/inet.h>
 #include <time.h>
 #include <stdatomic.h>
@@ -12,47 +16,94 @@
 
 #include "client.h"
 #include "gdmp.h"
+#include "gdmp_compress.h"
 #include "ui.h"
 
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
 struct client {
-    int sockfd;
+    int port; // Of the server
+    int sockfd; // -1 while reconnecting
+    GDMPParser parser;
+    GDMPCompressor compressor; // Created once the server accepts compression
+    atomic_bool compression;
+    char username[GDMP_USERNAME_MAX_LEN];
+    char room[GDMP_ROOM_MAX_LEN]; // Text messages are sent to this room
+    uint64_t seq; // Of the last message seen in the room, resumed from
+    pthread_mutex_t lock; // Guards the socket, room and seq
+    uint64_t typing_sent; // When the last typing message was sent (ms)
     UI ui;
     pthread_t thread;
     atomic_bool shutdown;
 };
 
-int setup_client(Client cli);
+int connect_server(int port);
 void free_client(Client cli);
 void *receive_messages(void *arg);
+int reconnect(Client cli);
+void wait_ms(Client cli, int ms);
+void handle_message(Client cli, GDMPMessage msg);
 void handle_command(Client cli, char *command);
+void change_room(Client cli, char *room);
+void direct_message(Client cli, char *args);
+void handle_key(char *input, void *arg);
+void display_presence(Client cli, GDMPMessage msg);
+uint64_t time_ms(void);
 char *get_timestamp(void);
 void display_message(Client cli, char *username, char *content, char* timestamp);
 
+int send_string(Client cli, char *msg_str);
 int send_text_message(Client cli, char *username, char *content, char *timestamp);
+int send_direct_message(Client cli, char *recipient, char *content, char *timestamp);
 int send_join_message(Client cli);
+int send_leave_message(Client cli);
+int send_hello_message(Client cli);
+int send_typing_message(Client cli);
 
 ////////////////////////////////// FUNCTIONS ///////////////////////////////////
 
-Client ClientNew(void) {
+Client ClientNew(int port) {
     Client cli = malloc(sizeof(struct client));
     if (cli == NULL) {
         perror("malloc");
         return NULL;
     }
 
-    cli->sockfd = socket(AF_INET, SOCK_STREAM, 0);
+    // Connect to the server
+    cli->port = port;
+    cli->sockfd = connect_server(port);
     if (cli->sockfd == -1) {
-        perror("socket");
+        fprintf(stderr, "connect_server: error\n");
+        free(cli);
+        return NULL;
+    }
+
+    cli->parser = GDMPParserNew();
+    if (cli->parser == NULL) {
+        fprintf(stderr, "GDMPParserNew: error\n");
+        close(cli->sockfd);
         free(cli);
         return NULL;
     }
 
+    cli->compressor = NULL;
+    atomic_store(&cli->compression, false);
     atomic_store(&cli->shutdown, false);
+    cli->seq = 0;
+    cli->typing_sent = 0;
+    pthread_mutex_init(&cli->lock, NULL);
+
+    // Spread out reconnects of clients dropped at the same time
+    srand(time(NULL) ^ getpid());
 
-    // Setup the client
-    int res = setup_client(cli);
+    // Offer compression to the server
+    int res = send_hello_message(cli);
     if (res == -1) {
-        fprintf(stderr, "setup_client: error\n");
+        fprintf(stderr, "send_hello_message: error\n");
+        pthread_mutex_destroy(&cli->lock);
+        GDMPParserFree(cli->parser);
         close(cli->sockfd);
         free(cli);
         return NULL;
@@ -76,8 +127,18 @@ int ClientStart(Client cli) {
     }
 
     // Get username
-    char username[GDMP_USERNAME_MAX_LEN];
-    UIDisplayInput(cli->ui, "Username: ", username, GDMP_USERNAME_MAX_LEN);
+    UIDisplayInput(cli->ui, "Username: ", cli->username, GDMP_USERNAME_MAX_LEN);
+
+    // Join the default room
+    strcpy(cli->room, CLIENT_DEFAULT_ROOM);
+    res = send_join_message(cli);
+    if (res == -1) {
+        fprintf(stderr, "send_join_message: error\n");
+        return -1;
+    }
+
+    // Tell the room while the user types
+    UISetKeyCallback(cli->ui, handle_key, cli);
 
     while (!atomic_load(&cli->shutdown)) {
         // Get content
@@ -93,12 +154,12 @@ int ClientStart(Client cli) {
         // Get timestamp
         char *timestamp = get_timestamp();
 
-        // Send text message
+        // Send text message (unless reconnecting)
+        cli->typing_sent = 0;
         if (strlen(content) > 0) {
-            int res = send_text_message(cli, username, content, timestamp);
+            int res = send_text_message(cli, cli->username, content, timestamp);
             if (res == -1) {
-                fprintf(stderr, "send_text_message: error\n");
-                return -1;
+                UIDisplayMessage(cli->ui, "Message not sent");
             }
         }
     }
@@ -110,41 +171,56 @@ int ClientStart(Client cli) {
 ////////////////////////////// HELPER FUNCTIONS ////////////////////////////////
 
 /**
- * Defines server socket address, connects client to server.
- * Returns -1 on error.
+ * Creates a socket, and connects it to the server (on the given port).
+ * Returns the socket, or -1 on error.
  */
-int setup_client(Client cli) {
+int connect_server(int port) {
+    int sockfd = socket(AF_INET, SOCK_STREAM, 0);
+    if (sockfd == -1) {
+        perror("socket");
+        return -1;
+    }
+
     // Define server socket address
     struct sockaddr_in server_addr;
     server_addr.sin_family = AF_INET;
-    server_addr.sin_port = htons(CLIENT_SERVER_PORT);
+    server_addr.sin_port = htons(port);
     inet_pton(AF_INET, CLIENT_SERVER_IP, &server_addr.sin_addr);
 
     // Connect client socket to server socket address
     int res = connect(
-        cli->sockfd, (struct sockaddr *)&server_addr, sizeof(server_addr)
+        sockfd, (struct sockaddr *)&server_addr, sizeof(server_addr)
     );
     if (res == -1) {
         perror("connect");
+        close(sockfd);
         return -1;
     }
 
-    return 0;
+    return sockfd;
 }
 
 /**
  * Frees client.
  */
 void free_client(Client cli) {
-    close(cli->sockfd);
+    pthread_mutex_lock(&cli->lock);
+    if (cli->sockfd != -1) shutdown(cli->sockfd, SHUT_RDWR);
+    pthread_mutex_unlock(&cli->lock);
+
     pthread_join(cli->thread, NULL);
+    if (cli->sockfd != -1) close(cli->sockfd);
+    pthread_mutex_destroy(&cli->lock);
+    GDMPParserFree(cli->parser);
+    if (cli->compressor != NULL) GDMPCompressorFree(cli->compressor);
     UIFree(cli->ui);
     free(cli);
 }
 
 /**
  * Receives GDMP messages from the server, parses them, validates them, 
- * and displays them. Executed by a seperate thread.
+ * and displays them. Messages may arrive split across or packed into reads.
+ * Executed by a seperate thread.
  */
  void *receive_messages(void *arg) {
     Client cli = (Client)arg;
@@ -153,36 +229,38 @@ void free_client(Client cli) {
 
     while (!atomic_load(&cli->shutdown)) {
 
-        // Receive string
-        char msg_str[GDMP_MESSAGE_MAX_LEN];
-        ssize_t bytes_read = recv(cli->sockfd, msg_str, GDMP_MESSAGE_MAX_LEN - 1, 0);
-
-        if (bytes_read < 0) {
-            perror("recv");
-            break;
-        }
-
-        if (bytes_read == 0) {
+        // Receive bytes (straight into the parser)
+        size_t space;
+        char *buffer = GDMPParserBuffer(cli->parser, &space);
+        if (space == 0) {
+            UIDisplayMessage(cli->ui, "Message from server too long");
             break;
         }
 
-        msg_str[bytes_read] = '\0';
+        ssize_t bytes_read = recv(cli->sockfd, buffer, space, 0);
 
-        // Parse string
-        GDMPMessage msg = GDMPParse(msg_str);
+        if (bytes_read <= 0) {
+            if (atomic_load(&cli->shutdown)) break;
 
-        // Validate message
-        if (!GDMPValidate(msg, GDMP_TEXT_MESSAGE)) return NULL;
+            // Resume from the last message seen
+            UIDisplayMessage(cli->ui, "Connection lost, reconnecting...");
+            if (reconnect(cli) == -1) break;
+            UIDisplayMessage(cli->ui, "Reconnected to server");
+            continue;
+        }
 
-        // Access headers
-        char *username = GDMPGetValue(msg, "Username");
-        char *content = GDMPGetValue(msg, "Content");
-        char *timestamp = GDMPGetValue(msg, "Timestamp");
+        GDMPParserCommit(cli->parser, bytes_read);
 
-        // Display message
-        display_message(cli, username, content, timestamp);
+        // Parse every complete message
+        GDMPMessage msg;
+        while ((msg = GDMPParserNext(cli->parser)) != NULL) {
+            // Validate message, and handle it
+            if (GDMPValidate(msg, GDMPGetType(msg))) {
+                handle_message(cli, msg);
+            }
 
-        GDMPFree(msg);
+            GDMPFree(msg);
+        }
     }
 
     UIDisplayMessage(cli->ui, "Disconnected from server");
@@ -191,6 +269,126 @@ void free_client(Client cli) {
     return NULL;
  }
 
+/**
+ * Connects to the server again, waiting longer after each failed attempt
+ * (with jitter, so clients dropped together don't all reconnect at once).
+ * Then rejoins the current room, resuming from the last message seen.
+ * Returns -1 if the client is freed first.
+ */
+int reconnect(Client cli) {
+    int delay = CLIENT_RECONNECT_MIN_MS;
+
+    while (true) {
+        // Drop the old connection, and its compression
+        pthread_mutex_lock(&cli->lock);
+        if (cli->sockfd != -1) close(cli->sockfd);
+        cli->sockfd = -1;
+        atomic_store(&cli->compression, false);
+        if (cli->compressor != NULL) GDMPCompressorFree(cli->compressor);
+        cli->compressor = NULL;
+        pthread_mutex_unlock(&cli->lock);
+
+        wait_ms(cli, delay / 2 + rand() % delay);
+        if (atomic_load(&cli->shutdown)) return -1;
+        delay = delay * 2 > CLIENT_RECONNECT_MAX_MS ? CLIENT_RECONNECT_MAX_MS : delay * 2;
+
+        int sockfd = connect_server(cli->port);
+        if (sockfd == -1) continue;
+
+        // Start parsing afresh
+        GDMPParser parser = GDMPParserNew();
+        if (parser == NULL) {
+            close(sockfd);
+            continue;
+        }
+        GDMPParserFree(cli->parser);
+        cli->parser = parser;
+
+        pthread_mutex_lock(&cli->lock);
+        cli->sockfd = sockfd;
+        pthread_mutex_unlock(&cli->lock);
+
+        if (send_hello_message(cli) == 0 && send_join_message(cli) == 0) return 0;
+    }
+}
+
+/**
+ * Waits the given number of milliseconds, or until the client is freed.
+ */
+void wait_ms(Client cli, int ms) {
+    struct timespec step = {0, 100 * 1000000};
+
+    for (int waited = 0; waited < ms && !atomic_load(&cli->shutdown); waited += 100) {
+        nanosleep(&step, NULL);
+    }
+}
+
+/**
+ * Handles a GDMP message received from the server.
+ */
+void handle_message(Client cli, GDMPMessage msg) {
+    switch (GDMPGetType(msg)) {
+        case GDMP_TEXT_MESSAGE: {
+            // Access headers
+            char *username = GDMPGetValue(msg, "Username");
+            char *content = GDMPGetValue(msg, "Content");
+            char *timestamp = GDMPGetValue(msg, "Timestamp");
+
+            // Only show messages of the current room (those of a room just
+            // left can still arrive, queued before the leave)
+            char *room = GDMPGetValue(msg, "Room");
+            char *seq = GDMPGetValue(msg, "Seq");
+            pthread_mutex_lock(&cli->lock);
+            bool current = room == NULL || strcmp(room, cli->room) == 0;
+            if (current && seq != NULL) {
+                // Remember the last message seen in the room
+                uint64_t value = strtoull(seq, NULL, 10);
+                if (value > cli->seq) cli->seq = value;
+            }
+            pthread_mutex_unlock(&cli->lock);
+            if (!current) break;
+
+            // Display message (they're done typing)
+            UISetStatus(cli->ui, NULL);
+            display_message(cli, username, content, timestamp);
+            break;
+        }
+        case GDMP_DIRECT_MESSAGE: {
+            // Access headers
+            char *username = GDMPGetValue(msg, "Username");
+            char *content = GDMPGetValue(msg, "Content");
+            char *timestamp = GDMPGetValue(msg, "Timestamp");
+
+            // Display message, marked as direct
+            char from[GDMP_MESSAGE_MAX_LEN];
+            snprintf(from, sizeof(from), "%s (direct)", username);
+            display_message(cli, from, content, timestamp);
+            break;
+        }
+        case GDMP_PRESENCE_MESSAGE:
+            display_presence(cli, msg);
+            break;
+        case GDMP_REJECT_MESSAGE: {
+            // Tell the user why their message wasn't delivered (or join failed)
+            bool join = strcmp(GDMPGetValue(msg, "Type"), "GDMP_JOIN_MESSAGE") == 0;
+            char message[GDMP_MESSAGE_MAX_LEN];
+            snprintf(message, sizeof(message), "%s: %s", join ? "Not joined" : "Not sent", GDMPGetValue(msg, "Reason"));
+            UIDisplayMessage(cli->ui, message);
+            break;
+        }
+        case GDMP_HELLO_MESSAGE: {
+            // Compress from now on if the server accepted
+            char *compression = GDMPGetValue(msg, "Compression");
+            if (strcmp(compression, GDMP_COMPRESSION_NAME) == 0) {
+                atomic_store(&cli->compression, true);
+            }
+            break;
+        }
+        default:
+            break;
+    }
+}
+
 /**
  * Handles the given command string.
  */
@@ -199,11 +397,114 @@ void handle_command(Client cli, char *command) {
         ClientFree(cli);
     } else if (strcmp(command, "/clear") == 0) {
         UIClearMessages(cli->ui);
+    } else if (strncmp(command, "/join ", 6) == 0) {
+        change_room(cli, command + 6);
+    } else if (strncmp(command, "/msg ", 5) == 0) {
+        direct_message(cli, command + 5);
     } else {
         UIDisplayMessage(cli->ui, "Invalid command");
     }
 }
 
+/**
+ * Leaves the current room, and joins the given one.
+ */
+void change_room(Client cli, char *room) {
+    if (strlen(room) == 0 || strlen(room) >= GDMP_ROOM_MAX_LEN) {
+        UIDisplayMessage(cli->ui, "Invalid room");
+        return;
+    }
+
+    send_leave_message(cli);
+
+    // Start with the new room's history
+    pthread_mutex_lock(&cli->lock);
+    strcpy(cli->room, room);
+    cli->seq = 0;
+    pthread_mutex_unlock(&cli->lock);
+
+    send_join_message(cli);
+
+    // Only show messages of the new room
+    char message[GDMP_MESSAGE_MAX_LEN];
+    snprintf(message, sizeof(message), "Joined room: %s", room);
+    UIClearMessages(cli->ui);
+    UIDisplayMessage(cli->ui, message);
+}
+
+/**
+ * Sends the content to the given user only. Arguments are "<user> <content>".
+ */
+void direct_message(Client cli, char *args) {
+    char *content = strchr(args, ' ');
+    if (content == NULL || content == args || content - args >= GDMP_USERNAME_MAX_LEN || content[1] == '\0') {
+        UIDisplayMessage(cli->ui, "Usage: /msg <user> <content>");
+        return;
+    }
+
+    char recipient[GDMP_USERNAME_MAX_LEN];
+    snprintf(recipient, sizeof(recipient), "%.*s", (int)(content - args), args);
+
+    if (send_direct_message(cli, recipient, content + 1, get_timestamp()) == -1) {
+        UIDisplayMessage(cli->ui, "Message not sent");
+    }
+}
+
+/**
+ * Sends a typing message as the user types (but not commands), at most once
+ * every CLIENT_TYPING_INTERVAL_MS. Called after each key.
+ */
+void handle_key(char *input, void *arg) {
+    Client cli = (Client)arg;
+    if (input[0] == CLIENT_COMMAND_CHAR) return;
+
+    uint64_t now = time_ms();
+    if (cli->typing_sent != 0 && now - cli->typing_sent < CLIENT_TYPING_INTERVAL_MS) return;
+
+    cli->typing_sent = now;
+    send_typing_message(cli);
+}
+
+/**
+ * Displays the joins and leaves of a presence message for the current room,
+ * and who is typing (other than the user) as the status.
+ */
+void display_presence(Client cli, GDMPMessage msg) {
+    pthread_mutex_lock(&cli->lock);
+    bool current = strcmp(GDMPGetValue(msg, "Room"), cli->room) == 0;
+    pthread_mutex_unlock(&cli->lock);
+    if (!current) return;
+
+    char message[GDMP_MESSAGE_MAX_LEN];
+    char *joined = GDMPGetValue(msg, "Joined");
+    char *left = GDMPGetValue(msg, "Left");
+    char *typing = GDMPGetValue(msg, "Typing");
+
+    if (joined != NULL) {
+        snprintf(message, sizeof(message), "Joined: %s", joined);
+        UIDisplayMessage(cli->ui, message);
+    }
+
+    if (left != NULL) {
+        snprintf(message, sizeof(message), "Left: %s", left);
+        UIDisplayMessage(cli->ui, message);
+    }
+
+    if (typing != NULL && strcmp(typing, cli->username) != 0) {
+        snprintf(message, sizeof(message), "Typing: %s", typing);
+        UISetStatus(cli->ui, message);
+    }
+}
+
+/**
+ * Returns the time in milliseconds (of a clock that never goes back).
+ */
+uint64_t time_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
 /**
  * Returns current timestamp.
  */
@@ -230,7 +531,45 @@ void display_message(Client cli, char *username, char* content, char *timestamp)
 /////////////////////////////////// SENDING ////////////////////////////////////
 
 /**
- * Sends a GDMP text message to the server. Returns -1 on error.
+ * Sends a serialized GDMP message to the server, compressed if the server
+ * accepted compression and the message is long enough. Returns -1 on error.
+ */
+int send_string(Client cli, char *msg_str) {
+    struct iovec iov = {msg_str, strlen(msg_str)};
+    char *compressed = NULL;
+
+    // Nothing is sent while reconnecting
+    pthread_mutex_lock(&cli->lock);
+    if (cli->sockfd == -1) {
+        pthread_mutex_unlock(&cli->lock);
+        return -1;
+    }
+
+    if (atomic_load(&cli->compression) && iov.iov_len >= GDMP_COMPRESSION_MIN_LEN) {
+        if (cli->compressor == NULL) cli->compressor = GDMPCompressorNew();
+        if (cli->compressor != NULL) compressed = GDMPCompress(cli->compressor, &iov, 1, &iov.iov_len);
+        if (compressed == NULL) {
+            pthread_mutex_unlock(&cli->lock);
+            return -1;
+        }
+        iov.iov_base = compressed;
+    }
+
+    ssize_t bytes_sent = send(cli->sockfd, iov.iov_base, iov.iov_len, MSG_NOSIGNAL);
+    pthread_mutex_unlock(&cli->lock);
+    free(compressed);
+
+    if (bytes_sent == -1) {
+        perror("send");
+        return -1;
+    }
+
+    return 0;
+}
+
+/**
+ * Sends a GDMP text message to the server, in the current room.
+ * Returns -1 on error.
  */
 int send_text_message(Client cli, char *username, char *content, char *timestamp) {
     // Create message
@@ -240,16 +579,17 @@ int send_text_message(Client cli, char *username, char *content, char *timestamp
     GDMPAddHeader(msg, "Username", username);
     GDMPAddHeader(msg, "Content", content);
     GDMPAddHeader(msg, "Timestamp", timestamp);
+    GDMPAddHeader(msg, "Room", cli->room);
 
     // Serialize message
     char *msg_str = GDMPStringify(msg);
 
     // Send string
-    ssize_t bytes_sent = send(cli->sockfd, msg_str, strlen(msg_str), 0);
-    if (bytes_sent == -1) {
-        perror("send");
+    int res = send_string(cli, msg_str);
+    if (res == -1) {
         free(timestamp);
         free(msg_str);
+        GDMPFree(msg);
         return -1;
     }
 
@@ -263,9 +603,132 @@ int send_text_message(Client cli, char *username, char *content, char *timestamp
 }
 
 /**
- * Sends a GDMP join message to the server. Returns -1 on error.
+ * Sends a GDMP direct message to the server, for the given user.
+ * Returns -1 on error.
+ */
+int send_direct_message(Client cli, char *recipient, char *content, char *timestamp) {
+    // Create message
+    GDMPMessage msg = GDMPNew(GDMP_DIRECT_MESSAGE);
+
+    // Add headers to message
+    GDMPAddHeader(msg, "Username", cli->username);
+    GDMPAddHeader(msg, "Recipient", recipient);
+    GDMPAddHeader(msg, "Content", content);
+    GDMPAddHeader(msg, "Timestamp", timestamp);
+
+    // Serialize message
+    char *msg_str = GDMPStringify(msg);
+
+    // Send string
+    int res = send_string(cli, msg_str);
+
+    // Display message, marked with its recipient
+    if (res == 0) {
+        char to[GDMP_MESSAGE_MAX_LEN];
+        snprintf(to, sizeof(to), "%s -> %s", cli->username, recipient);
+        display_message(cli, to, content, timestamp);
+    }
+
+    free(timestamp);
+    free(msg_str);
+    GDMPFree(msg);
+    return res;
+}
+
+/**
+ * Sends a GDMP join message to the server, for the current room, resuming
+ * from the last message seen in it (if any). Returns -1 on error.
  */
 int send_join_message(Client cli) {
-    // TODO
-    return 0;
+    // Create message
+    GDMPMessage msg = GDMPNew(GDMP_JOIN_MESSAGE);
+
+    // Add headers to message
+    pthread_mutex_lock(&cli->lock);
+    GDMPAddHeader(msg, "Username", cli->username);
+    GDMPAddHeader(msg, "Room", cli->room);
+    if (cli->seq != 0) {
+        char seq[24];
+        snprintf(seq, sizeof(seq), "%" PRIu64, cli->seq);
+        GDMPAddHeader(msg, "Seq", seq);
+    }
+    pthread_mutex_unlock(&cli->lock);
+
+    // Serialize message
+    char *msg_str = GDMPStringify(msg);
+
+    // Send string
+    int res = send_string(cli, msg_str);
+
+    free(msg_str);
+    GDMPFree(msg);
+    return res;
+}
+
+/**
+ * Sends a GDMP leave message to the server, for the current room.
+ * Returns -1 on error.
+ */
+int send_leave_message(Client cli) {
+    // Create message
+    GDMPMessage msg = GDMPNew(GDMP_LEAVE_MESSAGE);
+
+    // Add headers to message
+    GDMPAddHeader(msg, "Room", cli->room);
+
+    // Serialize message
+    char *msg_str = GDMPStringify(msg);
+
+    // Send string
+    int res = send_string(cli, msg_str);
+
+    free(msg_str);
+    GDMPFree(msg);
+    return res;
+}
+
+/**
+ * Sends a GDMP hello message to the server, offering compression.
+ * Returns -1 on error.
+ */
+int send_hello_message(Client cli) {
+    // Create message
+    GDMPMessage msg = GDMPNew(GDMP_HELLO_MESSAGE);
+
+    // Add headers to message
+    GDMPAddHeader(msg, "Compression", GDMP_COMPRESSION_NAME);
+
+    // Serialize message
+    char *msg_str = GDMPStringify(msg);
+
+    // Send string
+    int res = send_string(cli, msg_str);
+
+    free(msg_str);
+    GDMPFree(msg);
+    return res;
+}
+
+/**
+ * Sends a GDMP typing message to the server, for the current room.
+ * Returns -1 on error.
+ */
+int send_typing_message(Client cli) {
+    // Create message
+    GDMPMessage msg = GDMPNew(GDMP_TYPING_MESSAGE);
+
+    // Add headers to message
+    pthread_mutex_lock(&cli->lock);
+    GDMPAddHeader(msg, "Room", cli->room);
+    pthread_mutex_unlock(&cli->lock);
+
+    // Serialize message
+    char *msg_str = GDMPStringify(msg);
+
+    // Send string
+    int res = send_string(cli, msg_str);
+
+    free(msg_str);
+    GDMPFree(msg);
+    return res;
 }
@@ -0,0 +1,408 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+#include "connection.h"
+#include "frame.h"
+#include "gdmp.h"
+#include "gdmp_compress.h"
+#include "task.h"
+#include "thread_pool.h"
+#include "stats.h"
+#include "server_stats.h"
+#include "probes.h"
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
+#define FLUSH_MAX_IOV (2 * GDMP_BATCH_MAX_COUNT)
+
+void *flush_connection(void *arg);
+int send_unsent(Connection conn);
+int send_frames(Connection conn, Frame *frames, int count, GDMPCompressor compressor);
+int keep_unsent(Connection conn, struct iovec *iov, int iov_count, size_t sent);
+void drop_queued(Connection conn);
+
+////////////////////////////////// FUNCTIONS ///////////////////////////////////
+
+Connection ConnectionNew(int sockfd, ThreadPool pool, Stats stats) {
+    Connection conn = malloc(sizeof(struct connection));
+    if (conn == NULL) {
+        perror("malloc");
+        return NULL;
+    }
+
+    conn->sockfd = sockfd;
+    conn->pool = pool;
+    conn->stats = stats;
+
+    conn->parser = GDMPParserNew();
+    if (conn->parser == NULL) {
+        fprintf(stderr, "GDMPParserNew: error\n");
+        free(conn);
+        return NULL;
+    }
+
+    atomic_init(&conn->refs, 1);
+    pthread_mutex_init(&conn->send_lock, NULL);
+    conn->send_head = 0;
+    conn->send_count = 0;
+    conn->unsent = NULL;
+    conn->unsent_len = 0;
+    conn->compressor = NULL;
+    conn->username[0] = '\0';
+    conn->room_count = 0;
+    conn->peer = false;
+    conn->peer_id[0] = '\0';
+    conn->received = 0;
+    conn->flushing = false;
+    conn->closed = false;
+
+    return conn;
+}
+
+void ConnectionRetain(Connection conn) {
+    atomic_fetch_add(&conn->refs, 1);
+}
+
+void ConnectionRelease(Connection conn) {
+    if (atomic_fetch_sub(&conn->refs, 1) != 1) return;
+
+    drop_queued(conn);
+    close(conn->sockfd);
+
+    pthread_mutex_destroy(&conn->send_lock);
+    GDMPParserFree(conn->parser);
+    if (conn->compressor != NULL) GDMPCompressorFree(conn->compressor);
+    free(conn->unsent);
+    free(conn);
+}
+
+void ConnectionClose(Connection conn) {
+    pthread_mutex_lock(&conn->send_lock);
+    conn->closed = true;
+    drop_queued(conn);
+    pthread_mutex_unlock(&conn->send_lock);
+
+    shutdown(conn->sockfd, SHUT_RDWR);
+}
+
+int ConnectionSend(Connection conn, Frame frame) {
+    return ConnectionSendFrames(conn, &frame, 1);
+}
+
+int ConnectionSendFrames(Connection conn, Frame *frames, int count) {
+    uint64_t now = StatsTime();
+    pthread_mutex_lock(&conn->send_lock);
+
+    if (conn->closed || conn->send_count + count > CONNECTION_SEND_QUEUE_SIZE) {
+        bool full = !conn->closed;
+        pthread_mutex_unlock(&conn->send_lock);
+
+        if (full) StatsAdd(conn->stats, STAT_SEND_DROPPED, count);
+        return -1;
+    }
+
+    // Add frames to send queue
+    for (int i = 0; i < count; i++) {
+        int idx = (conn->send_head + conn->send_count) % CONNECTION_SEND_QUEUE_SIZE;
+        FrameRetain(frames[i]);
+        conn->send_queue[idx] = frames[i];
+        conn->queued_at[idx] = now;
+        conn->send_count++;
+    }
+
+    PROBE2(enqueue, conn->sockfd, count);
+
+    // Schedule a flush, unless one is already running
+    bool schedule = !conn->flushing;
+    conn->flushing = true;
+
+    pthread_mutex_unlock(&conn->send_lock);
+
+    if (schedule) {
+        ConnectionRetain(conn);
+        ThreadPoolAddTask(conn->pool, TaskNew(flush_connection, conn));
+    }
+
+    return 0;
+}
+
+int ConnectionSendMessage(Connection conn, GDMPMessage msg) {
+    char *msg_str = GDMPStringify(msg);
+    if (msg_str == NULL) return -1;
+
+    Frame frame = FrameNew(GDMPGetType(msg), msg_str, strlen(msg_str));
+    free(msg_str);
+    if (frame == NULL) return -1;
+
+    int res = ConnectionSend(conn, frame);
+    FrameRelease(frame);
+    return res;
+}
+
+bool ConnectionIdle(Connection conn) {
+    pthread_mutex_lock(&conn->send_lock);
+    bool idle = !conn->flushing && !conn->closed;
+    pthread_mutex_unlock(&conn->send_lock);
+
+    return idle;
+}
+
+int ConnectionEnableCompression(Connection conn) {
+    pthread_mutex_lock(&conn->send_lock);
+
+    if (conn->compressor == NULL) {
+        conn->compressor = GDMPCompressorNew();
+    }
+    int res = conn->compressor == NULL ? -1 : 0;
+
+    pthread_mutex_unlock(&conn->send_lock);
+    return res;
+}
+
+////////////////////////////// HELPER FUNCTIONS ////////////////////////////////
+
+/**
+ * Writes the queued frames of a connection to its socket.
+ * Reschedules itself until the queue is empty. Executed by treads in the thread pool.
+ */
+void *flush_connection(void *arg) {
+    Connection conn = (Connection)arg;
+    int res = 0;
+
+    // Send what the socket didn't take last time
+    if (conn->unsent_len > 0) {
+        res = send_unsent(conn);
+    }
+
+    if (res == 0 && conn->unsent_len == 0) {
+        // Take queued frames (at most a batch worth of bytes, 
+        // which bounds the size of a compressed message)
+        Frame frames[GDMP_BATCH_MAX_COUNT];
+        uint64_t queued_at[GDMP_BATCH_MAX_COUNT];
+        int count = 0;
+        size_t len = 0;
+
+        pthread_mutex_lock(&conn->send_lock);
+        while (count < GDMP_BATCH_MAX_COUNT && conn->send_count > 0) {
+            Frame frame = conn->send_queue[conn->send_head];
+            if (count > 0 && len + frame->len > GDMP_BATCH_MAX_LEN) break;
+
+            queued_at[count] = conn->queued_at[conn->send_head];
+            frames[count++] = frame;
+            len += frame->len;
+            conn->send_head = (conn->send_head + 1) % CONNECTION_SEND_QUEUE_SIZE;
+            conn->send_count--;
+        }
+        GDMPCompressor compressor = conn->compressor;
+        pthread_mutex_unlock(&conn->send_lock);
+
+        if (count > 0) {
+            res = send_frames(conn, frames, count, compressor);
+        }
+
+        // Written (or kept to write after what the socket took)
+        uint64_t sent = StatsTime();
+        for (int i = 0; res == 0 && i < count; i++) {
+            StatsRecord(conn->stats, LATENCY_SEND, sent - queued_at[i]);
+        }
+
+        for (int i = 0; i < count; i++) {
+            FrameRelease(frames[i]);
+        }
+    }
+
+    pthread_mutex_lock(&conn->send_lock);
+
+    if (res == -1) {
+        conn->closed = true;
+        drop_queued(conn);
+    }
+
+    // Flush again if there is more to send
+    bool again = !conn->closed && (conn->send_count > 0 || conn->unsent_len > 0);
+    conn->flushing = again;
+
+    pthread_mutex_unlock(&conn->send_lock);
+
+    if (again) {
+        ThreadPoolAddTask(conn->pool, TaskNew(flush_connection, conn));
+    } else {
+        ConnectionRelease(conn);
+    }
+
+    return NULL;
+}
+
+/**
+ * Sends the bytes a previous flush couldn't. Returns -1 on error.
+ */
+int send_unsent(Connection conn) {
+    ssize_t bytes_sent = send(
+        conn->sockfd, conn->unsent, conn->unsent_len, MSG_DONTWAIT | MSG_NOSIGNAL
+    );
+
+    if (bytes_sent == -1) {
+        if (errno == EWOULDBLOCK || errno == EAGAIN) return 0;
+        perror("send");
+        return -1;
+    }
+
+    StatsAdd(conn->stats, STAT_BYTES_OUT, bytes_sent);
+    PROBE2(send, conn->sockfd, bytes_sent);
+
+    conn->unsent_len -= bytes_sent;
+    memmove(conn->unsent, conn->unsent + bytes_sent, conn->unsent_len);
+
+    if (conn->unsent_len == 0) {
+        free(conn->unsent);
+        conn->unsent = NULL;
+    }
+
+    return 0;
+}
+
+/**
+ * Sends frames with a single system call. Consecutive text messages are
+ * packed into batch messages, whose bodies are the frames without their
+ * type lines, so no bytes are copied. With a compressor, everything is
+ * sent as one compressed message, unless it is too short to be worth it.
+ * Returns -1 on error.
+ */
+int send_frames(Connection conn, Frame *frames, int count, GDMPCompressor compressor) {
+    struct iovec iov[FLUSH_MAX_IOV];
+    char headers[GDMP_BATCH_MAX_COUNT][CONNECTION_BATCH_HEADER_LEN];
+    int iov_count = 0;
+    int header_count = 0;
+
+    for (int i = 0; i < count; ) {
+        // Find the run of text messages that fits in a batch
+        int j = i;
+        size_t body_len = 0;
+        while (j < count && frames[j]->type == GDMP_TEXT_MESSAGE) {
+            size_t len = frames[j]->len - frames[j]->type_len;
+            if (body_len + len > GDMP_BATCH_MAX_LEN) break;
+            body_len += len;
+            j++;
+        }
+
+        int header_len = -1;
+        if (j - i >= 2) {
+            header_len = GDMPBatchHeader(
+                headers[header_count], CONNECTION_BATCH_HEADER_LEN,
+                GDMP_TEXT_MESSAGE, j - i, body_len
+            );
+        }
+
+        if (header_len == -1) {
+            // Send the frame on its own
+            iov[iov_count].iov_base = frames[i]->data;
+            iov[iov_count].iov_len = frames[i]->len;
+            iov_count++;
+            i++;
+            continue;
+        }
+
+        // Send the run as a batch
+        iov[iov_count].iov_base = headers[header_count];
+        iov[iov_count].iov_len = header_len;
+        iov_count++;
+        header_count++;
+
+        for (; i < j; i++) {
+            iov[iov_count].iov_base = frames[i]->data + frames[i]->type_len;
+            iov[iov_count].iov_len = frames[i]->len - frames[i]->type_len;
+            iov_count++;
+        }
+    }
+
+    size_t total = 0;
+    for (int i = 0; i < iov_count; i++) {
+        total += iov[i].iov_len;
+    }
+
+    char *compressed = NULL;
+    if (compressor != NULL && total >= GDMP_COMPRESSION_MIN_LEN) {
+        size_t compressed_len;
+        compressed = GDMPCompress(compressor, iov, iov_count, &compressed_len);
+        if (compressed == NULL) return -1;
+
+        iov[0].iov_base = compressed;
+        iov[0].iov_len = compressed_len;
+        iov_count = 1;
+    }
+
+    struct msghdr msg = {0};
+    msg.msg_iov = iov;
+    msg.msg_iovlen = iov_count;
+
+    ssize_t bytes_sent = sendmsg(conn->sockfd, &msg, MSG_DONTWAIT | MSG_NOSIGNAL);
+    if (bytes_sent == -1) {
+        if (!(errno == EWOULDBLOCK || errno == EAGAIN)) {
+            perror("sendmsg");
+            free(compressed);
+            return -1;
+        }
+        bytes_sent = 0;
+    }
+
+    StatsAdd(conn->stats, STAT_MESSAGES_OUT, count);
+    StatsAdd(conn->stats, STAT_BYTES_OUT, bytes_sent);
+    PROBE2(send, conn->sockfd, bytes_sent);
+
+    int res = keep_unsent(conn, iov, iov_count, bytes_sent);
+    free(compressed);
+    return res;
+}
+
+/**
+ * Copies the bytes of the iovecs past the first sent bytes,
+ * to be sent by the next flush. Returns -1 on error.
+ */
+int keep_unsent(Connection conn, struct iovec *iov, int iov_count, size_t sent) {
+    size_t total = 0;
+    for (int i = 0; i < iov_count; i++) {
+        total += iov[i].iov_len;
+    }
+
+    if (sent == total) return 0;
+
+    conn->unsent = malloc(total - sent);
+    if (conn->unsent == NULL) {
+        perror("malloc");
+        return -1;
+    }
+
+    for (int i = 0; i < iov_count; i++) {
+        if (sent >= iov[i].iov_len) {
+            sent -= iov[i].iov_len;
+            continue;
+        }
+
+        size_t len = iov[i].iov_len - sent;
+        memcpy(conn->unsent + conn->unsent_len, (char *)iov[i].iov_base + sent, len);
+        conn->unsent_len += len;
+        sent = 0;
+    }
+
+    return 0;
+}
+
+/**
+ * Releases every frame in a connection's send queue.
+ */
+void drop_queued(Connection conn) {
+    while (conn->send_count > 0) {
+        FrameRelease(conn->send_queue[conn->send_head]);
+        conn->send_head = (conn->send_head + 1) % CONNECTION_SEND_QUEUE_SIZE;
+        conn->send_count--;
+    }
+}
@@ -0,0 +1,275 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <pthread.h>
+
+#include "fanout.h"
+#include "connection.h"
+#include "frame.h"
+#include "task.h"
+#include "thread_pool.h"
+#include "stats.h"
+#include "server_stats.h"
+
+/**
+ * The frames queued on a room's fan-out, sent one after another.
+ */
+struct fanout {
+    pthread_mutex_t lock;
+    atomic_int refs; // The owner's, and one per queued frame
+    ThreadPool pool;
+    Stats stats; // Timing each frame, from being queued to being sent to every member
+    FanoutJob head; // Being sent
+    FanoutJob tail;
+};
+
+/**
+ * A frame queued on a fan-out, with the members to send it to.
+ */
+struct fanout_job {
+    Frame frame;
+    Snapshot members;
+    Connection except;
+    atomic_int chunks_left; // Until the next frame can start
+    uint64_t queued; // When (in us)
+    FanoutJob next;
+};
+
+/**
+ * The members (a range of a snapshot) a fan-out task sends a frame to.
+ */
+struct fanout_task_arg {
+    Fanout fanout;
+    FanoutJob job;
+    int start;
+    int end;
+};
+
+void start_job(Fanout fanout, FanoutJob job);
+void finish_chunk(Fanout fanout, FanoutJob job);
+void add_fanout_task(Fanout fanout, FanoutJob job, int start, int end);
+void *fanout_task(void *arg);
+void send_range(Fanout fanout, FanoutJob job, int start, int end);
+void release_fanout(Fanout fanout);
+
+////////////////////////////////// FUNCTIONS ///////////////////////////////////
+
+Fanout FanoutNew(ThreadPool pool, Stats stats) {
+    Fanout fanout = malloc(sizeof(struct fanout));
+    if (fanout == NULL) {
+        perror("malloc");
+        return NULL;
+    }
+
+    pthread_mutex_init(&fanout->lock, NULL);
+    atomic_init(&fanout->refs, 1);
+    fanout->pool = pool;
+    fanout->stats = stats;
+    fanout->head = NULL;
+    fanout->tail = NULL;
+
+    return fanout;
+}
+
+void FanoutFree(Fanout fanout) {
+    release_fanout(fanout);
+}
+
+bool FanoutBusy(Fanout fanout) {
+    pthread_mutex_lock(&fanout->lock);
+    bool busy = fanout->head != NULL;
+    pthread_mutex_unlock(&fanout->lock);
+
+    return busy;
+}
+
+int FanoutSend(Fanout fanout, Snapshot members, Frame frame, Connection except) {
+    int chunks = (members->count + FANOUT_CHUNK_SIZE - 1) / FANOUT_CHUNK_SIZE;
+    if (chunks == 0) return 0;
+
+    FanoutJob job = malloc(sizeof(struct fanout_job));
+    if (job == NULL) {
+        perror("malloc");
+        return -1;
+    }
+
+    FrameRetain(frame);
+    job->frame = frame;
+    SnapshotRetain(members);
+    job->members = members;
+    job->except = except;
+    atomic_init(&job->chunks_left, chunks);
+    job->queued = StatsTime();
+    job->next = NULL;
+
+    // Queue the frame, starting it unless another is being sent
+    atomic_fetch_add(&fanout->refs, 1);
+    pthread_mutex_lock(&fanout->lock);
+
+    if (fanout->tail != NULL) {
+        fanout->tail->next = job;
+    } else {
+        fanout->head = job;
+    }
+    fanout->tail = job;
+    bool start = fanout->head == job;
+
+    pthread_mutex_unlock(&fanout->lock);
+
+    if (start) start_job(fanout, job);
+
+    return 0;
+}
+
+Snapshot SnapshotNew(Connection *members, int count) {
+    Snapshot snapshot = malloc(sizeof(struct snapshot));
+    if (snapshot == NULL) {
+        perror("malloc");
+        return NULL;
+    }
+
+    snapshot->members = malloc((count > 0 ? count : 1) * sizeof(Connection));
+    if (snapshot->members == NULL) {
+        perror("malloc");
+        free(snapshot);
+        return NULL;
+    }
+
+    for (int i = 0; i < count; i++) {
+        ConnectionRetain(members[i]);
+        snapshot->members[i] = members[i];
+    }
+
+    atomic_init(&snapshot->refs, 1);
+    snapshot->count = count;
+
+    return snapshot;
+}
+
+void SnapshotRetain(Snapshot snapshot) {
+    atomic_fetch_add(&snapshot->refs, 1);
+}
+
+void SnapshotRelease(Snapshot snapshot) {
+    if (atomic_fetch_sub(&snapshot->refs, 1) != 1) return;
+
+    for (int i = 0; i < snapshot->count; i++) {
+        ConnectionRelease(snapshot->members[i]);
+    }
+
+    free(snapshot->members);
+    free(snapshot);
+}
+
+////////////////////////////// HELPER FUNCTIONS ////////////////////////////////
+
+/**
+ * Starts sending a frame to its members, with a task splitting them up.
+ */
+void start_job(Fanout fanout, FanoutJob job) {
+    add_fanout_task(fanout, job, 0, job->members->count);
+}
+
+/**
+ * Notes that a chunk of a frame's members was sent to. After the last one,
+ * frees the frame's job, and starts the next one.
+ */
+void finish_chunk(Fanout fanout, FanoutJob job) {
+    if (atomic_fetch_sub(&job->chunks_left, 1) != 1) return;
+
+    StatsRecord(fanout->stats, LATENCY_FANOUT, StatsTime() - job->queued);
+
+    pthread_mutex_lock(&fanout->lock);
+
+    FanoutJob next = job->next;
+    fanout->head = next;
+    if (next == NULL) fanout->tail = NULL;
+
+    pthread_mutex_unlock(&fanout->lock);
+
+    FrameRelease(job->frame);
+    SnapshotRelease(job->members);
+    free(job);
+
+    if (next != NULL) start_job(fanout, next);
+
+    release_fanout(fanout);
+}
+
+/**
+ * Adds a task sending a frame to a range of its members
+ * (or sends to them right away, if the task can't be created).
+ */
+void add_fanout_task(Fanout fanout, FanoutJob job, int start, int end) {
+    struct fanout_task_arg *task_arg = malloc(sizeof(struct fanout_task_arg));
+    if (task_arg == NULL) {
+        perror("malloc");
+        send_range(fanout, job, start, end);
+        return;
+    }
+
+    task_arg->fanout = fanout;
+    task_arg->job = job;
+    task_arg->start = start;
+    task_arg->end = end;
+
+    Task task = TaskNew(fanout_task, task_arg);
+    if (task == NULL) {
+        fprintf(stderr, "TaskNew: error\n");
+        free(task_arg);
+        send_range(fanout, job, start, end);
+        return;
+    }
+
+    ThreadPoolAddTask(fanout->pool, task);
+}
+
+void *fanout_task(void *arg) {
+    struct fanout_task_arg *task_arg = (struct fanout_task_arg *)arg;
+    Fanout fanout = task_arg->fanout;
+    FanoutJob job = task_arg->job;
+    int start = task_arg->start;
+    int end = task_arg->end;
+    free(task_arg);
+
+    send_range(fanout, job, start, end);
+
+    return NULL;
+}
+
+/**
+ * Sends a frame to a range of its members, if it fits in a chunk.
+ * Otherwise, splits the range (on chunk boundaries) between new tasks.
+ */
+void send_range(Fanout fanout, FanoutJob job, int start, int end) {
+    if (end - start > FANOUT_CHUNK_SIZE) {
+        int chunks = (end - start + FANOUT_CHUNK_SIZE - 1) / FANOUT_CHUNK_SIZE;
+        int step = (chunks + FANOUT_WIDTH - 1) / FANOUT_WIDTH * FANOUT_CHUNK_SIZE;
+
+        for (int i = start; i < end; i += step) {
+            add_fanout_task(fanout, job, i, i + step < end ? i + step : end);
+        }
+        return;
+    }
+
+    // Members that dropped the frame (their queue is full) can resume later
+    for (int i = start; i < end; i++) {
+        Connection member = job->members->members[i];
+        if (member == job->except) continue;
+
+        ConnectionSend(member, job->frame);
+    }
+
+    finish_chunk(fanout, job);
+}
+
+/**
+ * Removes a reference to a fan-out, freeing it after the last one.
+ */
+void release_fanout(Fanout fanout) {
+    if (atomic_fetch_sub(&fanout->refs, 1) != 1) return;
+
+    pthread_mutex_destroy(&fanout->lock);
+    free(fanout);
+}
@@ -0,0 +1,36 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+
+#include "frame.h"
+
+////////////////////////////////// FUNCTIONS ///////////////////////////////////
+
+Frame FrameNew(MessageType type, const char *data, size_t len) {
+    Frame frame = malloc(sizeof(struct frame) + len);
+    if (frame == NULL) {
+        perror("malloc");
+        return NULL;
+    }
+
+    frame->type = type;
+    atomic_init(&frame->refs, 1);
+    frame->len = len;
+    memcpy(frame->data, data, len);
+
+    char *newline = memchr(frame->data, '\n', len);
+    frame->type_len = newline == NULL ? len : (size_t)(newline - frame->data) + 1;
+
+    return frame;
+}
+
+void FrameRetain(Frame frame) {
+    atomic_fetch_add(&frame->refs, 1);
+}
+
+void FrameRelease(Frame frame) {
+    if (atomic_fetch_sub(&frame->refs, 1) == 1) {
+        free(frame);
+    }
+}
@@ -0,0 +1,958 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <inttypes.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "room.h"
+#include "connection.h"
+#include "fanout.h"
+#include "frame.h"
+#include "hash_table.h"
+#include "message_log.h"
+#include "stats.h"
+#include "server_stats.h"
+
+#define ROOMS_INITIAL_SLOTS 64
+
+struct rooms {
+    HashTable table; // Maps names to rooms
+    MessageLog log;
+    MessageBus bus;
+    ThreadPool pool; // Runs the fan-outs of large rooms
+    Stats stats;
+    char id[GDMP_USERNAME_MAX_LEN]; // Of the server
+    Connection links[ROOM_MAX_PEERS]; // To other servers
+    int link_count;
+    pthread_mutex_t lock;
+};
+
+/**
+ * The state of a resume's read of the log, which collects the room's newest
+ * messages after a sequence number, oldest first (in a ring).
+ */
+struct resume_scan {
+    char *room;
+    char *username;
+    uint64_t after; // Last message the client saw
+    uint64_t last;  // Last of the room's messages read
+    Frame frames[ROOM_RESUME_MAX];
+    int head;
+    int count;
+    int scanned;
+};
+
+Room room_new(char *name, Rooms rooms);
+Room get_room(Rooms rooms, char *name);
+void room_free(Room room);
+int add_member(Room room, Connection conn);
+void remove_member(Room room, Connection conn);
+int send_members(Room room, Frame frame, Connection except);
+void forget_snapshot(Room room);
+Frame number_message(Room room, GDMPMessage msg);
+void add_history(Room room, Frame frame);
+void send_history(Room room, Connection conn);
+void scan_log(Rooms rooms, char *name, Connection conn, uint64_t seq, struct resume_scan *scan);
+void send_delta(Room room, Connection conn, struct resume_scan *scan);
+bool scan_record(LogRecord *record, const char *data, void *arg);
+uint64_t message_seq(const char *data, size_t len, char *room);
+bool sent_by(const char *data, size_t len, char *username);
+const char *find_string(const char *data, size_t len, const char *str, size_t str_len);
+uint64_t time_us(void);
+void announce_room(Rooms rooms, Room room, MessageType type, Connection link);
+int add_peer(Room room, Connection link);
+bool remove_peer(Room room, Connection link);
+void free_unused_room(Rooms rooms, Room room);
+void flush_presence(Room room);
+void note_join(Room room, char *username);
+void note_leave(Room room, char *username);
+int presence_add(PresenceSet *set, char *username);
+bool presence_remove(PresenceSet *set, char *username);
+void presence_take(PresenceSet *set, char *list, size_t size);
+
+////////////////////////////////// FUNCTIONS ///////////////////////////////////
+
+Rooms RoomsNew(MessageLog log, MessageBus bus, ThreadPool pool, Stats stats, char *id) {
+    Rooms rooms = malloc(sizeof(*rooms));
+    if (rooms == NULL) {
+        perror("malloc");
+        return NULL;
+    }
+
+    rooms->table = HashTableNew(ROOMS_INITIAL_SLOTS);
+    rooms->log = log;
+    rooms->bus = bus;
+    rooms->pool = pool;
+    rooms->stats = stats;
+    snprintf(rooms->id, sizeof(rooms->id), "%s", id);
+    rooms->link_count = 0;
+    pthread_mutex_init(&rooms->lock, NULL);
+
+    return rooms;
+}
+
+void RoomsFree(Rooms rooms) {
+    HashTableIterator it = HashTableIterate(rooms->table);
+    Key name;
+    Value room;
+    while (HashTableNext(&it, &name, &room)) {
+        room_free(room);
+    }
+
+    for (int i = 0; i < rooms->link_count; i++) {
+        ConnectionRelease(rooms->links[i]);
+    }
+
+    HashTableFree(rooms->table);
+    pthread_mutex_destroy(&rooms->lock);
+    free(rooms);
+}
+
+Room RoomsJoin(Rooms rooms, char *name, Connection conn, uint64_t seq) {
+    // A resume reads the log before taking the locks
+    struct resume_scan scan;
+    scan.count = 0;
+    if (seq != 0) scan_log(rooms, name, conn, seq, &scan);
+
+    pthread_mutex_lock(&rooms->lock);
+
+    Room room = get_room(rooms, name);
+    if (room == NULL) {
+        pthread_mutex_unlock(&rooms->lock);
+        for (int i = 0; i < scan.count; i++) FrameRelease(scan.frames[i]);
+        return NULL;
+    }
+
+    // Replay the history before any new message can be sent to the room
+    pthread_rwlock_wrlock(&room->lock);
+    int res = add_member(room, conn);
+    if (res == 0) note_join(room, conn->username);
+    if (res == 0 && seq == 0) send_history(room, conn);
+    if (res == 0 && seq != 0) send_delta(room, conn, &scan);
+    pthread_rwlock_unlock(&room->lock);
+
+    // Peers send the room's messages here from its first member on
+    if (res == 0 && room->member_count == 1) {
+        announce_room(rooms, room, GDMP_JOIN_MESSAGE, NULL);
+    }
+
+    // Don't leave an empty room behind
+    if (res == -1) free_unused_room(rooms, room);
+
+    pthread_mutex_unlock(&rooms->lock);
+
+    for (int i = 0; i < scan.count; i++) FrameRelease(scan.frames[i]);
+
+    return res == -1 ? NULL : room;
+}
+
+Room RoomsRejoin(Rooms rooms, char *name, Connection conn) {
+    pthread_mutex_lock(&rooms->lock);
+
+    Room room = get_room(rooms, name);
+    if (room == NULL) {
+        pthread_mutex_unlock(&rooms->lock);
+        return NULL;
+    }
+
+    pthread_rwlock_wrlock(&room->lock);
+    int res = add_member(room, conn);
+    pthread_rwlock_unlock(&room->lock);
+
+    if (res == 0 && room->member_count == 1) {
+        announce_room(rooms, room, GDMP_JOIN_MESSAGE, NULL);
+    }
+
+    if (res == -1) free_unused_room(rooms, room);
+
+    pthread_mutex_unlock(&rooms->lock);
+
+    return res == -1 ? NULL : room;
+}
+
+void RoomsLeave(Rooms rooms, Room room, Connection conn) {
+    pthread_mutex_lock(&rooms->lock);
+
+    pthread_rwlock_wrlock(&room->lock);
+    remove_member(room, conn);
+    note_leave(room, conn->username);
+    pthread_rwlock_unlock(&room->lock);
+
+    // Free the room after its last member leaves (unless peers still use it)
+    if (room->member_count == 0) {
+        announce_room(rooms, room, GDMP_LEAVE_MESSAGE, NULL);
+        free_unused_room(rooms, room);
+    }
+
+    pthread_mutex_unlock(&rooms->lock);
+}
+
+void RoomTyping(Room room, char *username) {
+    pthread_mutex_lock(&room->presence_lock);
+    presence_add(&room->typing, username);
+    pthread_mutex_unlock(&room->presence_lock);
+}
+
+void RoomsFlushPresence(Rooms rooms) {
+    pthread_mutex_lock(&rooms->lock);
+
+    HashTableIterator it = HashTableIterate(rooms->table);
+    Key name;
+    Value room;
+    while (HashTableNext(&it, &name, &room)) {
+        flush_presence(room);
+    }
+
+    pthread_mutex_unlock(&rooms->lock);
+}
+
+int RoomsAddPeer(Rooms rooms, Connection link) {
+    pthread_mutex_lock(&rooms->lock);
+
+    // A second link to the same server would deliver every message twice
+    bool linked = false;
+    for (int i = 0; i < rooms->link_count; i++) {
+        if (strcmp(rooms->links[i]->peer_id, link->peer_id) == 0) linked = true;
+    }
+
+    if (linked || rooms->link_count == ROOM_MAX_PEERS) {
+        pthread_mutex_unlock(&rooms->lock);
+        return -1;
+    }
+
+    ConnectionRetain(link);
+    rooms->links[rooms->link_count] = link;
+    rooms->link_count++;
+
+    // Tell the server which rooms have members here
+    HashTableIterator it = HashTableIterate(rooms->table);
+    Key name;
+    Value room;
+    while (HashTableNext(&it, &name, &room)) {
+        if (((Room)room)->member_count > 0) announce_room(rooms, room, GDMP_JOIN_MESSAGE, link);
+    }
+
+    pthread_mutex_unlock(&rooms->lock);
+
+    return 0;
+}
+
+void RoomsRemovePeer(Rooms rooms, Connection link) {
+    pthread_mutex_lock(&rooms->lock);
+
+    // Remove the link from every room, then free the rooms only it was using
+    // (the table can't change while it is iterated)
+    int unused_count = 0;
+    Room *unused = malloc(HashTableSize(rooms->table) * sizeof(Room));
+
+    HashTableIterator it = HashTableIterate(rooms->table);
+    Key name;
+    Value room;
+    while (HashTableNext(&it, &name, &room)) {
+        pthread_rwlock_wrlock(&((Room)room)->lock);
+        bool removed = remove_peer(room, link);
+        pthread_rwlock_unlock(&((Room)room)->lock);
+
+        if (removed && unused != NULL) unused[unused_count++] = room;
+    }
+
+    for (int i = 0; i < unused_count; i++) {
+        free_unused_room(rooms, unused[i]);
+    }
+    free(unused);
+
+    for (int i = 0; i < rooms->link_count; i++) {
+        if (rooms->links[i] != link) continue;
+
+        rooms->links[i] = rooms->links[rooms->link_count - 1];
+        rooms->link_count--;
+        ConnectionRelease(link);
+        break;
+    }
+
+    pthread_mutex_unlock(&rooms->lock);
+}
+
+void RoomsPeerJoin(Rooms rooms, char *name, Connection link) {
+    pthread_mutex_lock(&rooms->lock);
+
+    // Create the room on the first join
+    Room room = HashTableGet(rooms->table, name);
+    if (room == NULL) {
+        room = room_new(name, rooms);
+        if (room == NULL) {
+            pthread_mutex_unlock(&rooms->lock);
+            return;
+        }
+        HashTableInsert(rooms->table, room->name, room);
+    }
+
+    pthread_rwlock_wrlock(&room->lock);
+    int res = add_peer(room, link);
+    pthread_rwlock_unlock(&room->lock);
+
+    if (res == -1) free_unused_room(rooms, room);
+
+    pthread_mutex_unlock(&rooms->lock);
+}
+
+void RoomsPeerLeave(Rooms rooms, char *name, Connection link) {
+    pthread_mutex_lock(&rooms->lock);
+
+    Room room = HashTableGet(rooms->table, name);
+    if (room != NULL) {
+        pthread_rwlock_wrlock(&room->lock);
+        remove_peer(room, link);
+        pthread_rwlock_unlock(&room->lock);
+
+        free_unused_room(rooms, room);
+    }
+
+    pthread_mutex_unlock(&rooms->lock);
+}
+
+int RoomsRelay(Rooms rooms, GDMPMessage msg, Connection link) {
+    pthread_mutex_lock(&rooms->lock);
+
+    // The room is kept while the message is sent
+    Room room = HashTableGet(rooms->table, GDMPGetValue(msg, "Room"));
+    int dropped = 0;
+    if (room != NULL && room->member_count > 0) {
+        dropped = RoomSend(room, msg, link, true);
+    }
+
+    pthread_mutex_unlock(&rooms->lock);
+
+    return dropped;
+}
+
+int RoomSend(Room room, GDMPMessage msg, Connection except, bool relayed) {
+    int dropped = 0;
+
+    pthread_rwlock_rdlock(&room->lock);
+
+    // Number, store and send messages in the same order,
+    // so a client never sees a message before an older one
+    pthread_mutex_lock(&room->history_lock);
+
+    Frame frame = number_message(room, msg);
+    if (frame == NULL) {
+        pthread_mutex_unlock(&room->history_lock);
+        pthread_rwlock_unlock(&room->lock);
+        return -1;
+    }
+
+    // Written to disk by the log's writer thread
+    if (MessageLogAppend(room->log, frame->data, frame->len) == -1) {
+        fprintf(stderr, "MessageLogAppend: error\n");
+    }
+
+    add_history(room, frame);
+
+    dropped = send_members(room, frame, except);
+    if (dropped == -1) {
+        pthread_mutex_unlock(&room->history_lock);
+        pthread_rwlock_unlock(&room->lock);
+        FrameRelease(frame);
+        return -1;
+    }
+
+    // Relay to the servers with members in the room, unless one relayed it here
+    if (!relayed) {
+        for (int i = 0; i < room->peer_count; i++) {
+            if (ConnectionSend(room->peers[i], frame) == -1) dropped++;
+        }
+
+        if (room->bus != NULL && MessageBusPublish(room->bus, frame->data, frame->len) == -1) {
+            fprintf(stderr, "MessageBusPublish: error\n");
+        }
+    }
+
+    pthread_mutex_unlock(&room->history_lock);
+    pthread_rwlock_unlock(&room->lock);
+
+    FrameRelease(frame);
+    return dropped;
+}
+
+////////////////////////////// HELPER FUNCTIONS ////////////////////////////////
+
+/**
+ * Creates an empty room in a set of rooms. Returns NULL on error.
+ */
+Room room_new(char *name, Rooms rooms) {
+    Room room = malloc(sizeof(struct room));
+    if (room == NULL) {
+        perror("malloc");
+        return NULL;
+    }
+
+    room->members = malloc(ROOM_INITIAL_CAPACITY * sizeof(Connection));
+    if (room->members == NULL) {
+        perror("malloc");
+        free(room);
+        return NULL;
+    }
+
+    room->fanout = FanoutNew(rooms->pool, rooms->stats);
+    if (room->fanout == NULL) {
+        fprintf(stderr, "FanoutNew: error\n");
+        free(room->members);
+        free(room);
+        return NULL;
+    }
+
+    snprintf(room->name, sizeof(room->name), "%s", name);
+    pthread_rwlock_init(&room->lock, NULL);
+    room->member_count = 0;
+    room->member_capacity = ROOM_INITIAL_CAPACITY;
+    room->peer_count = 0;
+    room->snapshot = NULL;
+
+    pthread_mutex_init(&room->history_lock, NULL);
+    room->seq = 0;
+    room->log = rooms->log;
+    room->bus = rooms->bus;
+    room->stats = rooms->stats;
+
+    pthread_mutex_init(&room->presence_lock, NULL);
+    memset(&room->joined, 0, sizeof(PresenceSet));
+    memset(&room->left, 0, sizeof(PresenceSet));
+    memset(&room->typing, 0, sizeof(PresenceSet));
+    room->history_head = 0;
+    room->history_count = 0;
+    room->history_len = 0;
+
+    return room;
+}
+
+/**
+ * Returns the room with the given name, creating it on the first join
+ * (rooms must be locked). Returns NULL on error.
+ */
+Room get_room(Rooms rooms, char *name) {
+    Room room = HashTableGet(rooms->table, name);
+    if (room != NULL) return room;
+
+    room = room_new(name, rooms);
+    if (room == NULL) return NULL;
+
+    HashTableInsert(rooms->table, room->name, room);
+    return room;
+}
+
+/**
+ * Frees a room, releasing its members and peers.
+ */
+void room_free(Room room) {
+    for (int i = 0; i < room->member_count; i++) {
+        ConnectionRelease(room->members[i]);
+    }
+
+    for (int i = 0; i < room->peer_count; i++) {
+        ConnectionRelease(room->peers[i]);
+    }
+
+    for (int i = 0; i < room->history_count; i++) {
+        FrameRelease(room->history[(room->history_head + i) % ROOM_HISTORY_SIZE]);
+    }
+
+    // Frames still being sent keep the fan-out (and their snapshots)
+    if (room->snapshot != NULL) SnapshotRelease(room->snapshot);
+    FanoutFree(room->fanout);
+
+    free(room->joined.names);
+    free(room->left.names);
+    free(room->typing.names);
+
+    pthread_mutex_destroy(&room->presence_lock);
+    pthread_mutex_destroy(&room->history_lock);
+    pthread_rwlock_destroy(&room->lock);
+    free(room->members);
+    free(room);
+}
+
+/**
+ * Appends a connection to the room's members, retaining it.
+ * Returns -1 on error.
+ */
+int add_member(Room room, Connection conn) {
+    if (room->member_count == room->member_capacity) {
+        int capacity = room->member_capacity * 2;
+        Connection *members = realloc(room->members, capacity * sizeof(Connection));
+        if (members == NULL) {
+            perror("realloc");
+            return -1;
+        }
+
+        room->members = members;
+        room->member_capacity = capacity;
+    }
+
+    ConnectionRetain(conn);
+    room->members[room->member_count] = conn;
+    room->member_count++;
+    forget_snapshot(room);
+
+    return 0;
+}
+
+/**
+ * Removes a connection from the room's members (moving the last member
+ * into its place), releasing it.
+ */
+void remove_member(Room room, Connection conn) {
+    for (int i = 0; i < room->member_count; i++) {
+        if (room->members[i] != conn) continue;
+
+        room->members[i] = room->members[room->member_count - 1];
+        room->member_count--;
+        forget_snapshot(room);
+        ConnectionRelease(conn);
+        return;
+    }
+}
+
+/**
+ * Queues a frame on every member except the given connection. A large room
+ * (or one still sending earlier frames that way) leaves it to its fan-out,
+ * over a snapshot of its members. Called with the history lock held, so
+ * frames are queued in order. Returns the number of members that dropped it
+ * (not counting those the fan-out sends to), or -1 on error.
+ */
+int send_members(Room room, Frame frame, Connection except) {
+    if (room->member_count <= FANOUT_CHUNK_SIZE && !FanoutBusy(room->fanout)) {
+        uint64_t start = StatsTime();
+
+        int dropped = 0;
+        for (int i = 0; i < room->member_count; i++) {
+            Connection member = room->members[i];
+            if (member == except) continue;
+
+            if (ConnectionSend(member, frame) == -1) dropped++;
+        }
+
+        StatsRecord(room->stats, LATENCY_FANOUT, StatsTime() - start);
+        return dropped;
+    }
+
+    // Taken once, then shared by every frame until the members change
+    if (room->snapshot == NULL) {
+        room->snapshot = SnapshotNew(room->members, room->member_count);
+        if (room->snapshot == NULL) {
+            fprintf(stderr, "SnapshotNew: error\n");
+            return -1;
+        }
+    }
+
+    if (FanoutSend(room->fanout, room->snapshot, frame, except) == -1) {
+        fprintf(stderr, "FanoutSend: error\n");
+        return -1;
+    }
+
+    return 0;
+}
+
+/**
+ * Drops the room's snapshot of its members, once they change.
+ * Called with the room lock held for writing.
+ */
+void forget_snapshot(Room room) {
+    if (room->snapshot == NULL) return;
+
+    SnapshotRelease(room->snapshot);
+    room->snapshot = NULL;
+}
+
+/**
+ * Tells the server at the other end of a link (or every linked server, if it's
+ * NULL) that a room has members here (a join message) or not anymore (a leave
+ * message). Called with the rooms lock held.
+ */
+void announce_room(Rooms rooms, Room room, MessageType type, Connection link) {
+    GDMPMessage msg = GDMPNew(type);
+    if (type == GDMP_JOIN_MESSAGE) GDMPAddHeader(msg, "Username", rooms->id);
+    GDMPAddHeader(msg, "Room", room->name);
+
+    for (int i = 0; i < rooms->link_count; i++) {
+        if (link != NULL && rooms->links[i] != link) continue;
+        ConnectionSendMessage(rooms->links[i], msg);
+    }
+
+    GDMPFree(msg);
+}
+
+/**
+ * Adds a link to the room's peers (unless it's already one), retaining it.
+ * Called with the room lock held. Returns -1 on error.
+ */
+int add_peer(Room room, Connection link) {
+    for (int i = 0; i < room->peer_count; i++) {
+        if (room->peers[i] == link) return 0;
+    }
+
+    if (room->peer_count == ROOM_MAX_PEERS) return -1;
+
+    ConnectionRetain(link);
+    room->peers[room->peer_count] = link;
+    room->peer_count++;
+
+    return 0;
+}
+
+/**
+ * Removes a link from the room's peers, releasing it.
+ * Called with the room lock held. Returns whether it was one.
+ */
+bool remove_peer(Room room, Connection link) {
+    for (int i = 0; i < room->peer_count; i++) {
+        if (room->peers[i] != link) continue;
+
+        room->peers[i] = room->peers[room->peer_count - 1];
+        room->peer_count--;
+        ConnectionRelease(link);
+        return true;
+    }
+
+    return false;
+}
+
+/**
+ * Frees a room if it has no members, and no peers with members in it.
+ * Called with the rooms lock held.
+ */
+void free_unused_room(Rooms rooms, Room room) {
+    if (room->member_count > 0 || room->peer_count > 0) return;
+
+    HashTableDelete(rooms->table, room->name);
+    room_free(room);
+}
+
+/**
+ * Adds the room's next sequence number to a text message, and serializes it.
+ * Called with the history lock held. Returns NULL on error.
+ */
+Frame number_message(Room room, GDMPMessage msg) {
+    uint64_t seq = time_us();
+    if (seq <= room->seq) seq = room->seq + 1;
+
+    char seq_str[24];
+    snprintf(seq_str, sizeof(seq_str), "%" PRIu64, seq);
+    if (GDMPAddHeader(msg, "Seq", seq_str) == -1) return NULL;
+
+    char *msg_str = GDMPStringify(msg);
+    if (msg_str == NULL) return NULL;
+
+    Frame frame = FrameNew(GDMP_TEXT_MESSAGE, msg_str, strlen(msg_str));
+    free(msg_str);
+    if (frame == NULL) return NULL;
+
+    room->seq = seq;
+    return frame;
+}
+
+/**
+ * Adds the room's last message to its history, dropping the oldest frames
+ * to stay within its count and length. Called with the history lock held.
+ */
+void add_history(Room room, Frame frame) {
+    if (frame->len > ROOM_HISTORY_MAX_LEN) return;
+
+    while (room->history_count == ROOM_HISTORY_SIZE
+        || (room->history_count > 0 && room->history_len + frame->len > ROOM_HISTORY_MAX_LEN)) {
+        Frame oldest = room->history[room->history_head];
+        room->history_head = (room->history_head + 1) % ROOM_HISTORY_SIZE;
+        room->history_count--;
+        room->history_len -= oldest->len;
+        FrameRelease(oldest);
+    }
+
+    int idx = (room->history_head + room->history_count) % ROOM_HISTORY_SIZE;
+    FrameRetain(frame);
+    room->history[idx] = frame;
+    room->history_seqs[idx] = room->seq;
+    room->history_count++;
+    room->history_len += frame->len;
+}
+
+/**
+ * Queues the room's history on a connection, oldest first,
+ * so it is written by a single flush. Called with the room lock held.
+ */
+void send_history(Room room, Connection conn) {
+    Frame frames[ROOM_HISTORY_SIZE];
+
+    pthread_mutex_lock(&room->history_lock);
+    int count = room->history_count;
+    for (int i = 0; i < count; i++) {
+        frames[i] = room->history[(room->history_head + i) % ROOM_HISTORY_SIZE];
+    }
+
+    if (count > 0) ConnectionSendFrames(conn, frames, count);
+    pthread_mutex_unlock(&room->history_lock);
+}
+
+/**
+ * Reads the room's newest messages after the given sequence number (not sent
+ * by the connection) from the log, for a resume. Only the history's oldest
+ * sequence number is read under the locks: unless the history goes back to
+ * seq, the log is read without any.
+ */
+void scan_log(Rooms rooms, char *name, Connection conn, uint64_t seq, struct resume_scan *scan) {
+    scan->room = name;
+    scan->username = conn->username;
+    scan->after = seq;
+    scan->last = seq;
+    scan->head = 0;
+    scan->count = 0;
+    scan->scanned = 0;
+
+    uint64_t oldest = UINT64_MAX;
+    pthread_mutex_lock(&rooms->lock);
+    Room room = HashTableGet(rooms->table, name);
+    if (room != NULL) {
+        pthread_mutex_lock(&room->history_lock);
+        if (room->history_count > 0) oldest = room->history_seqs[room->history_head];
+        pthread_mutex_unlock(&room->history_lock);
+    }
+    pthread_mutex_unlock(&rooms->lock);
+
+    if (oldest <= seq) return;
+
+    // A sequence number is the time (in microseconds) the message was numbered,
+    // so the message was written to the log after it. The log is read to its
+    // end, since the history may move on in the meantime.
+    MessageLogRead(rooms->log, MessageLogFindTime(rooms->log, (int64_t)seq * 1000), scan_record, scan);
+}
+
+/**
+ * Queues the messages a resume read from the log on a connection, then the
+ * history's messages after them (not sent by the connection), keeping the
+ * newest ROOM_RESUME_MAX. Called with the room lock held.
+ */
+void send_delta(Room room, Connection conn, struct resume_scan *scan) {
+    pthread_mutex_lock(&room->history_lock);
+
+    // Find the history's messages after the last one read from the log
+    Frame recent[ROOM_HISTORY_SIZE];
+    int recent_count = 0;
+    for (int i = 0; i < room->history_count; i++) {
+        int idx = (room->history_head + i) % ROOM_HISTORY_SIZE;
+        Frame frame = room->history[idx];
+        if (room->history_seqs[idx] <= scan->last) continue;
+        if (!sent_by(frame->data, frame->len, conn->username)) recent[recent_count++] = frame;
+    }
+
+    // Queue everything, oldest first
+    int skip = scan->count + recent_count - ROOM_RESUME_MAX;
+    if (skip < 0) skip = 0;
+
+    Frame frames[ROOM_RESUME_MAX];
+    int count = 0;
+    for (int i = skip; i < scan->count; i++) {
+        frames[count++] = scan->frames[(scan->head + i) % ROOM_RESUME_MAX];
+    }
+    for (int i = skip > scan->count ? skip - scan->count : 0; i < recent_count; i++) {
+        frames[count++] = recent[i];
+    }
+
+    if (count > 0) ConnectionSendFrames(conn, frames, count);
+    pthread_mutex_unlock(&room->history_lock);
+}
+
+/**
+ * Collects a logged message for a resume, if it's one of the room's messages
+ * after the last one the client saw, keeping the newest ROOM_RESUME_MAX.
+ * Stops once enough records were looked at.
+ */
+bool scan_record(LogRecord *record, const char *data, void *arg) {
+    struct resume_scan *scan = arg;
+    if (++scan->scanned > ROOM_RESUME_SCAN_MAX) return false;
+
+    uint64_t seq = message_seq(data, record->len, scan->room);
+    if (seq <= scan->after) return true;
+
+    scan->last = seq;
+    if (sent_by(data, record->len, scan->username)) return true;
+
+    Frame frame = FrameNew(GDMP_TEXT_MESSAGE, data, record->len);
+    if (frame == NULL) return false;
+
+    // Replace the oldest message once the ring is full
+    if (scan->count == ROOM_RESUME_MAX) {
+        FrameRelease(scan->frames[scan->head]);
+        scan->frames[scan->head] = frame;
+        scan->head = (scan->head + 1) % ROOM_RESUME_MAX;
+    } else {
+        scan->frames[scan->count++] = frame;
+    }
+    return true;
+}
+
+/**
+ * Returns the sequence number of a serialized text message if it was sent
+ * to the given room, or 0 otherwise.
+ */
+uint64_t message_seq(const char *data, size_t len, char *room) {
+    char line[GDMP_ROOM_MAX_LEN + 16];
+    int line_len = snprintf(line, sizeof(line), "\nRoom: %s\n", room);
+    if (find_string(data, len, line, line_len) == NULL) return 0;
+
+    // The value ends with a line break, so the number can't run past the data
+    const char *seq = find_string(data, len, "\nSeq: ", 6);
+    return seq == NULL ? 0 : strtoull(seq + 6, NULL, 10);
+}
+
+/**
+ * Returns true if a serialized text message was sent by the given user.
+ */
+bool sent_by(const char *data, size_t len, char *username) {
+    char line[GDMP_USERNAME_MAX_LEN + 16];
+    int line_len = snprintf(line, sizeof(line), "\nUsername: %s\n", username);
+    return find_string(data, len, line, line_len) != NULL;
+}
+
+/**
+ * Returns the first occurrence of a string in data, or NULL if there is none.
+ */
+const char *find_string(const char *data, size_t len, const char *str, size_t str_len) {
+    const char *end = data + len;
+
+    while ((size_t)(end - data) >= str_len) {
+        const char *pos = memchr(data, str[0], end - data - str_len + 1);
+        if (pos == NULL) return NULL;
+        if (memcmp(pos, str, str_len) == 0) return pos;
+        data = pos + 1;
+    }
+
+    return NULL;
+}
+
+/**
+ * Returns the current time in microseconds since the epoch.
+ */
+uint64_t time_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/**
+ * Sends one presence message to every member of a room, with the joins,
+ * leaves and typing since the last tick (at most ROOM_PRESENCE_MAX usernames
+ * per list, the rest wait for the next tick). Sends nothing without changes.
+ */
+void flush_presence(Room room) {
+    char joined[ROOM_PRESENCE_MAX * GDMP_USERNAME_MAX_LEN];
+    char left[ROOM_PRESENCE_MAX * GDMP_USERNAME_MAX_LEN];
+    char typing[ROOM_PRESENCE_MAX * GDMP_USERNAME_MAX_LEN];
+
+    pthread_mutex_lock(&room->presence_lock);
+    presence_take(&room->joined, joined, sizeof(joined));
+    presence_take(&room->left, left, sizeof(left));
+    presence_take(&room->typing, typing, sizeof(typing));
+    pthread_mutex_unlock(&room->presence_lock);
+
+    if (joined[0] == '\0' && left[0] == '\0' && typing[0] == '\0') return;
+
+    // Create message
+    GDMPMessage msg = GDMPNew(GDMP_PRESENCE_MESSAGE);
+    GDMPAddHeader(msg, "Room", room->name);
+    if (joined[0] != '\0') GDMPAddHeader(msg, "Joined", joined);
+    if (left[0] != '\0') GDMPAddHeader(msg, "Left", left);
+    if (typing[0] != '\0') GDMPAddHeader(msg, "Typing", typing);
+
+    // Serialize message (once for all members)
+    char *msg_str = GDMPStringify(msg);
+    GDMPFree(msg);
+    if (msg_str == NULL) return;
+
+    Frame frame = FrameNew(GDMP_PRESENCE_MESSAGE, msg_str, strlen(msg_str));
+    free(msg_str);
+    if (frame == NULL) return;
+
+    pthread_rwlock_rdlock(&room->lock);
+    for (int i = 0; i < room->member_count; i++) {
+        ConnectionSend(room->members[i], frame);
+    }
+    pthread_rwlock_unlock(&room->lock);
+
+    FrameRelease(frame);
+}
+
+/**
+ * Notes a join for the next tick, unless it cancels a leave.
+ */
+void note_join(Room room, char *username) {
+    pthread_mutex_lock(&room->presence_lock);
+    if (!presence_remove(&room->left, username)) presence_add(&room->joined, username);
+    pthread_mutex_unlock(&room->presence_lock);
+}
+
+/**
+ * Notes a leave for the next tick, unless it cancels a join.
+ */
+void note_leave(Room room, char *username) {
+    pthread_mutex_lock(&room->presence_lock);
+    presence_remove(&room->typing, username);
+    if (!presence_remove(&room->joined, username)) presence_add(&room->left, username);
+    pthread_mutex_unlock(&room->presence_lock);
+}
+
+/**
+ * Adds a username to a set, unless it's already in it. Returns -1 on error.
+ */
+int presence_add(PresenceSet *set, char *username) {
+    for (int i = 0; i < set->count; i++) {
+        if (strcmp(set->names[i], username) == 0) return 0;
+    }
+
+    if (set->count == set->capacity) {
+        int capacity = set->capacity == 0 ? ROOM_PRESENCE_MAX : set->capacity * 2;
+        char (*names)[GDMP_USERNAME_MAX_LEN] = realloc(set->names, capacity * sizeof(*names));
+        if (names == NULL) {
+            perror("realloc");
+            return -1;
+        }
+
+        set->names = names;
+        set->capacity = capacity;
+    }
+
+    snprintf(set->names[set->count], GDMP_USERNAME_MAX_LEN, "%s", username);
+    set->count++;
+    return 0;
+}
+
+/**
+ * Removes a username from a set. Returns false if it wasn't in it.
+ */
+bool presence_remove(PresenceSet *set, char *username) {
+    for (int i = 0; i < set->count; i++) {
+        if (strcmp(set->names[i], username) != 0) continue;
+
+        memcpy(set->names[i], set->names[set->count - 1], GDMP_USERNAME_MAX_LEN);
+        set->count--;
+        return true;
+    }
+
+    return false;
+}
+
+/**
+ * Writes up to ROOM_PRESENCE_MAX usernames of a set as a comma separated
+ * list, removing them from the set.
+ */
+void presence_take(PresenceSet *set, char *list, size_t size) {
+    int count = set->count < ROOM_PRESENCE_MAX ? set->count : ROOM_PRESENCE_MAX;
+    size_t len = 0;
+    list[0] = '\0';
+
+    for (int i = 0; i < count; i++) {
+        len += snprintf(list + len, size - len, "%s%s", i > 0 ? "," : "", set->names[set->count - 1 - i]);
+    }
+
+    set->count -= count;
+}
@@ -8,8 +8,13 @@ Client cli;
 
 void handle_sigint(int signal);
 
-int main(void) {
-    cli = ClientNew();
+/**
+ * Usage: run_client [port]
+ */
+int main(int argc, char *argv[]) {
+    int port = argc > 1 ? atoi(argv[1]) : CLIENT_SERVER_PORT;
+
+    cli = ClientNew(port);
     if (cli == NULL) {
         fprintf(stderr, "ClientNew: error\n");
         exit(EXIT_FAILURE);
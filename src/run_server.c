@@ -1,22 +1,97 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
 #include <signal.h>
+#include <unistd.h>
 
 #include "server.h"
 
 Server srv;
 
 void handle_sigint(int signal);
+void handle_sigusr(int signal);
 
-int main(void) {
-    srv = ServerNew();
+/**
+ * Usage: run_server [-u] [-b bus] [-s stats_port] [-t trace_every] [-l level] [-a peer_ip] [port] [peer_ip:peer_port ...]
+ */
+int main(int argc, char *argv[]) {
+    // Share a message bus (and the port) with the other processes given it,
+    // take over from the server running in this directory with -u,
+    // serve stats on a local port with -s, trace one in every few
+    // messages of each client with -t, log at a level with -l, and accept
+    // links from servers at the addresses given with -a (and the peers')
+    char *bus = NULL;
+    bool upgrade = false;
+    int stats_port = 0;
+    int trace_every = 0;
+    int level = SERVER_LOG_LEVEL;
+    char *allowed[SERVER_MAX_PEERS];
+    int allowed_count = 0;
+    int opt;
+    while ((opt = getopt(argc, argv, "ub:s:t:l:a:")) != -1) {
+        if (opt == 'u') {
+            upgrade = true;
+        } else if (opt == 'b') {
+            bus = optarg;
+        } else if (opt == 's') {
+            stats_port = atoi(optarg);
+        } else if (opt == 't') {
+            trace_every = atoi(optarg);
+        } else if (opt == 'l' && LoggerLevelNamed(optarg) != -1) {
+            level = LoggerLevelNamed(optarg);
+        } else if (opt == 'a' && allowed_count < SERVER_MAX_PEERS) {
+            allowed[allowed_count++] = optarg;
+        } else {
+            fprintf(stderr, "Usage: %s [-u] [-b bus] [-s stats_port] [-t trace_every] [-l level] [-a peer_ip] [port] [peer_ip:peer_port ...]\n", argv[0]);
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    int port = optind < argc ? atoi(argv[optind]) : SERVER_PORT;
+
+    srv = ServerNew(port, bus, upgrade);
     if (srv == NULL) {
         fprintf(stderr, "ServerNew: error\n");
         exit(EXIT_FAILURE);
     }
 
+    ServerTrace(srv, trace_every);
+    ServerSetLogLevel(srv, level);
+
+    if (stats_port != 0 && ServerServeStats(srv, stats_port) == -1) {
+        fprintf(stderr, "ServerServeStats: error\n");
+        exit(EXIT_FAILURE);
+    }
+
+    for (int i = 0; i < allowed_count; i++) {
+        if (ServerAllowPeer(srv, allowed[i]) == -1) {
+            fprintf(stderr, "ServerAllowPeer: error\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    // Link with the given peers
+    for (int i = optind + 1; i < argc; i++) {
+        char *colon = strrchr(argv[i], ':');
+        if (colon == NULL) {
+            fprintf(stderr, "Invalid peer (expected ip:port): %s\n", argv[i]);
+            exit(EXIT_FAILURE);
+        }
+
+        *colon = '\0';
+        if (ServerAddPeer(srv, argv[i], atoi(colon + 1)) == -1) {
+            fprintf(stderr, "ServerAddPeer: error\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+
     signal(SIGINT, handle_sigint);
 
+    // Log more with SIGUSR1, and less with SIGUSR2
+    signal(SIGUSR1, handle_sigusr);
+    signal(SIGUSR2, handle_sigusr);
+
     int res = ServerStart(srv);
     if (res == -1) {
         fprintf(stderr, "ServerStart: error\n");
@@ -30,3 +105,9 @@ int main(void) {
 void handle_sigint(int signal) {
     ServerFree(srv);
 }
+
+void handle_sigusr(int signal) {
+    LogLevel level = ServerLogLevel(srv);
+    if (signal == SIGUSR1 && level > LOG_DEBUG) ServerSetLogLevel(srv, level - 1);
+    if (signal == SIGUSR2 && level < LOG_ERROR) ServerSetLogLevel(srv, level + 1);
+}
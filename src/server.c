@@ -2,45 +2,135 @@
 #include <stdlib.h>
 #include <unistd.h>
 #include <sys/socket.h>
+#include <sys/un.h>
 #include <netinet/in.h>
+#include <arpa/inet.h>
 #include <poll.h>
 #include <errno.h>
 #include <pthread.h>
 #include <stdbool.h>
 #include <stdatomic.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <string.h>
+#include <time.h>
 
 #include "server.h"
 #include "server_process.h"
+#include "server_stats.h"
+#include "connection.h"
+#include "directory.h"
+#include "room.h"
 #include "gdmp.h"
+#include "gdmp_compress.h"
 #include "thread_pool.h"
+#include "probes.h"
+#include "logger.h"
 
 struct receive_message_arg {
     Server srv;
     int client_sockfd;
+    uint64_t ready; // When the task was added (in us)
+};
+
+/**
+ * What a server hands a new process over with each socket (the listening
+ * socket first, then each client's). It's followed by the client's
+ * decompression window, then the bytes received from it but not parsed yet.
+ */
+struct handoff_record {
+    bool listener;
+    bool compressed; // Sent to compressed
+    char username[GDMP_USERNAME_MAX_LEN];
+    char rooms[CONNECTION_MAX_ROOMS][GDMP_ROOM_MAX_LEN];
+    int room_count;
+    size_t window_len;
+    size_t pending_len;
 };
 
 int setup_server(Server srv);
+int listen_upgrade(Server srv);
 void free_server(Server srv);
 int get_client(Server srv);
 int add_client(Server srv, int client_sockfd);
 int remove_client(Server srv, int client_sockfd);
+void disconnect_client(Server srv, int client_sockfd);
 int add_poll(Server srv, int client_sockfd);
 int remove_poll(Server srv, int client_sockfd);
 int check_poll(Server srv);
+void dial_peers(Server srv);
+int link_peer(Server srv, int peer_idx);
+int add_receive_task(Server srv, int client_sockfd);
+int delay_client(Server srv, int client_sockfd, uint64_t until);
+void wake_clients(Server srv, uint64_t now);
 void *receive_message(void *arg);
+void *read_bus(void *arg);
+void deliver_bus_message(const char *data, size_t len, void *arg);
+int hand_off(Server srv);
+bool clients_quiet(Server srv);
+int send_client(int handoff_sockfd, Connection conn);
+int send_record(int handoff_sockfd, struct handoff_record *record, const char *window, const char *pending, int fd);
+int take_over(Server srv);
+void restore_clients(Server srv, int handoff_sockfd);
+int restore_client(Server srv, struct handoff_record *record, const char *data, int fd);
+ssize_t receive_record(int handoff_sockfd, struct handoff_record *record, char *data, size_t size, int *fd);
+bool within_rate(Connection conn, uint64_t now);
+void retain_connection(void *conn);
+uint64_t time_ms(void);
 
 ////////////////////////////////// FUNCTIONS ///////////////////////////////////
 
-Server ServerNew(void) {
+Server ServerNew(int port, char *bus, bool upgrade) {
     Server srv = malloc(sizeof(struct server));
     if (srv == NULL) {
         perror("malloc");
         return NULL;
     }
 
-    srv->sockfd = socket(AF_INET, SOCK_STREAM, 0);
-    if (srv->sockfd == -1) {
-        perror("socket");
+    // Everything after this logs through the logger
+    srv->logger = LoggerNew(stdout, stderr, SERVER_LOG_LEVEL);
+    if (srv->logger == NULL) {
+        fprintf(stderr, "LoggerNew: error\n");
+        free(srv);
+        return NULL;
+    }
+
+    // Servers started at the same time still get different ids
+    uint32_t id = (uint32_t)time_ms() ^ ((uint32_t)getpid() << 16);
+    snprintf(srv->id, sizeof(srv->id), "%08x", id);
+    srv->port = port;
+    srv->peer_count = 0;
+    srv->allowed_count = 0;
+
+    srv->upgrade_sockfd = -1;
+    srv->handed_off = false;
+
+    // Take over the listening socket of the running server (once it's quiet),
+    // before opening the message log it writes to
+    int handoff_sockfd = -1;
+    if (upgrade) {
+        handoff_sockfd = take_over(srv);
+        if (handoff_sockfd == -1) {
+            fprintf(stderr, "take_over: error\n");
+            LoggerFree(srv->logger);
+            free(srv);
+            return NULL;
+        }
+    } else {
+        srv->sockfd = socket(AF_INET, SOCK_STREAM, 0);
+        if (srv->sockfd == -1) {
+            perror("socket");
+            LoggerFree(srv->logger);
+            free(srv);
+            return NULL;
+        }
+    }
+
+    srv->stats = StatsNew(STAT_COUNT, LATENCY_COUNT);
+    if (srv->stats == NULL) {
+        fprintf(stderr, "StatsNew: error\n");
+        close(srv->sockfd);
+        LoggerFree(srv->logger);
         free(srv);
         return NULL;
     }
@@ -48,46 +138,148 @@ Server ServerNew(void) {
     srv->clients = malloc(sizeof(int) * SERVER_MAX_CLIENT_COUNT);
     if (srv->clients == NULL) {
         perror("malloc");
+        StatsFree(srv->stats);
         close(srv->sockfd);
+        LoggerFree(srv->logger);
         free(srv);
         return NULL;
     }
 
     srv->client_count = 0;
 
-    srv->poll_set = malloc(sizeof(struct pollfd) * SERVER_MAX_POLL_COUNT);
-    if (srv->poll_set == NULL) {
-        perror("malloc");
+    srv->connections = calloc(SERVER_MAX_FD, sizeof(Connection));
+    if (srv->connections == NULL) {
+        perror("calloc");
         free(srv->clients);
+        StatsFree(srv->stats);
         close(srv->sockfd);
+        LoggerFree(srv->logger);
         free(srv);
         return NULL;
     }
 
-    srv->poll_count = 0;
+    srv->users = DirectoryNew(retain_connection);
+    if (srv->users == NULL) {
+        fprintf(stderr, "DirectoryNew: error\n");
+        free(srv->connections);
+        free(srv->clients);
+        StatsFree(srv->stats);
+        close(srv->sockfd);
+        LoggerFree(srv->logger);
+        free(srv);
+        return NULL;
+    }
+
+    srv->log = MessageLogNew(SERVER_LOG_DIR, SERVER_LOG_SYNC, SERVER_LOG_SEGMENT_SIZE);
+    if (srv->log == NULL) {
+        fprintf(stderr, "MessageLogNew: error\n");
+        DirectoryFree(srv->users);
+        free(srv->connections);
+        free(srv->clients);
+        StatsFree(srv->stats);
+        close(srv->sockfd);
+        LoggerFree(srv->logger);
+        free(srv);
+        return NULL;
+    }
 
+    srv->bus = NULL;
+    if (bus != NULL) {
+        srv->bus = MessageBusOpen(bus, SERVER_BUS_SIZE);
+        if (srv->bus == NULL) {
+            fprintf(stderr, "MessageBusOpen: error\n");
+            MessageLogFree(srv->log);
+            DirectoryFree(srv->users);
+            free(srv->connections);
+            free(srv->clients);
+            StatsFree(srv->stats);
+            close(srv->sockfd);
+            LoggerFree(srv->logger);
+            free(srv);
+            return NULL;
+        }
+    }
+
+    // Large rooms send with tasks in the pool
     srv->pool = ThreadPoolNew(SERVER_THREAD_COUNT);
     if (srv->pool == NULL) {
         fprintf(stderr, "ThreadPoolNew: error\n");
-        free(srv->poll_set);
+        if (srv->bus != NULL) MessageBusClose(srv->bus);
+        MessageLogFree(srv->log);
+        DirectoryFree(srv->users);
+        free(srv->connections);
+        free(srv->clients);
+        StatsFree(srv->stats);
+        close(srv->sockfd);
+        LoggerFree(srv->logger);
+        free(srv);
+        return NULL;
+    }
+
+    srv->rooms = RoomsNew(srv->log, srv->bus, srv->pool, srv->stats, srv->id);
+    if (srv->rooms == NULL) {
+        fprintf(stderr, "RoomsNew: error\n");
+        ThreadPoolFree(srv->pool);
+        if (srv->bus != NULL) MessageBusClose(srv->bus);
+        MessageLogFree(srv->log);
+        DirectoryFree(srv->users);
+        free(srv->connections);
+        free(srv->clients);
+        StatsFree(srv->stats);
+        close(srv->sockfd);
+        LoggerFree(srv->logger);
+        free(srv);
+        return NULL;
+    }
+
+    srv->poll_set = malloc(sizeof(struct pollfd) * SERVER_MAX_POLL_COUNT);
+    if (srv->poll_set == NULL) {
+        perror("malloc");
+        RoomsFree(srv->rooms);
+        ThreadPoolFree(srv->pool);
+        if (srv->bus != NULL) MessageBusClose(srv->bus);
+        MessageLogFree(srv->log);
+        DirectoryFree(srv->users);
+        free(srv->connections);
         free(srv->clients);
+        StatsFree(srv->stats);
         close(srv->sockfd);
+        LoggerFree(srv->logger);
         free(srv);
         return NULL;
     }
 
+    srv->poll_count = 0;
+    srv->delayed_count = 0;
+
+    srv->rate_policy = SERVER_RATE_POLICY;
+    srv->stats_sockfd = -1;
+    srv->trace_every = 0;
+
     atomic_store(&srv->shutdown, false);
 
     pthread_mutex_init(&srv->lock, NULL); 
 
-    // Setup the server
-    int res = setup_server(srv);
+    // Setup the server (the listening socket taken over is already bound)
+    int res = upgrade ? add_poll(srv, srv->sockfd) : setup_server(srv);
     if (res == -1) {
         fprintf(stderr, "setup_server: error\n");
+        if (handoff_sockfd != -1) close(handoff_sockfd);
+        free_server(srv);
+        return NULL;
+    }
+
+    // Let a later process take over in turn
+    res = listen_upgrade(srv);
+    if (res == -1) {
+        fprintf(stderr, "listen_upgrade: error\n");
+        if (handoff_sockfd != -1) close(handoff_sockfd);
         free_server(srv);
         return NULL;
     }
 
+    if (upgrade) restore_clients(srv, handoff_sockfd);
+
     return srv;
 }
 
@@ -103,7 +295,19 @@ int ServerStart(Server srv) {
         return -1;
     }
 
-    printf("Server listening on port %d...\n", SERVER_PORT);
+    LoggerLog(srv->logger, LOG_INFO, "Server %s listening on port %d...", srv->id, srv->port);
+
+    // Deliver the messages of the other processes on the bus
+    if (srv->bus != NULL) {
+        res = pthread_create(&srv->bus_reader, NULL, read_bus, srv);
+        if (res != 0) {
+            fprintf(stderr, "pthread_create: error\n");
+            return -1;
+        }
+    }
+
+    uint64_t last_tick = time_ms();
+    uint64_t last_dial = 0;
 
     while (!atomic_load(&srv->shutdown)) {
         // Wait until a socket is ready or timeout runs out
@@ -123,14 +327,110 @@ int ServerStart(Server srv) {
                 return -1;
             }
         }
+
+        // Handed off (the thread pool is gone)
+        if (atomic_load(&srv->shutdown)) break;
+
+        // Read again from clients delayed by the rate limit
+        uint64_t now = time_ms();
+        wake_clients(srv, now);
+
+        // Link with the peers not linked yet (or anymore)
+        if (now - last_dial >= SERVER_PEER_RETRY_MS) {
+            dial_peers(srv);
+            last_dial = now;
+        }
+
+        // Send the presence changes of the last tick
+        if (now - last_tick >= SERVER_PRESENCE_TICK_MS) {
+            RoomsFlushPresence(srv->rooms);
+            last_tick = now;
+        }
     }
 
-    printf("Server shutting down...\n");
+    LoggerLog(srv->logger, LOG_INFO, "Server shutting down...");
 
+    if (srv->bus != NULL) pthread_join(srv->bus_reader, NULL);
     free_server(srv);
     return 0;
 }
 
+int ServerAddPeer(Server srv, char *host, int port) {
+    if (srv->peer_count == SERVER_MAX_PEERS || strlen(host) >= sizeof(srv->peers[0].host)) {
+        return -1;
+    }
+
+    struct peer_address *peer = &srv->peers[srv->peer_count];
+    strcpy(peer->host, host);
+    peer->port = port;
+    peer->sockfd = -1;
+    srv->peer_count++;
+
+    return 0;
+}
+
+int ServerAllowPeer(Server srv, char *host) {
+    if (srv->allowed_count == SERVER_MAX_PEERS || strlen(host) >= sizeof(srv->allowed_peers[0])) {
+        return -1;
+    }
+
+    strcpy(srv->allowed_peers[srv->allowed_count], host);
+    srv->allowed_count++;
+
+    return 0;
+}
+
+void ServerTrace(Server srv, int every) {
+    srv->trace_every = every;
+}
+
+void ServerSetLogLevel(Server srv, LogLevel level) {
+    LoggerSetLevel(srv->logger, level);
+}
+
+LogLevel ServerLogLevel(Server srv) {
+    return LoggerLevel(srv->logger);
+}
+
+int ServerServeStats(Server srv, int port) {
+    int sockfd = socket(AF_INET, SOCK_STREAM, 0);
+    if (sockfd == -1) {
+        perror("socket");
+        return -1;
+    }
+
+    int reuse_addr = 1;
+    int res = setsockopt(sockfd, SOL_SOCKET, SO_REUSEADDR, &reuse_addr, sizeof(reuse_addr));
+    if (res == -1) {
+        perror("setsockopt");
+        close(sockfd);
+        return -1;
+    }
+
+    // Only for this host
+    struct sockaddr_in stats_addr;
+    stats_addr.sin_family = AF_INET;
+    stats_addr.sin_port = htons(port);
+    stats_addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    res = bind(sockfd, (struct sockaddr *)&stats_addr, sizeof(stats_addr));
+    if (res == -1) {
+        perror("bind");
+        close(sockfd);
+        return -1;
+    }
+
+    res = listen(sockfd, SERVER_MAX_BACKLOG);
+    if (res == -1) {
+        perror("listen");
+        close(sockfd);
+        return -1;
+    }
+
+    srv->stats_sockfd = sockfd;
+    return add_poll(srv, sockfd);
+}
+
 ////////////////////////////// HELPER FUNCTIONS ////////////////////////////////
 
 /**
@@ -146,10 +446,20 @@ int setup_server(Server srv) {
         return -1;
     }
 
+    // Processes sharing a bus share the port too (the kernel spreads the clients)
+    if (srv->bus != NULL) {
+        int reuse_port = 1;
+        res = setsockopt(srv->sockfd, SOL_SOCKET, SO_REUSEPORT, &reuse_port, sizeof(reuse_port));
+        if (res == -1) {
+            perror("setsockopt");
+            return -1;
+        }
+    }
+
     // Define server socket address
     struct sockaddr_in server_addr;
     server_addr.sin_family = AF_INET;
-    server_addr.sin_port = htons(SERVER_PORT);
+    server_addr.sin_port = htons(srv->port);
     server_addr.sin_addr.s_addr = INADDR_ANY;     
 
     // Bind server socket to server socket address
@@ -165,23 +475,77 @@ int setup_server(Server srv) {
     return 0;
 }
 
+/**
+ * Creates the socket a new process connects to, to take over from this one,
+ * and adds it to the poll set. Returns -1 on error.
+ */
+int listen_upgrade(Server srv) {
+    srv->upgrade_sockfd = socket(AF_UNIX, SOCK_SEQPACKET, 0);
+    if (srv->upgrade_sockfd == -1) {
+        perror("socket");
+        return -1;
+    }
+
+    // Replace the socket of the process taken over (or of one that crashed)
+    struct sockaddr_un upgrade_addr = {0};
+    upgrade_addr.sun_family = AF_UNIX;
+    strcpy(upgrade_addr.sun_path, SERVER_UPGRADE_PATH);
+    unlink(SERVER_UPGRADE_PATH);
+
+    int res = bind(srv->upgrade_sockfd, (struct sockaddr *)&upgrade_addr, sizeof(upgrade_addr));
+    if (res == -1) {
+        perror("bind");
+        return -1;
+    }
+
+    res = listen(srv->upgrade_sockfd, 1);
+    if (res == -1) {
+        perror("listen");
+        return -1;
+    }
+
+    return add_poll(srv, srv->upgrade_sockfd);
+}
+
 /**
  * Frees server.
  */
 void free_server(Server srv) {
+    // Stop the worker threads first, since their tasks use the server
+    // (unless they were stopped for a handoff)
+    if (srv->pool != NULL) ThreadPoolFree(srv->pool);
+
     pthread_mutex_lock(&srv->lock);
 
-    for (int i = 0; i < srv->poll_count; i++) {
-        close(srv->poll_set[i].fd);
+    // Sockets handed off are only closed here (shutting them down would
+    // disconnect them from the new process too)
+    for (int i = 0; i < srv->client_count; i++) {
+        Connection conn = srv->connections[srv->clients[i]];
+        if (!srv->handed_off) ConnectionClose(conn);
+        ConnectionRelease(conn);
+    }
+
+    close(srv->sockfd);
+    if (srv->stats_sockfd != -1) close(srv->stats_sockfd);
+    if (srv->upgrade_sockfd != -1) {
+        close(srv->upgrade_sockfd);
+        unlink(SERVER_UPGRADE_PATH);
     }
 
     free(srv->poll_set);
+    RoomsFree(srv->rooms);
+    if (srv->bus != NULL) MessageBusClose(srv->bus);
+    if (srv->log != NULL) MessageLogFree(srv->log);
+    DirectoryFree(srv->users);
+    free(srv->connections);
     free(srv->clients);
-    ThreadPoolFree(srv->pool);
+    StatsFree(srv->stats);
 
     pthread_mutex_unlock(&srv->lock);
     pthread_mutex_destroy(&srv->lock);
 
+    // Last, so everything logged until now is written
+    LoggerFree(srv->logger);
     free(srv);
 }
 
@@ -201,27 +565,39 @@ int get_client(Server srv) {
         return -1;
     }
 
-    if (SERVER_DEBUG_MODE) {
-        printf("Connecting client: %d\n", client_sockfd);
-    }
+    LoggerLog(srv->logger, LOG_DEBUG, "Connecting client: %d", client_sockfd);
 
     return client_sockfd;
 }
 
 /**
- * Adds a client to the clients array. Returns -1 on error.
+ * Adds a client to the clients array, and creates its connection.
+ * Returns -1 on error.
  */
 int add_client(Server srv, int client_sockfd) {
     pthread_mutex_lock(&srv->lock);
 
-    if (srv->client_count >= SERVER_MAX_CLIENT_COUNT) {
+    if (srv->client_count >= SERVER_MAX_CLIENT_COUNT || client_sockfd >= SERVER_MAX_FD) {
+        pthread_mutex_unlock(&srv->lock);
+        close(client_sockfd);
+        return -1;
+    }
+
+    Connection conn = ConnectionNew(client_sockfd, srv->pool, srv->stats);
+    if (conn == NULL) {
         pthread_mutex_unlock(&srv->lock);
         close(client_sockfd);
         return -1;
     }
 
+    uint64_t now = time_ms();
+    TokenBucketInit(&conn->message_rate, SERVER_RATE_MESSAGES, SERVER_RATE_MESSAGES_BURST, now);
+    TokenBucketInit(&conn->byte_rate, SERVER_RATE_BYTES, SERVER_RATE_BYTES_BURST, now);
+
+    srv->connections[client_sockfd] = conn;
     srv->clients[srv->client_count] = client_sockfd;
     srv->client_count++;
+    StatsAdd(srv->stats, STAT_CONNECTIONS, 1);
 
     pthread_mutex_unlock(&srv->lock);
 
@@ -229,7 +605,8 @@ int add_client(Server srv, int client_sockfd) {
 }
 
 /**
- * Removes a client from the clients array. Returns -1 on error.
+ * Removes a client from the clients array, and closes its connection.
+ * Returns -1 on error.
  */
 int remove_client(Server srv, int client_sockfd) {
     pthread_mutex_lock(&srv->lock);
@@ -249,12 +626,49 @@ int remove_client(Server srv, int client_sockfd) {
 
     srv->clients[idx] = srv->clients[srv->client_count - 1];
     srv->client_count--;
+    StatsAdd(srv->stats, STAT_CONNECTIONS, -1);
+
+    Connection conn = srv->connections[client_sockfd];
+    srv->connections[client_sockfd] = NULL;
+
+    // Free the username for others
+    if (conn->username[0] != '\0') {
+        DirectoryRemove(srv->users, conn->username, conn);
+    }
+
+    // Leave every room
+    for (int i = 0; i < conn->room_count; i++) {
+        RoomsLeave(srv->rooms, conn->rooms[i], conn);
+    }
+    conn->room_count = 0;
+
+    // Stop relaying to a linked server (and link with it again later)
+    if (conn->peer) {
+        RoomsRemovePeer(srv->rooms, conn);
+
+        for (int i = 0; i < srv->peer_count; i++) {
+            if (srv->peers[i].sockfd == client_sockfd) srv->peers[i].sockfd = -1;
+        }
+    }
+
+    // The socket is closed once pending flushes release the connection
+    ConnectionClose(conn);
+    ConnectionRelease(conn);
 
     pthread_mutex_unlock(&srv->lock);
 
     return 0;
 }
 
+/**
+ * Removes a client, closing its connection.
+ */
+void disconnect_client(Server srv, int client_sockfd) {
+    LoggerLog(srv->logger, LOG_DEBUG, "Disconnecting client: %d", client_sockfd);
+
+    remove_client(srv, client_sockfd);
+}
+
 /**
  * Adds a client to the poll set. Returns -1 on error.
  */
@@ -316,13 +730,28 @@ int check_poll(Server srv) {
             int poll_sockfd = srv->poll_set[i].fd;
             pthread_mutex_unlock(&srv->lock);
 
-            if (poll_sockfd == srv->sockfd) {
+            if (poll_sockfd == srv->upgrade_sockfd) {
+                // A new process is taking over (this one shuts down)
+                int res = hand_off(srv);
+                if (res == -1) {
+                    fprintf(stderr, "hand_off: error\n");
+                    return -1;
+                }
+                return 0;
+            } else if (poll_sockfd == srv->stats_sockfd) {
+                // Scraped (a failed scrape doesn't stop the server)
+                if (serve_stats(srv) == -1) {
+                    fprintf(stderr, "serve_stats: error\n");
+                }
+            } else if (poll_sockfd == srv->sockfd) {
                 // Accept a connection (get a client)
                 int client_sockfd = get_client(srv);
                 if (client_sockfd == -1) {
                     fprintf(stderr, "get_client: error\n");
                     return -1;
                 }
+                StatsAdd(srv->stats, STAT_ACCEPTS, 1);
+                PROBE1(accept, client_sockfd);
 
                 // Add client into client array and poll set
                 int res = add_client(srv, client_sockfd);
@@ -345,13 +774,11 @@ int check_poll(Server srv) {
                 }
 
                 // Create a task to receive message
-                struct receive_message_arg *arg = malloc(sizeof(struct receive_message_arg));
-                arg->srv = srv;
-                arg->client_sockfd = poll_sockfd;
-                Task task = TaskNew(receive_message, arg);
-
-                // Add task to task queue
-                ThreadPoolAddTask(srv->pool, task);
+                res = add_receive_task(srv, poll_sockfd);
+                if (res == -1) {
+                    fprintf(stderr, "add_receive_task: error\n");
+                    return -1;
+                }
             }
 
             pthread_mutex_lock(&srv->lock);
@@ -363,52 +790,639 @@ int check_poll(Server srv) {
 }
 
 /**
- * Receives a GDMP message from the client, parses it, validates it, 
- * and sends it to processing. Executed by treads in the thread pool.
+ * Links with every peer there isn't a link to (yet, or anymore).
+ */
+void dial_peers(Server srv) {
+    for (int i = 0; i < srv->peer_count; i++) {
+        pthread_mutex_lock(&srv->lock);
+        bool linked = srv->peers[i].sockfd != -1;
+        pthread_mutex_unlock(&srv->lock);
+
+        if (!linked) link_peer(srv, i);
+    }
+}
+
+/**
+ * Connects to a peer, and adds the link like a client (so it is polled),
+ * then says hello. Returns -1 on error (such as the peer being down).
+ */
+int link_peer(Server srv, int peer_idx) {
+    struct peer_address *peer = &srv->peers[peer_idx];
+
+    int sockfd = socket(AF_INET, SOCK_STREAM, 0);
+    if (sockfd == -1) {
+        perror("socket");
+        return -1;
+    }
+
+    // Define peer socket address
+    struct sockaddr_in peer_addr;
+    peer_addr.sin_family = AF_INET;
+    peer_addr.sin_port = htons(peer->port);
+    if (inet_pton(AF_INET, peer->host, &peer_addr.sin_addr) != 1) {
+        fprintf(stderr, "link_peer: invalid address %s\n", peer->host);
+        close(sockfd);
+        return -1;
+    }
+
+    // Connect (quietly, it's tried again until the peer is up)
+    int res = connect(sockfd, (struct sockaddr *)&peer_addr, sizeof(peer_addr));
+    if (res == -1) {
+        close(sockfd);
+        return -1;
+    }
+
+    res = add_client(srv, sockfd);
+    if (res == -1) {
+        fprintf(stderr, "add_client: error\n");
+        return -1;
+    }
+
+    pthread_mutex_lock(&srv->lock);
+    Connection conn = srv->connections[sockfd];
+    conn->peer = true;
+    peer->sockfd = sockfd;
+    pthread_mutex_unlock(&srv->lock);
+
+    // The peer replies with its own hello, then the rooms it has members in
+    GDMPMessage hello = GDMPNew(GDMP_PEER_MESSAGE);
+    GDMPAddHeader(hello, "Server", srv->id);
+    ConnectionSendMessage(conn, hello);
+    GDMPFree(hello);
+
+    LoggerLog(srv->logger, LOG_DEBUG, "Linking with peer %s:%d: %d", peer->host, peer->port, sockfd);
+
+    return add_poll(srv, sockfd);
+}
+
+/**
+ * Adds a task to receive messages from a client to the task queue.
+ * Returns -1 on error.
+ */
+int add_receive_task(Server srv, int client_sockfd) {
+    struct receive_message_arg *arg = malloc(sizeof(struct receive_message_arg));
+    if (arg == NULL) {
+        perror("malloc");
+        return -1;
+    }
+
+    arg->srv = srv;
+    arg->client_sockfd = client_sockfd;
+    arg->ready = StatsTime();
+
+    Task task = TaskNew(receive_message, arg);
+    if (task == NULL) {
+        free(arg);
+        return -1;
+    }
+
+    ThreadPoolAddTask(srv->pool, task);
+    return 0;
+}
+
+/**
+ * Keeps a client (already out of the poll set) from being read until the given time.
+ * Returns -1 on error.
+ */
+int delay_client(Server srv, int client_sockfd, uint64_t until) {
+    pthread_mutex_lock(&srv->lock);
+
+    if (srv->delayed_count >= SERVER_MAX_CLIENT_COUNT) {
+        pthread_mutex_unlock(&srv->lock);
+        return -1;
+    }
+
+    srv->delayed[srv->delayed_count].sockfd = client_sockfd;
+    srv->delayed[srv->delayed_count].until = until;
+    srv->delayed_count++;
+
+    pthread_mutex_unlock(&srv->lock);
+
+    return 0;
+}
+
+/**
+ * Receives from every delayed client whose delay is over.
+ * They are read straight away rather than polled, since the messages
+ * they were held back on may already be in their parsers.
+ */
+void wake_clients(Server srv, uint64_t now) {
+    int woken[SERVER_MAX_CLIENT_COUNT];
+    int woken_count = 0;
+
+    pthread_mutex_lock(&srv->lock);
+
+    for (int i = 0; i < srv->delayed_count; ) {
+        if (srv->delayed[i].until > now) {
+            i++;
+            continue;
+        }
+
+        woken[woken_count++] = srv->delayed[i].sockfd;
+        srv->delayed[i] = srv->delayed[srv->delayed_count - 1];
+        srv->delayed_count--;
+    }
+
+    pthread_mutex_unlock(&srv->lock);
+
+    for (int i = 0; i < woken_count; i++) {
+        if (add_receive_task(srv, woken[i]) == -1) {
+            fprintf(stderr, "add_receive_task: error\n");
+        }
+    }
+}
+
+/**
+ * Receives bytes from the client into its parser, then parses, validates,
+ * and sends to processing every message completed by those bytes.
+ * Executed by threads in the thread pool.
  */
 void *receive_message(void *arg) {
     struct receive_message_arg *msg_arg = (struct receive_message_arg *)arg;
     Server srv = msg_arg->srv;
     int client_sockfd = msg_arg->client_sockfd;
+    uint64_t ready = msg_arg->ready;
+    free(msg_arg);
+
+    uint64_t started = StatsTime();
+    StatsRecord(srv->stats, LATENCY_QUEUE, started - ready);
+    uint64_t received = started; // Or when the task started, for messages left in the parser
 
-    // Receive string
-    char msg_str[GDMP_MESSAGE_MAX_LEN];
-    ssize_t bytes_read = recv(client_sockfd, msg_str, GDMP_MESSAGE_MAX_LEN - 1, MSG_DONTWAIT);
+    pthread_mutex_lock(&srv->lock);
+    Connection conn = srv->connections[client_sockfd];
+    pthread_mutex_unlock(&srv->lock);
+
+    // Receive bytes (straight into the parser), unless it is full
+    // of messages held back by the rate limit
+    size_t space;
+    char *buffer = GDMPParserBuffer(conn->parser, &space);
+    if (space > 0) {
+        ssize_t bytes_read = recv(client_sockfd, buffer, space, MSG_DONTWAIT);
+        PROBE2(recv, client_sockfd, bytes_read);
+
+        if (bytes_read == 0) {
+            disconnect_client(srv, client_sockfd);
+            return NULL;
+        }
 
-    if (bytes_read < 0) {
-        if (!(errno == EWOULDBLOCK || errno == EAGAIN)) {
+        if (bytes_read < 0 && !(errno == EWOULDBLOCK || errno == EAGAIN)) {
             perror("recv");
         }
 
-        add_poll(srv, client_sockfd);
-        return NULL;
+        // Bytes are charged once read, so a large read puts the client in debt
+        if (bytes_read > 0) {
+            received = StatsTime();
+            GDMPParserCommit(conn->parser, bytes_read);
+            TokenBucketCharge(&conn->byte_rate, bytes_read, time_ms());
+            StatsAdd(srv->stats, STAT_BYTES_IN, bytes_read);
+        }
     }
 
-    if (bytes_read == 0) {
-        if (SERVER_DEBUG_MODE) {
-            printf("Disconnecting client: %d\n", client_sockfd);
+    // Parse every complete message, within the rate limit
+    int parsed = 0;
+    while (true) {
+        uint64_t now = time_ms();
+        bool limited = !within_rate(conn, now);
+
+        if (limited && srv->rate_policy == RATE_POLICY_DISCONNECT) {
+            StatsAdd(srv->stats, STAT_RATE_DISCONNECTED, 1);
+            LoggerLog(srv->logger, LOG_WARN, "receive_message: client %d over rate limit", client_sockfd);
+            disconnect_client(srv, client_sockfd);
+            return NULL;
         }
 
-        remove_client(srv, client_sockfd);
-        close(client_sockfd);
-        return NULL;
-    }
+        if (limited && srv->rate_policy == RATE_POLICY_DELAY) {
+            // Leave the rest in the parser, and the socket out of the poll set
+            uint64_t wait = TokenBucketWait(&conn->message_rate, 1, now);
+            uint64_t byte_wait = TokenBucketWait(&conn->byte_rate, 0, now);
+            if (byte_wait > wait) wait = byte_wait;
 
-    msg_str[bytes_read] = '\0';
+            StatsAdd(srv->stats, STAT_RATE_DELAYED, 1);
+            if (delay_client(srv, client_sockfd, now + wait) == -1) {
+                fprintf(stderr, "delay_client: error\n");
+                disconnect_client(srv, client_sockfd);
+            }
+            return NULL;
+        }
 
-    // Parse string
-    GDMPMessage msg = GDMPParse(msg_str);
+        GDMPMessage msg = GDMPParserNext(conn->parser);
+        if (msg == NULL) break;
+        parsed++;
+        StatsAdd(srv->stats, STAT_MESSAGES_IN, 1);
 
-    // Validate message
-    if (!GDMPValidate(msg, GDMPGetType(msg))) return NULL;;
+        uint64_t parse_done = StatsTime();
+        StatsRecord(srv->stats, LATENCY_PARSE, parse_done - received);
+        MessageType type = GDMPGetType(msg);
+        PROBE2(parse, client_sockfd, type);
 
-    // Process message
-    process_message(srv, msg, client_sockfd);
+        if (limited) {
+            StatsAdd(srv->stats, STAT_RATE_DROPPED, 1);
+            GDMPFree(msg);
+            continue;
+        }
+
+        TokenBucketTake(&conn->message_rate, 1, now);
+
+        // Validate message, and process it
+        if (GDMPValidate(msg, type)) {
+            uint64_t process_start = StatsTime();
+            process_message(srv, msg, client_sockfd);
+            uint64_t process_done = StatsTime();
+            StatsRecord(srv->stats, LATENCY_PROCESS, process_done - process_start);
+            PROBE2(process__done, client_sockfd, process_done - process_start);
+
+            conn->received++;
+            if (srv->trace_every > 0 && conn->received % srv->trace_every == 0) {
+                LoggerLog(
+                    srv->logger, LOG_INFO,
+                    "Trace %d: queue %" PRIu64 " us, parse %" PRIu64 " us, process %" PRIu64 " us",
+                    client_sockfd, started - ready, parse_done - received, process_done - process_start
+                );
+            }
+        }
+
+        GDMPFree(msg);
+    }
+
+    // A full parser without a complete message can't make progress
+    if (space == 0 && parsed == 0) {
+        LoggerLog(srv->logger, LOG_WARN, "receive_message: message too long");
+        disconnect_client(srv, client_sockfd);
+        return NULL;
+    }
 
     // Add client back into poll set
     add_poll(srv, client_sockfd);
 
-    GDMPFree(msg);
-    free(msg_arg);
     return NULL;
 }
+
+/**
+ * Reads the messages other server processes publish on the bus,
+ * until the server shuts down.
+ */
+void *read_bus(void *arg) {
+    Server srv = (Server)arg;
+    unsigned long lost = 0;
+
+    while (!atomic_load(&srv->shutdown)) {
+        MessageBusRead(srv->bus, deliver_bus_message, srv, SERVER_BUS_WAIT_MS);
+
+        // Counted here, since only this thread reads the bus
+        unsigned long now_lost = MessageBusLost(srv->bus);
+        StatsAdd(srv->stats, STAT_BUS_LOST, now_lost - lost);
+        lost = now_lost;
+    }
+
+    return NULL;
+}
+
+/**
+ * Delivers a message read from the bus to the local members of its room.
+ */
+void deliver_bus_message(const char *data, size_t len, void *arg) {
+    Server srv = (Server)arg;
+    (void)len;
+
+    GDMPMessage msg = GDMPParse((char *)data);
+    if (msg == NULL) {
+        fprintf(stderr, "GDMPParse: error\n");
+        return;
+    }
+
+    process_bus_message(srv, msg);
+    GDMPFree(msg);
+}
+
+/**
+ * Hands the listening socket and the clients over to the new process connecting
+ * to the upgrade socket, once the clients are quiet (nothing being received
+ * from or sent to them). Clients that don't go quiet in time, links to other
+ * servers (which link again), and clients in the middle of a message are
+ * closed instead. Shuts the server down after. Returns -1 on error.
+ */
+int hand_off(Server srv) {
+    int handoff_sockfd = accept(srv->upgrade_sockfd, NULL, NULL);
+    if (handoff_sockfd == -1) {
+        perror("accept");
+        return -1;
+    }
+
+    LoggerLog(srv->logger, LOG_INFO, "Handing off to a new process...");
+
+    // Stop accepting clients (the new process accepts them from now on)
+    remove_poll(srv, srv->sockfd);
+    remove_poll(srv, srv->upgrade_sockfd);
+    close(srv->upgrade_sockfd);
+    srv->upgrade_sockfd = -1;
+
+    // Free the stats port for the new process
+    if (srv->stats_sockfd != -1) {
+        remove_poll(srv, srv->stats_sockfd);
+        close(srv->stats_sockfd);
+        srv->stats_sockfd = -1;
+    }
+
+    // Stop delivering from the bus, so clients can go quiet
+    atomic_store(&srv->shutdown, true);
+    if (srv->bus != NULL) pthread_join(srv->bus_reader, NULL);
+
+    uint64_t deadline = time_ms() + SERVER_DRAIN_MS;
+    while (!clients_quiet(srv) && time_ms() < deadline) {
+        usleep(10000);
+    }
+
+    // Stop every task, and let the new process open the message log and bus
+    ThreadPoolFree(srv->pool);
+    srv->pool = NULL;
+    if (srv->bus != NULL) MessageBusClose(srv->bus);
+    srv->bus = NULL;
+    MessageLogFree(srv->log);
+    srv->log = NULL;
+
+    // The listening socket first (the new process waits for it)
+    struct handoff_record listener = {0};
+    listener.listener = true;
+    if (send_record(handoff_sockfd, &listener, NULL, NULL, srv->sockfd) == -1) {
+        fprintf(stderr, "send_record: error\n");
+        close(handoff_sockfd);
+        return 0;
+    }
+
+    int handed = 0;
+    for (int i = 0; i < srv->client_count; i++) {
+        Connection conn = srv->connections[srv->clients[i]];
+        if (send_client(handoff_sockfd, conn) == -1) {
+            ConnectionClose(conn);
+            continue;
+        }
+        handed++;
+    }
+
+    srv->handed_off = true;
+    close(handoff_sockfd);
+
+    LoggerLog(srv->logger, LOG_INFO, "Handed off %d clients", handed);
+
+    return 0;
+}
+
+/**
+ * Returns whether every client is waiting to be read (rather than being read),
+ * and has nothing left to send.
+ */
+bool clients_quiet(Server srv) {
+    pthread_mutex_lock(&srv->lock);
+
+    bool quiet = srv->poll_count + srv->delayed_count == srv->client_count;
+    for (int i = 0; quiet && i < srv->client_count; i++) {
+        quiet = ConnectionIdle(srv->connections[srv->clients[i]]);
+    }
+
+    pthread_mutex_unlock(&srv->lock);
+
+    return quiet;
+}
+
+/**
+ * Hands a client over to the new process. Returns -1 if it can't be.
+ */
+int send_client(int handoff_sockfd, Connection conn) {
+    if (conn->peer || !ConnectionIdle(conn)) return -1;
+
+    const char *pending;
+    ssize_t pending_len = GDMPParserPending(conn->parser, &pending);
+    if (pending_len == -1) return -1;
+
+    char window[GDMP_COMPRESSION_WINDOW_SIZE];
+    ssize_t window_len = GDMPParserWindow(conn->parser, window);
+    if (window_len == -1) return -1;
+
+    struct handoff_record record = {0};
+    record.compressed = conn->compressor != NULL;
+    strcpy(record.username, conn->username);
+    for (int i = 0; i < conn->room_count; i++) {
+        strcpy(record.rooms[i], conn->rooms[i]->name);
+    }
+    record.room_count = conn->room_count;
+    record.window_len = window_len;
+    record.pending_len = pending_len;
+
+    return send_record(handoff_sockfd, &record, window, pending, conn->sockfd);
+}
+
+/**
+ * Sends a record, its window and pending bytes, and a socket (a copy of the
+ * file descriptor, in the other process) in one message. Returns -1 on error.
+ */
+int send_record(int handoff_sockfd, struct handoff_record *record, const char *window, const char *pending, int fd) {
+    struct iovec iov[3] = {
+        {record, sizeof(struct handoff_record)},
+        {(void *)window, record->window_len},
+        {(void *)pending, record->pending_len},
+    };
+
+    char control[CMSG_SPACE(sizeof(int))] = {0};
+    struct msghdr msg = {0};
+    msg.msg_iov = iov;
+    msg.msg_iovlen = 3;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+
+    struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+    memcpy(CMSG_DATA(cmsg), &fd, sizeof(int));
+
+    if (sendmsg(handoff_sockfd, &msg, MSG_NOSIGNAL) == -1) {
+        perror("sendmsg");
+        return -1;
+    }
+
+    return 0;
+}
+
+/**
+ * Connects to the upgrade socket of the running server, and receives its
+ * listening socket into srv->sockfd. Returns the socket the clients follow on,
+ * or -1 on error.
+ */
+int take_over(Server srv) {
+    int handoff_sockfd = socket(AF_UNIX, SOCK_SEQPACKET, 0);
+    if (handoff_sockfd == -1) {
+        perror("socket");
+        return -1;
+    }
+
+    struct sockaddr_un upgrade_addr = {0};
+    upgrade_addr.sun_family = AF_UNIX;
+    strcpy(upgrade_addr.sun_path, SERVER_UPGRADE_PATH);
+
+    int res = connect(handoff_sockfd, (struct sockaddr *)&upgrade_addr, sizeof(upgrade_addr));
+    if (res == -1) {
+        perror("connect");
+        close(handoff_sockfd);
+        return -1;
+    }
+
+    LoggerLog(srv->logger, LOG_INFO, "Taking over...");
+
+    struct handoff_record record;
+    int fd;
+    ssize_t len = receive_record(handoff_sockfd, &record, NULL, 0, &fd);
+    if (len <= 0 || !record.listener) {
+        fprintf(stderr, "take_over: no listening socket\n");
+        if (len > 0) close(fd);
+        close(handoff_sockfd);
+        return -1;
+    }
+
+    srv->sockfd = fd;
+
+    return handoff_sockfd;
+}
+
+/**
+ * Adds the clients handed off by the old process, until it closes the socket
+ * they follow on.
+ */
+void restore_clients(Server srv, int handoff_sockfd) {
+    char *data = malloc(GDMP_COMPRESSION_WINDOW_SIZE + GDMP_PARSER_BUFFER_SIZE);
+    if (data == NULL) {
+        perror("malloc");
+        close(handoff_sockfd);
+        return;
+    }
+
+    int restored = 0;
+    struct handoff_record record;
+    int fd;
+    while (receive_record(handoff_sockfd, &record, data, GDMP_COMPRESSION_WINDOW_SIZE + GDMP_PARSER_BUFFER_SIZE, &fd) > 0) {
+        if (restore_client(srv, &record, data, fd) == 0) restored++;
+    }
+
+    free(data);
+    close(handoff_sockfd);
+
+    LoggerLog(srv->logger, LOG_INFO, "Took over %d clients", restored);
+}
+
+/**
+ * Adds a client handed off by the old process as it was: joined, in its rooms,
+ * and with the stream it sends and receives carried on. Returns -1 on error.
+ */
+int restore_client(Server srv, struct handoff_record *record, const char *data, int fd) {
+    int res = add_client(srv, fd);
+    if (res == -1) {
+        fprintf(stderr, "add_client: error\n");
+        return -1;
+    }
+
+    pthread_mutex_lock(&srv->lock);
+    Connection conn = srv->connections[fd];
+    pthread_mutex_unlock(&srv->lock);
+
+    // Carry on with the compressed streams both ways
+    if (record->compressed) res = ConnectionEnableCompression(conn);
+    if (res == 0 && record->window_len > 0) {
+        res = GDMPParserSetWindow(conn->parser, data, record->window_len);
+    }
+    if (res == 0 && record->pending_len > 0) {
+        res = GDMPParserFeed(conn->parser, data + record->window_len, record->pending_len);
+    }
+
+    if (res == 0 && record->username[0] != '\0') {
+        res = DirectoryAdd(srv->users, record->username, conn);
+        if (res == 0) strcpy(conn->username, record->username);
+    }
+
+    if (res == -1) {
+        disconnect_client(srv, fd);
+        return -1;
+    }
+
+    for (int i = 0; i < record->room_count; i++) {
+        Room room = RoomsRejoin(srv->rooms, record->rooms[i], conn);
+        if (room == NULL) continue;
+
+        conn->rooms[conn->room_count] = room;
+        conn->room_count++;
+    }
+
+    LoggerLog(srv->logger, LOG_DEBUG, "Taking over client: %d", fd);
+
+    // Messages already received are parsed straight away
+    return record->pending_len > 0 ? add_receive_task(srv, fd) : add_poll(srv, fd);
+}
+
+/**
+ * Receives a record, its window and pending bytes (into data, of the given size),
+ * and a socket into fd. Returns the length received, 0 once the old process
+ * is done, or -1 on error.
+ */
+ssize_t receive_record(int handoff_sockfd, struct handoff_record *record, char *data, size_t size, int *fd) {
+    struct iovec iov[2] = {
+        {record, sizeof(struct handoff_record)},
+        {data, size},
+    };
+
+    char control[CMSG_SPACE(sizeof(int))];
+    struct msghdr msg = {0};
+    msg.msg_iov = iov;
+    msg.msg_iovlen = data == NULL ? 1 : 2;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+
+    ssize_t len = recvmsg(handoff_sockfd, &msg, 0);
+    if (len == -1) {
+        perror("recvmsg");
+        return -1;
+    }
+    if (len == 0) return 0;
+
+    struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+    if (cmsg == NULL || cmsg->cmsg_type != SCM_RIGHTS) {
+        fprintf(stderr, "receive_record: no socket\n");
+        return -1;
+    }
+    memcpy(fd, CMSG_DATA(cmsg), sizeof(int));
+
+    // Records are sent whole (the socket keeps message boundaries)
+    if (len != (ssize_t)(sizeof(struct handoff_record) + record->window_len + record->pending_len)
+            || record->room_count > CONNECTION_MAX_ROOMS) {
+        fprintf(stderr, "receive_record: invalid record\n");
+        close(*fd);
+        return -1;
+    }
+
+    return len;
+}
+
+/**
+ * Returns whether a client may send another message: it has a message token,
+ * and isn't in debt for bytes. Links to other servers aren't limited,
+ * since they carry the messages of many clients.
+ */
+bool within_rate(Connection conn, uint64_t now) {
+    if (conn->peer) return true;
+
+    return TokenBucketTokens(&conn->message_rate, now) >= 1
+        && TokenBucketTokens(&conn->byte_rate, now) >= 0;
+}
+
+/**
+ * Retains a connection looked up in the users directory.
+ */
+void retain_connection(void *conn) {
+    ConnectionRetain((Connection)conn);
+}
+
+/**
+ * Returns the time in milliseconds (of a clock that never goes back).
+ */
+uint64_t time_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
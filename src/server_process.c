@@ -4,24 +4,39 @@
 #include <errno.h>
 #include <string.h>
 #include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
 
 #include "server_process.h"
 #include "server.h"
+#include "connection.h"
+#include "directory.h"
+#include "frame.h"
+#include "room.h"
 #include "gdmp.h"
-#include "task.h"
-#include "thread_pool.h"
+#include "gdmp_compress.h"
+#include "probes.h"
+#include "logger.h"
 
-struct send_text_message_arg {
-    GDMPMessage msg;
-    int client_sockfd;
-};
-
-void *send_text_message(void *arg);
+Connection get_connection(Server srv, int client_sockfd);
+Room get_joined_room(Connection conn, char *name);
+void send_reject(Connection conn, char *type, char *reason);
+bool peer_allowed(Server srv, int sockfd);
+void take_username(Server srv, char *username, Connection conn);
+void relay_message(Server srv, GDMPMessage msg, Connection link);
 
 ////////////////////////////////// FUNCTIONS ///////////////////////////////////
 
 void process_message(Server srv, GDMPMessage msg, int client_sockfd) {
     MessageType type = GDMPGetType(msg);
+    PROBE2(process, client_sockfd, type);
+
+    // Links to other servers send their own set of messages
+    if (get_connection(srv, client_sockfd)->peer) {
+        process_link_message(srv, msg, client_sockfd);
+        return;
+    }
+
     switch (type) {
         case GDMP_TEXT_MESSAGE:
             process_text_message(srv, msg, client_sockfd);
@@ -29,6 +44,29 @@ void process_message(Server srv, GDMPMessage msg, int client_sockfd) {
         case GDMP_JOIN_MESSAGE:
             process_join_message(srv, msg, client_sockfd);
             break; 
+        case GDMP_LEAVE_MESSAGE:
+            process_leave_message(srv, msg, client_sockfd);
+            break;
+        case GDMP_DIRECT_MESSAGE:
+            process_direct_message(srv, msg, client_sockfd);
+            break;
+        case GDMP_HELLO_MESSAGE:
+            process_hello_message(srv, msg, client_sockfd);
+            break;
+        case GDMP_TYPING_MESSAGE:
+            process_typing_message(srv, msg, client_sockfd);
+            break;
+        case GDMP_PEER_MESSAGE:
+            process_peer_message(srv, msg, client_sockfd);
+            break;
+        case GDMP_REJECT_MESSAGE:
+        case GDMP_PRESENCE_MESSAGE:
+            // Only sent by the server
+            break;
+        case GDMP_BATCH_MESSAGE:
+        case GDMP_COMPRESSED_MESSAGE:
+            // Unpacked by the parser
+            break;
         case GDMP_ERROR_MESSAGE:
             fprintf(stderr, "GDMP_ERROR_MESSAGE\n");
             break;
@@ -36,55 +74,372 @@ void process_message(Server srv, GDMPMessage msg, int client_sockfd) {
 }
 
 void process_text_message(Server srv, GDMPMessage msg, int client_sockfd) {
-    // Access headers
-    char *username = GDMPGetValue(msg, "Username");
+    // Access headers (the sender is the username it joined with,
+    // whatever it claims)
     char *content = GDMPGetValue(msg, "Content");
     char *timestamp = GDMPGetValue(msg, "Timestamp");
+    char *room_name = GDMPGetValue(msg, "Room");
+
+    // Only members of a room can send to it
+    Connection conn = get_connection(srv, client_sockfd);
+    Room room = room_name == NULL ? NULL : get_joined_room(conn, room_name);
+    if (room == NULL) {
+        LoggerLog(srv->logger, LOG_DEBUG, "Dropping message outside a joined room from client: %d", client_sockfd);
+        return;
+    }
 
     // Log message
-    printf("[%s] %s: %s\n", timestamp, username, content);
+    LoggerLog(srv->logger, LOG_INFO, "[%s] (%s) %s: %s", timestamp, room_name, conn->username, content);
 
-    // Broadcast to other clients
-    pthread_mutex_lock(&srv->lock);
-    for (int i = 0; i < srv->poll_count; i++) {
-        if (srv->clients[i] == client_sockfd) {
-            continue;
+    // Copy the known headers (the room adds its sequence number)
+    GDMPMessage text = GDMPNew(GDMP_TEXT_MESSAGE);
+    GDMPAddHeader(text, "Username", conn->username);
+    GDMPAddHeader(text, "Content", content);
+    GDMPAddHeader(text, "Timestamp", timestamp);
+    GDMPAddHeader(text, "Room", room_name);
+    GDMPAddHeader(text, "Origin", srv->id);
+
+    // Store, and send to the other members of the room (and peers with members in it)
+    int dropped = RoomSend(room, text, conn, false);
+    if (dropped == -1) {
+        fprintf(stderr, "RoomSend: error\n");
+    } else if (dropped > 0) {
+        LoggerLog(srv->logger, LOG_DEBUG, "Dropping message for %d clients in room: %s", dropped, room_name);
+    }
+
+    GDMPFree(text);
+}
+
+void process_join_message(Server srv, GDMPMessage msg, int client_sockfd) {
+    Connection conn = get_connection(srv, client_sockfd);
+
+    // Access headers
+    char *username = GDMPGetValue(msg, "Username");
+    char *room_name = GDMPGetValue(msg, "Room");
+    char *seq = GDMPGetValue(msg, "Seq"); // Only sent when resuming
+    if (strlen(username) == 0 || strlen(username) >= GDMP_USERNAME_MAX_LEN) {
+        send_reject(conn, "GDMP_JOIN_MESSAGE", "Invalid username");
+        return;
+    }
+    if (strlen(room_name) == 0 || strlen(room_name) >= GDMP_ROOM_MAX_LEN) {
+        send_reject(conn, "GDMP_JOIN_MESSAGE", "Invalid room name");
+        return;
+    }
+
+    // Register the username on the first join, unless someone else is using it
+    // (a connection keeps the username it joined with). A resuming client takes
+    // it over, from a connection the server hasn't seen drop yet.
+    if (conn->username[0] == '\0') {
+        if (seq != NULL) take_username(srv, username, conn);
+        if (DirectoryAdd(srv->users, username, conn) == -1) {
+            LoggerLog(srv->logger, LOG_DEBUG, "Username taken: %s", username);
+            send_reject(conn, "GDMP_JOIN_MESSAGE", "Username taken");
+            return;
         }
 
-        // Create a task to send text message
-        struct send_text_message_arg *arg = malloc(sizeof(struct send_text_message_arg));
-        arg->msg = GDMPCopy(msg);
-        arg->client_sockfd = srv->clients[i];
-        Task task = TaskNew(send_text_message, arg);
+        strcpy(conn->username, username);
+    }
 
-        // Add task to task queue
-        ThreadPoolAddTask(srv->pool, task);
+    // Join the room
+    if (get_joined_room(conn, room_name) != NULL) return;
+    if (conn->room_count == CONNECTION_MAX_ROOMS) {
+        LoggerLog(srv->logger, LOG_DEBUG, "Too many rooms for client: %d", client_sockfd);
+        send_reject(conn, "GDMP_JOIN_MESSAGE", "Too many rooms");
+        return;
     }
-    pthread_mutex_unlock(&srv->lock);
+
+    Room room = RoomsJoin(srv->rooms, room_name, conn, seq == NULL ? 0 : strtoull(seq, NULL, 10));
+    if (room == NULL) {
+        send_reject(conn, "GDMP_JOIN_MESSAGE", "Room unavailable");
+        return;
+    }
+
+    conn->rooms[conn->room_count] = room;
+    conn->room_count++;
+
+    // Log join
+    LoggerLog(srv->logger, LOG_INFO, "%s %s %s", conn->username, seq == NULL ? "joined" : "resumed", room_name);
 }
 
-void process_join_message(Server srv, GDMPMessage msg, int client_sockfd) {
-    // TODO
+void process_leave_message(Server srv, GDMPMessage msg, int client_sockfd) {
+    Connection conn = get_connection(srv, client_sockfd);
+
+    // Access headers
+    char *room_name = GDMPGetValue(msg, "Room");
+
+    for (int i = 0; i < conn->room_count; i++) {
+        if (strcmp(conn->rooms[i]->name, room_name) != 0) continue;
+
+        // Leave the room
+        RoomsLeave(srv->rooms, conn->rooms[i], conn);
+        conn->rooms[i] = conn->rooms[conn->room_count - 1];
+        conn->room_count--;
+
+        // Log leave
+        LoggerLog(srv->logger, LOG_INFO, "%s left %s", conn->username, room_name);
+        return;
+    }
+}
+
+void process_direct_message(Server srv, GDMPMessage msg, int client_sockfd) {
+    Connection conn = get_connection(srv, client_sockfd);
+
+    // Access headers
+    char *recipient = GDMPGetValue(msg, "Recipient");
+    char *content = GDMPGetValue(msg, "Content");
+    char *timestamp = GDMPGetValue(msg, "Timestamp");
+
+    // Only registered users can send direct messages (as themselves)
+    if (conn->username[0] == '\0') {
+        send_reject(conn, "GDMP_DIRECT_MESSAGE", "Join a room first");
+        return;
+    }
+
+    // Find the recipient's connection
+    Connection target = DirectoryGet(srv->users, recipient);
+    if (target == NULL) {
+        send_reject(conn, "GDMP_DIRECT_MESSAGE", "User is offline");
+        return;
+    }
+
+    GDMPMessage direct = GDMPNew(GDMP_DIRECT_MESSAGE);
+    GDMPAddHeader(direct, "Username", conn->username);
+    GDMPAddHeader(direct, "Recipient", recipient);
+    GDMPAddHeader(direct, "Content", content);
+    GDMPAddHeader(direct, "Timestamp", timestamp);
+
+    // Send to the recipient only
+    int res = ConnectionSendMessage(target, direct);
+    ConnectionRelease(target);
+    GDMPFree(direct);
+
+    if (res == -1) {
+        send_reject(conn, "GDMP_DIRECT_MESSAGE", "Message not delivered");
+        return;
+    }
+
+    // Log message (without its content)
+    LoggerLog(srv->logger, LOG_INFO, "[%s] %s -> %s", timestamp, conn->username, recipient);
+}
+
+void process_typing_message(Server srv, GDMPMessage msg, int client_sockfd) {
+    Connection conn = get_connection(srv, client_sockfd);
+
+    // Only members of a room can type in it
+    Room room = get_joined_room(conn, GDMPGetValue(msg, "Room"));
+    if (room == NULL) return;
+
+    RoomTyping(room, conn->username);
+}
+
+void process_hello_message(Server srv, GDMPMessage msg, int client_sockfd) {
+    Connection conn = get_connection(srv, client_sockfd);
+
+    // Enable compression if the client supports it
+    char *compression = GDMPGetValue(msg, "Compression");
+    bool compress = strcmp(compression, GDMP_COMPRESSION_NAME) == 0;
+    if (compress && ConnectionEnableCompression(conn) == -1) {
+        compress = false;
+    }
+
+    // Reply with the chosen compression
+    GDMPMessage reply = GDMPNew(GDMP_HELLO_MESSAGE);
+    GDMPAddHeader(reply, "Compression", compress ? GDMP_COMPRESSION_NAME : "none");
+    ConnectionSendMessage(conn, reply);
+    GDMPFree(reply);
+}
+
+void process_link_message(Server srv, GDMPMessage msg, int client_sockfd) {
+    Connection link = get_connection(srv, client_sockfd);
+
+    switch (GDMPGetType(msg)) {
+        case GDMP_TEXT_MESSAGE:
+            process_relayed_message(srv, msg, client_sockfd);
+            break;
+        case GDMP_JOIN_MESSAGE:
+            // The peer has members in the room
+            if (link->peer_id[0] == '\0') break;
+            RoomsPeerJoin(srv->rooms, GDMPGetValue(msg, "Room"), link);
+            break;
+        case GDMP_LEAVE_MESSAGE:
+            // The peer has no members left in the room
+            RoomsPeerLeave(srv->rooms, GDMPGetValue(msg, "Room"), link);
+            break;
+        case GDMP_PEER_MESSAGE:
+            process_peer_message(srv, msg, client_sockfd);
+            break;
+        default:
+            // Clients' own messages aren't relayed
+            break;
+    }
+}
+
+void process_relayed_message(Server srv, GDMPMessage msg, int client_sockfd) {
+    Connection link = get_connection(srv, client_sockfd);
+    if (link->peer_id[0] == '\0') return;
+
+    relay_message(srv, msg, link);
+}
+
+void process_bus_message(Server srv, GDMPMessage msg) {
+    if (!GDMPValidate(msg, GDMP_TEXT_MESSAGE)) return;
+
+    relay_message(srv, msg, NULL);
+}
+
+void process_peer_message(Server srv, GDMPMessage msg, int client_sockfd) {
+    Connection conn = get_connection(srv, client_sockfd);
+
+    // Access headers
+    char *id = GDMPGetValue(msg, "Server");
+    if (strlen(id) == 0 || strlen(id) >= GDMP_USERNAME_MAX_LEN) return;
+    if (conn->peer_id[0] != '\0' || conn->username[0] != '\0') return;
+
+    if (strcmp(id, srv->id) == 0) {
+        fprintf(stderr, "process_peer_message: linked to itself\n");
+        ConnectionClose(conn);
+        return;
+    }
+
+    // A hello from a server that dialed this one is answered with this one's
+    // (a link this server dialed is already a peer, and the hello is the answer),
+    // if it's at an address allowed to link (any client could send one)
+    bool dialed = conn->peer;
+    if (!dialed && !peer_allowed(srv, client_sockfd)) {
+        LoggerLog(srv->logger, LOG_WARN, "process_peer_message: client %d not allowed to link", client_sockfd);
+        send_reject(conn, "GDMP_PEER_MESSAGE", "Not a peer");
+        ConnectionClose(conn);
+        return;
+    }
+
+    strcpy(conn->peer_id, id);
+    conn->peer = true;
+
+    if (!dialed) {
+        GDMPMessage reply = GDMPNew(GDMP_PEER_MESSAGE);
+        GDMPAddHeader(reply, "Server", srv->id);
+        ConnectionSendMessage(conn, reply);
+        GDMPFree(reply);
+    }
+
+    // Start relaying (after telling the peer which rooms have members here)
+    if (RoomsAddPeer(srv->rooms, conn) == -1) {
+        fprintf(stderr, "process_peer_message: can't link with %s\n", id);
+        ConnectionClose(conn);
+        return;
+    }
+
+    // Log link
+    LoggerLog(srv->logger, LOG_INFO, "Linked with server %s", id);
 }
 
 ////////////////////////////// HELPER FUNCTIONS ////////////////////////////////
 
-void *send_text_message(void *arg) {
-    struct send_text_message_arg *msg_arg = (struct send_text_message_arg *)arg;
-    GDMPMessage msg = msg_arg->msg;
-    int client_sockfd = msg_arg->client_sockfd;
+/**
+ * Returns the connection of the given client.
+ */
+Connection get_connection(Server srv, int client_sockfd) {
+    pthread_mutex_lock(&srv->lock);
+    Connection conn = srv->connections[client_sockfd];
+    pthread_mutex_unlock(&srv->lock);
+
+    return conn;
+}
 
-    // Serialize message
-    char *msg_str = GDMPStringify(msg);
+/**
+ * Frees a username registered by another connection, closing that connection
+ * (the server removes it from its rooms when it sees the socket close).
+ */
+void take_username(Server srv, char *username, Connection conn) {
+    Connection old = DirectoryGet(srv->users, username);
+    if (old == NULL) return;
 
-    // Send string
-    ssize_t bytes_sent = send(client_sockfd, msg_str, strlen(msg_str), MSG_DONTWAIT);
-    if (bytes_sent == -1 && !(errno == EWOULDBLOCK || errno == EAGAIN)) {
-        perror("send");
+    if (old != conn && DirectoryRemove(srv->users, username, old)) {
+        LoggerLog(srv->logger, LOG_INFO, "%s resumed, closing its old connection: %d", username, old->sockfd);
+        ConnectionClose(old);
+    }
+
+    ConnectionRelease(old);
+}
+
+/**
+ * Returns the room with the given name if the connection joined it,
+ * or NULL otherwise.
+ */
+Room get_joined_room(Connection conn, char *name) {
+    for (int i = 0; i < conn->room_count; i++) {
+        if (strcmp(conn->rooms[i]->name, name) == 0) return conn->rooms[i];
     }
 
-    GDMPFree(msg);
-    free(msg_str);
-    free(msg_arg);
     return NULL;
 }
+
+/**
+ * Replies to a client with a reject message, for a message of the given type.
+ */
+void send_reject(Connection conn, char *type, char *reason) {
+    GDMPMessage reply = GDMPNew(GDMP_REJECT_MESSAGE);
+    GDMPAddHeader(reply, "Type", type);
+    GDMPAddHeader(reply, "Reason", reason);
+    ConnectionSendMessage(conn, reply);
+    GDMPFree(reply);
+}
+
+/**
+ * Sends a text message from another server (relayed by a link, or read from
+ * the bus if link is NULL) to the members of its room on this server only.
+ */
+void relay_message(Server srv, GDMPMessage msg, Connection link) {
+    // Access headers
+    char *room_name = GDMPGetValue(msg, "Room");
+    char *origin = GDMPGetValue(msg, "Origin");
+    if (room_name == NULL || origin == NULL) return;
+
+    // A message back at the server it came from has looped
+    if (strcmp(origin, srv->id) == 0) {
+        LoggerLog(srv->logger, LOG_DEBUG, "Dropping looped message from: %s", link == NULL ? "bus" : link->peer_id);
+        return;
+    }
+
+    // Copy the known headers (this server numbers it in its own room)
+    GDMPMessage text = GDMPNew(GDMP_TEXT_MESSAGE);
+    GDMPAddHeader(text, "Username", GDMPGetValue(msg, "Username"));
+    GDMPAddHeader(text, "Content", GDMPGetValue(msg, "Content"));
+    GDMPAddHeader(text, "Timestamp", GDMPGetValue(msg, "Timestamp"));
+    GDMPAddHeader(text, "Room", room_name);
+    GDMPAddHeader(text, "Origin", origin);
+
+    // Store, and send to the room's members here (never on to other servers)
+    int dropped = RoomsRelay(srv->rooms, text, link);
+    if (dropped == -1) {
+        fprintf(stderr, "RoomsRelay: error\n");
+    } else if (dropped > 0) {
+        LoggerLog(srv->logger, LOG_DEBUG, "Dropping relayed message for %d clients in room: %s", dropped, room_name);
+    }
+
+    GDMPFree(text);
+}
+
+/**
+ * Returns whether the client at the other end of a socket is at the address
+ * of one of the server's peers, or one allowed to link with it.
+ */
+bool peer_allowed(Server srv, int sockfd) {
+    struct sockaddr_in addr;
+    socklen_t addr_len = sizeof(addr);
+    if (getpeername(sockfd, (struct sockaddr *)&addr, &addr_len) == -1 || addr.sin_family != AF_INET) {
+        return false;
+    }
+
+    char host[INET_ADDRSTRLEN];
+    inet_ntop(AF_INET, &addr.sin_addr, host, sizeof(host));
+
+    for (int i = 0; i < srv->peer_count; i++) {
+        if (strcmp(srv->peers[i].host, host) == 0) return true;
+    }
+    for (int i = 0; i < srv->allowed_count; i++) {
+        if (strcmp(srv->allowed_peers[i], host) == 0) return true;
+    }
+
+    return false;
+}
@@ -0,0 +1,182 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdarg.h>
+#include <inttypes.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/socket.h>
+
+#include "server_stats.h"
+#include "server.h"
+#include "stats.h"
+#include "directory.h"
+#include "thread_pool.h"
+#include "logger.h"
+
+/**
+ * How a stat is named and described to Prometheus.
+ */
+struct stat_info {
+    char *name;
+    char *type;
+    char *help;
+};
+
+struct stat_info server_stat_info[STAT_COUNT] = {
+    [STAT_CONNECTIONS] = {"gdaymate_connections", "gauge", "Open connections, of clients and links to other servers"},
+    [STAT_ACCEPTS] = {"gdaymate_accepts_total", "counter", "Connections accepted"},
+    [STAT_MESSAGES_IN] = {"gdaymate_messages_received_total", "counter", "Messages received"},
+    [STAT_MESSAGES_OUT] = {"gdaymate_messages_sent_total", "counter", "Messages sent"},
+    [STAT_BYTES_IN] = {"gdaymate_received_bytes_total", "counter", "Bytes received"},
+    [STAT_BYTES_OUT] = {"gdaymate_sent_bytes_total", "counter", "Bytes sent"},
+    [STAT_SEND_DROPPED] = {"gdaymate_send_dropped_total", "counter", "Messages dropped, since a connection's send queue was full"},
+    [STAT_RATE_DROPPED] = {"gdaymate_rate_dropped_total", "counter", "Messages dropped by the rate limit"},
+    [STAT_RATE_DELAYED] = {"gdaymate_rate_delayed_total", "counter", "Times a client was delayed by the rate limit"},
+    [STAT_RATE_DISCONNECTED] = {"gdaymate_rate_disconnected_total", "counter", "Clients disconnected by the rate limit"},
+    [STAT_BUS_LOST] = {"gdaymate_bus_lost_total", "counter", "Messages on the message bus skipped by falling behind"},
+};
+
+char *server_latency_stage[LATENCY_COUNT] = {
+    [LATENCY_QUEUE] = "queue",
+    [LATENCY_PARSE] = "parse",
+    [LATENCY_PROCESS] = "process",
+    [LATENCY_FANOUT] = "fanout",
+    [LATENCY_SEND] = "send",
+};
+
+double server_latency_quantiles[] = {0.5, 0.99, 0.999};
+
+int append_stat(char *buf, size_t size, int len, struct stat_info *info, long value);
+int append_latency(Server srv, char *buf, size_t size, int len);
+int append_text(char *buf, size_t size, int len, const char *format, ...);
+
+////////////////////////////////// FUNCTIONS ///////////////////////////////////
+
+int serve_stats(Server srv) {
+    int sockfd = accept(srv->stats_sockfd, NULL, NULL);
+    if (sockfd == -1) {
+        perror("accept");
+        return -1;
+    }
+
+    // Read the request first (closing with it unread would reset the
+    // connection), without holding up the server loop for long: the whole
+    // request gets SERVER_STATS_TIMEOUT_MS, however slowly it arrives
+    char request[SERVER_STATS_MAX_LEN];
+    size_t request_len = 0;
+    struct pollfd pfd = {sockfd, POLLIN, 0};
+    uint64_t deadline = StatsTime() + SERVER_STATS_TIMEOUT_MS * 1000;
+    while (request_len < sizeof(request) - 1) {
+        uint64_t now = StatsTime();
+        if (now >= deadline || poll(&pfd, 1, (deadline - now + 999) / 1000) <= 0) break;
+
+        ssize_t bytes_read = recv(sockfd, request + request_len, sizeof(request) - 1 - request_len, 0);
+        if (bytes_read <= 0) break;
+
+        request_len += bytes_read;
+        request[request_len] = '\0';
+        if (strstr(request, "\r\n\r\n") != NULL) break;
+    }
+
+    char body[SERVER_STATS_MAX_LEN];
+    int body_len = write_stats(srv, body, sizeof(body));
+
+    char header[128];
+    int header_len = snprintf(
+        header, sizeof(header),
+        "HTTP/1.0 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\nContent-Length: %d\r\n\r\n",
+        body_len
+    );
+
+    // Short enough for the socket to take at once
+    int res = 0;
+    if (send(sockfd, header, header_len, MSG_NOSIGNAL) == -1 || send(sockfd, body, body_len, MSG_NOSIGNAL) == -1) {
+        perror("send");
+        res = -1;
+    }
+
+    close(sockfd);
+    return res;
+}
+
+int write_stats(Server srv, char *buf, size_t size) {
+    int len = 0;
+
+    for (int i = 0; i < STAT_COUNT; i++) {
+        len = append_stat(buf, size, len, &server_stat_info[i], StatsRead(srv->stats, i));
+    }
+
+    // Read when asked for, rather than counted
+    struct stat_info users = {"gdaymate_users", "gauge", "Usernames registered by joined clients"};
+    len = append_stat(buf, size, len, &users, DirectoryCount(srv->users));
+
+    struct stat_info queue_depth = {"gdaymate_task_queue_depth", "gauge", "Tasks waiting for a worker thread"};
+    len = append_stat(buf, size, len, &queue_depth, ThreadPoolPending(srv->pool));
+
+    struct stat_info log_dropped = {"gdaymate_log_dropped_total", "counter", "Log lines dropped, since a thread's log ring was full"};
+    len = append_stat(buf, size, len, &log_dropped, LoggerDropped(srv->logger));
+
+    return append_latency(srv, buf, size, len);
+}
+
+////////////////////////////// HELPER FUNCTIONS ////////////////////////////////
+
+/**
+ * Appends the latency of each stage, as a summary (its quantiles, and how many
+ * messages were timed), to the len bytes written into buf (of the given size).
+ * Returns the new length.
+ */
+int append_latency(Server srv, char *buf, size_t size, int len) {
+    len = append_text(
+        buf, size, len,
+        "# HELP gdaymate_latency_microseconds Latency of each stage of a message's way through the server\n"
+        "# TYPE gdaymate_latency_microseconds summary\n"
+    );
+
+    int quantile_count = sizeof(server_latency_quantiles) / sizeof(server_latency_quantiles[0]);
+    for (int i = 0; i < LATENCY_COUNT; i++) {
+        for (int j = 0; j < quantile_count; j++) {
+            double quantile = server_latency_quantiles[j];
+            len = append_text(
+                buf, size, len, "gdaymate_latency_microseconds{stage=\"%s\",quantile=\"%g\"} %" PRIu64 "\n",
+                server_latency_stage[i], quantile, StatsPercentile(srv->stats, i, quantile * 100)
+            );
+        }
+
+        len = append_text(
+            buf, size, len, "gdaymate_latency_microseconds_count{stage=\"%s\"} %" PRIu64 "\n",
+            server_latency_stage[i], StatsRecorded(srv->stats, i)
+        );
+    }
+
+    return len;
+}
+
+/**
+ * Appends a formatted line to the len bytes written into buf (of the given size).
+ * Returns the new length (a line that doesn't fit is left out).
+ */
+int append_text(char *buf, size_t size, int len, const char *format, ...) {
+    va_list args;
+    va_start(args, format);
+    int res = vsnprintf(buf + len, size - len, format, args);
+    va_end(args);
+
+    if (res < 0 || (size_t)res >= size - len) {
+        buf[len] = '\0';
+        return len;
+    }
+
+    return len + res;
+}
+
+/**
+ * Appends a stat to the len bytes written into buf (of the given size).
+ * Returns the new length (stats that don't fit are left out).
+ */
+int append_stat(char *buf, size_t size, int len, struct stat_info *info, long value) {
+    return append_text(
+        buf, size, len, "# HELP %s %s\n# TYPE %s %s\n%s %ld\n",
+        info->name, info->help, info->name, info->type, info->name, value
+    );
+}
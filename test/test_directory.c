@@ -0,0 +1,123 @@
+// Directory Tests
+
+#include <stdio.h>
+#include <assert.h>
+#include <string.h>
+#include <pthread.h>
+#include <stdatomic.h>
+
+#include "directory.h"
+
+#define THREAD_COUNT 4
+#define NAMES_PER_THREAD 500
+
+void test_DirectoryAdd(void);
+void test_DirectoryRemove(void);
+void test_DirectoryConcurrent(void);
+void count_retain(void *value);
+void *add_names(void *arg);
+
+atomic_int retain_count;
+
+int main(void) {
+    test_DirectoryAdd();
+    test_DirectoryRemove();
+    test_DirectoryConcurrent();
+
+    printf("All Directory tests passed\n");
+    return 0;
+}
+
+void test_DirectoryAdd(void) {
+    Directory dir = DirectoryNew(count_retain);
+    assert(dir != NULL);
+
+    int will = 1;
+    int jack = 2;
+
+    // The name is copied
+    char name[16] = "Will";
+    assert(DirectoryAdd(dir, name, &will) == 0);
+    strcpy(name, "Jack");
+    assert(DirectoryAdd(dir, name, &jack) == 0);
+
+    // Names can't be taken twice
+    assert(DirectoryAdd(dir, "Will", &jack) == -1);
+    assert(DirectoryCount(dir) == 2);
+
+    // Lookups retain the value
+    atomic_store(&retain_count, 0);
+    assert(DirectoryGet(dir, "Will") == &will);
+    assert(DirectoryGet(dir, "Jack") == &jack);
+    assert(DirectoryGet(dir, "Charlotte") == NULL);
+    assert(atomic_load(&retain_count) == 2);
+
+    DirectoryFree(dir);
+}
+
+void test_DirectoryRemove(void) {
+    Directory dir = DirectoryNew(NULL);
+
+    int old_conn = 1;
+    int new_conn = 2;
+
+    assert(DirectoryAdd(dir, "Will", &old_conn) == 0);
+    assert(DirectoryRemove(dir, "Will", &old_conn));
+    assert(DirectoryGet(dir, "Will") == NULL);
+    assert(!DirectoryRemove(dir, "Will", &old_conn));
+
+    // Only the value the name maps to can remove it
+    assert(DirectoryAdd(dir, "Will", &new_conn) == 0);
+    assert(!DirectoryRemove(dir, "Will", &old_conn));
+    assert(DirectoryGet(dir, "Will") == &new_conn);
+
+    DirectoryFree(dir);
+}
+
+void test_DirectoryConcurrent(void) {
+    Directory dir = DirectoryNew(NULL);
+
+    pthread_t threads[THREAD_COUNT];
+    int ids[THREAD_COUNT];
+    void *args[THREAD_COUNT][2];
+
+    for (int i = 0; i < THREAD_COUNT; i++) {
+        ids[i] = i;
+        args[i][0] = dir;
+        args[i][1] = &ids[i];
+        pthread_create(&threads[i], NULL, add_names, args[i]);
+    }
+
+    for (int i = 0; i < THREAD_COUNT; i++) {
+        pthread_join(threads[i], NULL);
+    }
+
+    // Every thread removed the odd names it added
+    assert(DirectoryCount(dir) == THREAD_COUNT * NAMES_PER_THREAD / 2);
+
+    DirectoryFree(dir);
+}
+
+void count_retain(void *value) {
+    atomic_fetch_add(&retain_count, 1);
+}
+
+/**
+ * Adds names unique to the thread, looks each one up, and removes half.
+ */
+void *add_names(void *arg) {
+    void **args = arg;
+    Directory dir = args[0];
+    int *id = args[1];
+
+    for (int i = 0; i < NAMES_PER_THREAD; i++) {
+        char name[32];
+        snprintf(name, sizeof(name), "user%d-%d", *id, i);
+        assert(DirectoryAdd(dir, name, id) == 0);
+        assert(DirectoryGet(dir, name) == id);
+
+        if (i % 2 == 1) assert(DirectoryRemove(dir, name, id));
+    }
+
+    return NULL;
+}
@@ -10,13 +10,31 @@
 #include <hash_table.h>
 
 void test_GDMPNew(void);
+void test_GDMPAddHeader(void);
+void test_GDMPCopy(void);
+void test_GDMPManyHeaders(void);
 void test_GDMPStringify(void);
 void test_GDMPParse(void);
+void test_GDMPParseSeparatorInValue(void);
+void test_GDMPParseDirect(void);
+void test_GDMPParserPartial(void);
+void test_GDMPParserCoalesced(void);
+void test_GDMPParserOverflow(void);
+void test_GDMPParserBatch(void);
 
 int main(void) {
     test_GDMPNew();
+    test_GDMPAddHeader();
+    test_GDMPCopy();
+    test_GDMPManyHeaders();
     test_GDMPStringify();
     test_GDMPParse();
+    test_GDMPParseSeparatorInValue();
+    test_GDMPParseDirect();
+    test_GDMPParserPartial();
+    test_GDMPParserCoalesced();
+    test_GDMPParserOverflow();
+    test_GDMPParserBatch();
 
     printf("All GDMP tests passed\n");
     return 0;
@@ -28,11 +46,95 @@ void test_GDMPNew(void) {
     GDMPFree(msg);
 }
 
+void test_GDMPAddHeader(void) {
+    GDMPMessage msg = GDMPNew(GDMP_TEXT_MESSAGE);
+
+    // The message keeps its own copy of the value
+    char username[GDMP_USERNAME_MAX_LEN] = "Will";
+    assert(GDMPAddHeader(msg, "Username", username) == 0);
+    strcpy(username, "Jack");
+    assert(strcmp(GDMPGetValue(msg, "Username"), "Will") == 0);
+
+    // Replaces the value if header already exists
+    assert(GDMPAddHeader(msg, "Username", username) == 0);
+    assert(strcmp(GDMPGetValue(msg, "Username"), "Jack") == 0);
+    assert(GDMPGetValue(msg, "Content") == NULL);
+
+    // Fails once the message is full
+    char long_value[GDMP_MESSAGE_MAX_LEN + 1];
+    memset(long_value, 'a', GDMP_MESSAGE_MAX_LEN);
+    long_value[GDMP_MESSAGE_MAX_LEN] = '\0';
+    assert(GDMPAddHeader(msg, "Content", long_value) == -1);
+
+    GDMPFree(msg);
+}
+
+void test_GDMPCopy(void) {
+    char *str = "GDMP_TEXT_MESSAGE\n"
+                "Username: Will\n"
+                "Content: G'day mate!\n"
+                "Timestamp: 14:18\n";
+
+    GDMPMessage msg = GDMPParse(str);
+    GDMPMessage copy = GDMPCopy(msg);
+    GDMPFree(msg);
+
+    // The copy outlives the original
+    assert(GDMPGetType(copy) == GDMP_TEXT_MESSAGE);
+    assert(strcmp(GDMPGetValue(copy, "Content"), "G'day mate!") == 0);
+    assert(GDMPValidate(copy, GDMP_TEXT_MESSAGE));
+
+    GDMPFree(copy);
+}
+
+void test_GDMPManyHeaders(void) {
+    char *str = "GDMP_TEXT_MESSAGE\n"
+                "Username: Will\n"
+                "Content: G'day mate!\n"
+                "Timestamp: 14:18\n"
+                "Room: general\n"
+                "Client: gdaymate-cli\n"
+                "Version: 1\n"
+                "Locale: en-AU\n"
+                "Reply-To: Jack\n"
+                "Priority: normal\n"
+                "Trace: 0f3a9c\n";
+
+    // Enough headers to be looked up through an index
+    GDMPMessage msg = GDMPParse(str);
+    assert(strcmp(GDMPGetValue(msg, "Username"), "Will") == 0);
+    assert(strcmp(GDMPGetValue(msg, "Trace"), "0f3a9c") == 0);
+    assert(GDMPGetValue(msg, "Missing") == NULL);
+
+    GDMPMessage copy = GDMPCopy(msg);
+    GDMPFree(msg);
+    assert(strcmp(GDMPGetValue(copy, "Reply-To"), "Jack") == 0);
+    assert(GDMPValidate(copy, GDMP_TEXT_MESSAGE));
+
+    GDMPFree(copy);
+
+    // Headers past the limit can't be added, existing ones can be replaced
+    GDMPMessage built = GDMPNew(GDMP_TEXT_MESSAGE);
+    char names[GDMP_HEADERS_MAX_COUNT][16];
+    for (int i = 0; i < GDMP_HEADERS_MAX_COUNT; i++) {
+        snprintf(names[i], sizeof(names[i]), "Header%d", i);
+        assert(GDMPAddHeader(built, names[i], "value") == 0);
+    }
+
+    assert(GDMPAddHeader(built, "Extra", "value") == -1);
+    assert(GDMPAddHeader(built, "Header0", "replaced") == 0);
+    assert(strcmp(GDMPGetValue(built, "Header0"), "replaced") == 0);
+    assert(strcmp(GDMPGetValue(built, "Header9"), "value") == 0);
+
+    GDMPFree(built);
+}
+
 void test_GDMPStringify(void) {
     GDMPMessage msg = GDMPNew(GDMP_TEXT_MESSAGE);
     
     GDMPAddHeader(msg, "Username", "Will");
     GDMPAddHeader(msg, "Content", "Gday mate!");
+    GDMPAddHeader(msg, "Room", "general");
 
     char *str = GDMPStringify(msg);
     assert(str != NULL);
@@ -40,6 +142,10 @@ void test_GDMPStringify(void) {
     assert(strstr(str, "Username: Will\n") != NULL);
     assert(strstr(str, "Content: Gday mate!\n") != NULL);
 
+    // Headers other than the expected ones are kept, in order
+    assert(strstr(str, "Gday mate!\nRoom: general\n") != NULL);
+    assert(strcmp(str + strlen(str) - 2, "\n\n") == 0);
+
     GDMPFree(msg);
     free(str);
 }
@@ -59,3 +165,168 @@ void test_GDMPParse(void) {
 
     GDMPFree(msg);
 }
+
+void test_GDMPParseSeparatorInValue(void) {
+    char *str = "GDMP_TEXT_MESSAGE\n"
+                "Username: Will\n"
+                "Content: Note: it works\n"
+                "Timestamp: 14:18";
+
+    GDMPMessage msg = GDMPParse(str);
+    assert(msg != NULL);
+
+    assert(strcmp(GDMPGetValue(msg, "Content"), "Note: it works") == 0);
+    assert(strcmp(GDMPGetValue(msg, "Timestamp"), "14:18") == 0);
+    assert(GDMPValidate(msg, GDMP_TEXT_MESSAGE));
+
+    GDMPFree(msg);
+}
+
+void test_GDMPParseDirect(void) {
+    char *str = "GDMP_DIRECT_MESSAGE\n"
+                "Username: Will\n"
+                "Recipient: Jack\n"
+                "Content: G'day mate!\n"
+                "Timestamp: 14:18";
+
+    GDMPMessage msg = GDMPParse(str);
+    assert(msg != NULL);
+
+    assert(GDMPGetType(msg) == GDMP_DIRECT_MESSAGE);
+    assert(strcmp(GDMPGetValue(msg, "Recipient"), "Jack") == 0);
+    assert(GDMPValidate(msg, GDMP_DIRECT_MESSAGE));
+
+    // Round trip
+    char *msg_str = GDMPStringify(msg);
+    assert(strncmp(msg_str, "GDMP_DIRECT_MESSAGE\n", 20) == 0);
+    free(msg_str);
+    GDMPFree(msg);
+
+    // Missing the recipient
+    msg = GDMPParse("GDMP_DIRECT_MESSAGE\nUsername: Will\nContent: Hi\nTimestamp: 14:18");
+    assert(!GDMPValidate(msg, GDMP_DIRECT_MESSAGE));
+    GDMPFree(msg);
+}
+
+void test_GDMPParserPartial(void) {
+    char *str = "GDMP_TEXT_MESSAGE\n"
+                "Username: Will\n"
+                "Content: G'day mate!\n"
+                "Timestamp: 14:18\n"
+                "\n";
+
+    GDMPParser parser = GDMPParserNew();
+    assert(parser != NULL);
+
+    // Feed one byte at a time, the message only completes on the last one
+    size_t len = strlen(str);
+    for (size_t i = 0; i < len - 1; i++) {
+        assert(GDMPParserFeed(parser, str + i, 1) == 0);
+        assert(GDMPParserNext(parser) == NULL);
+    }
+
+    assert(GDMPParserFeed(parser, str + len - 1, 1) == 0);
+    GDMPMessage msg = GDMPParserNext(parser);
+    assert(msg != NULL);
+    assert(GDMPValidate(msg, GDMP_TEXT_MESSAGE));
+    assert(strcmp(GDMPGetValue(msg, "Content"), "G'day mate!") == 0);
+    assert(GDMPParserNext(parser) == NULL);
+
+    GDMPFree(msg);
+    GDMPParserFree(parser);
+}
+
+void test_GDMPParserCoalesced(void) {
+    char *str = "GDMP_TEXT_MESSAGE\n"
+                "Username: Will\n"
+                "\n"
+                "GDMP_TEXT_MESSAGE\n"
+                "Username: Jack\n"
+                "\n"
+                "GDMP_TEXT_MESSAGE\n"
+                "Userna";
+
+    GDMPParser parser = GDMPParserNew();
+    assert(GDMPParserFeed(parser, str, strlen(str)) == 0);
+
+    GDMPMessage msg = GDMPParserNext(parser);
+    assert(strcmp(GDMPGetValue(msg, "Username"), "Will") == 0);
+    GDMPFree(msg);
+
+    msg = GDMPParserNext(parser);
+    assert(strcmp(GDMPGetValue(msg, "Username"), "Jack") == 0);
+    GDMPFree(msg);
+
+    assert(GDMPParserNext(parser) == NULL);
+
+    // Complete the partial message
+    char *rest = "me: Mary\n\n";
+    assert(GDMPParserFeed(parser, rest, strlen(rest)) == 0);
+
+    msg = GDMPParserNext(parser);
+    assert(strcmp(GDMPGetValue(msg, "Username"), "Mary") == 0);
+    GDMPFree(msg);
+
+    GDMPParserFree(parser);
+}
+
+void test_GDMPParserOverflow(void) {
+    GDMPParser parser = GDMPParserNew();
+
+    char chunk[GDMP_MESSAGE_MAX_LEN];
+    memset(chunk, 'a', sizeof(chunk));
+
+    // A message without an end never fits
+    int res = 0;
+    for (int i = 0; i <= GDMP_PARSER_BUFFER_SIZE / GDMP_MESSAGE_MAX_LEN && res == 0; i++) {
+        res = GDMPParserFeed(parser, chunk, sizeof(chunk));
+        assert(GDMPParserNext(parser) == NULL);
+    }
+    assert(res == -1);
+
+    size_t space;
+    GDMPParserBuffer(parser, &space);
+    assert(space == 0);
+
+    GDMPParserFree(parser);
+}
+
+void test_GDMPParserBatch(void) {
+    char *body = "Username: Will\n"
+                 "Content: one\n"
+                 "\n"
+                 "Username: Jack\n"
+                 "Content: two\n"
+                 "\n";
+
+    char header[128];
+    int header_len = GDMPBatchHeader(header, sizeof(header), GDMP_TEXT_MESSAGE, 2, strlen(body));
+    assert(header_len > 0);
+
+    // Batch followed by a regular message, split in the middle of the body
+    char *next = "GDMP_TEXT_MESSAGE\nUsername: Mary\n\n";
+    GDMPParser parser = GDMPParserNew();
+    assert(GDMPParserFeed(parser, header, header_len) == 0);
+    assert(GDMPParserFeed(parser, body, 20) == 0);
+    assert(GDMPParserNext(parser) == NULL);
+    assert(GDMPParserFeed(parser, body + 20, strlen(body) - 20) == 0);
+    assert(GDMPParserFeed(parser, next, strlen(next)) == 0);
+
+    GDMPMessage msg = GDMPParserNext(parser);
+    assert(GDMPGetType(msg) == GDMP_TEXT_MESSAGE);
+    assert(strcmp(GDMPGetValue(msg, "Username"), "Will") == 0);
+    assert(strcmp(GDMPGetValue(msg, "Content"), "one") == 0);
+    GDMPFree(msg);
+
+    msg = GDMPParserNext(parser);
+    assert(GDMPGetType(msg) == GDMP_TEXT_MESSAGE);
+    assert(strcmp(GDMPGetValue(msg, "Username"), "Jack") == 0);
+    GDMPFree(msg);
+
+    msg = GDMPParserNext(parser);
+    assert(strcmp(GDMPGetValue(msg, "Username"), "Mary") == 0);
+    GDMPFree(msg);
+
+    assert(GDMPParserNext(parser) == NULL);
+    GDMPParserFree(parser);
+}
@@ -0,0 +1,263 @@
+// GDMP Compression Tests
+
+#include <stdio.h>
+#include <assert.h>
+#include <string.h>
+#include <stdlib.h>
+#include <sys/uio.h>
+
+#include "gdmp.h"
+#include "gdmp_compress.h"
+
+void test_GDMPCompressorNew(void);
+void test_GDMPCompressParse(void);
+void test_GDMPCompressWindow(void);
+void test_GDMPCompressHandOff(void);
+void test_GDMPCompressCompact(void);
+
+int main(void) {
+    test_GDMPCompressorNew();
+    test_GDMPCompressParse();
+    test_GDMPCompressWindow();
+    test_GDMPCompressHandOff();
+    test_GDMPCompressCompact();
+
+    printf("All GDMP compression tests passed\n");
+    return 0;
+}
+
+void test_GDMPCompressorNew(void) {
+    GDMPCompressor comp = GDMPCompressorNew();
+    assert(comp != NULL);
+    GDMPCompressorFree(comp);
+
+    GDMPDecompressor decomp = GDMPDecompressorNew();
+    assert(decomp != NULL);
+    GDMPDecompressorFree(decomp);
+}
+
+void test_GDMPCompressParse(void) {
+    char *first = "GDMP_TEXT_MESSAGE\n"
+                  "Username: Will\n"
+                  "Content: G'day mate!\n"
+                  "Timestamp: 14:18\n"
+                  "\n";
+    char *second = "GDMP_TEXT_MESSAGE\n"
+                   "Username: Jack\n"
+                   "Content: How ya going?\n"
+                   "Timestamp: 14:19\n"
+                   "\n";
+
+    // Two messages compressed together, split across two reads
+    struct iovec iov[2] = {{first, strlen(first)}, {second, strlen(second)}};
+    GDMPCompressor comp = GDMPCompressorNew();
+    size_t len;
+    char *compressed = GDMPCompress(comp, iov, 2, &len);
+    assert(compressed != NULL);
+    assert(strncmp(compressed, "GDMP_COMPRESSED_MESSAGE\n", 24) == 0);
+
+    GDMPParser parser = GDMPParserNew();
+    assert(GDMPParserFeed(parser, compressed, len / 2) == 0);
+    assert(GDMPParserNext(parser) == NULL);
+    assert(GDMPParserFeed(parser, compressed + len / 2, len - len / 2) == 0);
+
+    GDMPMessage msg = GDMPParserNext(parser);
+    assert(msg != NULL);
+    assert(GDMPValidate(msg, GDMP_TEXT_MESSAGE));
+    assert(strcmp(GDMPGetValue(msg, "Username"), "Will") == 0);
+    GDMPFree(msg);
+
+    msg = GDMPParserNext(parser);
+    assert(msg != NULL);
+    assert(strcmp(GDMPGetValue(msg, "Content"), "How ya going?") == 0);
+    GDMPFree(msg);
+
+    assert(GDMPParserNext(parser) == NULL);
+
+    free(compressed);
+    GDMPParserFree(parser);
+    GDMPCompressorFree(comp);
+}
+
+void test_GDMPCompressWindow(void) {
+    char *str = "GDMP_TEXT_MESSAGE\n"
+                "Username: Will\n"
+                "Content: G'day mate!\n"
+                "Timestamp: 14:18\n"
+                "\n";
+    struct iovec iov = {str, strlen(str)};
+
+    GDMPCompressor comp = GDMPCompressorNew();
+    GDMPParser parser = GDMPParserNew();
+
+    // Repeated messages shrink, since the window is kept between them
+    size_t first_len;
+    char *first = GDMPCompress(comp, &iov, 1, &first_len);
+    size_t second_len;
+    char *second = GDMPCompress(comp, &iov, 1, &second_len);
+    assert(second_len < first_len);
+
+    // A raw message can be sent between compressed ones
+    assert(GDMPParserFeed(parser, first, first_len) == 0);
+    assert(GDMPParserFeed(parser, str, strlen(str)) == 0);
+    assert(GDMPParserFeed(parser, second, second_len) == 0);
+
+    for (int i = 0; i < 3; i++) {
+        GDMPMessage msg = GDMPParserNext(parser);
+        assert(msg != NULL);
+        assert(strcmp(GDMPGetValue(msg, "Content"), "G'day mate!") == 0);
+        GDMPFree(msg);
+    }
+    assert(GDMPParserNext(parser) == NULL);
+
+    free(first);
+    free(second);
+    GDMPParserFree(parser);
+    GDMPCompressorFree(comp);
+}
+
+void test_GDMPCompressHandOff(void) {
+    char *str = "GDMP_TEXT_MESSAGE\n"
+                "Username: Will\n"
+                "Content: G'day mate!\n"
+                "Timestamp: 14:18\n"
+                "\n";
+    struct iovec iov = {str, strlen(str)};
+
+    GDMPCompressor comp = GDMPCompressorNew();
+    size_t first_len;
+    char *first = GDMPCompress(comp, &iov, 1, &first_len);
+    size_t second_len;
+    char *second = GDMPCompress(comp, &iov, 1, &second_len);
+
+    // The first parser reads a compressed message, and the start of a raw one
+    GDMPParser parser = GDMPParserNew();
+    assert(GDMPParserFeed(parser, first, first_len) == 0);
+    assert(GDMPParserFeed(parser, str, 10) == 0);
+    GDMPMessage msg = GDMPParserNext(parser);
+    assert(msg != NULL);
+    GDMPFree(msg);
+    assert(GDMPParserNext(parser) == NULL);
+
+    const char *pending;
+    assert(GDMPParserPending(parser, &pending) == 10);
+    char window[GDMP_COMPRESSION_WINDOW_SIZE];
+    ssize_t window_len = GDMPParserWindow(parser, window);
+    assert(window_len == (ssize_t)strlen(str));
+
+    // A second parser carries on from there (the second message refers back to the first)
+    GDMPParser next = GDMPParserNew();
+    assert(GDMPParserSetWindow(next, window, window_len) == 0);
+    assert(GDMPParserFeed(next, pending, 10) == 0);
+    assert(GDMPParserFeed(next, str + 10, strlen(str) - 10) == 0);
+    assert(GDMPParserFeed(next, second, second_len) == 0);
+
+    // So does a new compressor, on the other side
+    GDMPCompressor next_comp = GDMPCompressorNew();
+    size_t third_len;
+    char *third = GDMPCompress(next_comp, &iov, 1, &third_len);
+    assert(GDMPParserFeed(next, third, third_len) == 0);
+
+    for (int i = 0; i < 3; i++) {
+        msg = GDMPParserNext(next);
+        assert(msg != NULL);
+        assert(strcmp(GDMPGetValue(msg, "Content"), "G'day mate!") == 0);
+        GDMPFree(msg);
+    }
+    assert(GDMPParserNext(next) == NULL);
+
+    // A parser in the middle of a message can't hand it off
+    assert(GDMPParserFeed(next, second, second_len - 2) == 0);
+    assert(GDMPParserNext(next) == NULL);
+    assert(GDMPParserPending(next, &pending) == -1);
+
+    free(first);
+    free(second);
+    free(third);
+    GDMPParserFree(parser);
+    GDMPParserFree(next);
+    GDMPCompressorFree(comp);
+    GDMPCompressorFree(next_comp);
+}
+
+void test_GDMPCompressCompact(void) {
+    char *str = "GDMP_TEXT_MESSAGE\n"
+                "Username: Will\n"
+                "Content: G'day mate!\n"
+                "Timestamp: 14:18\n"
+                "\n";
+
+    // More messages than fit in the buffer once decompressed, so they're
+    // decompressed a buffer at a time
+    int count = 1000;
+    char *messages = malloc(count * 64);
+    size_t messages_len = 0;
+    for (int i = 0; i < count; i++) {
+        messages_len += sprintf(messages + messages_len, "GDMP_TEXT_MESSAGE\nContent: message %d\n\n", i);
+    }
+    assert(messages_len > GDMP_PARSER_BUFFER_SIZE);
+
+    struct iovec iov = {messages, messages_len};
+    GDMPCompressor comp = GDMPCompressorNew();
+    size_t compressed_len;
+    char *compressed = GDMPCompress(comp, &iov, 1, &compressed_len);
+
+    // A raw message, the compressed one, then raw messages filling the buffer
+    // (the last one only partly received)
+    GDMPParser parser = GDMPParserNew();
+    assert(GDMPParserFeed(parser, str, strlen(str)) == 0);
+    assert(GDMPParserFeed(parser, compressed, compressed_len) == 0);
+
+    size_t space;
+    int fillers = 0;
+    while (GDMPParserBuffer(parser, &space), space > strlen(str)) {
+        assert(GDMPParserFeed(parser, str, strlen(str)) == 0);
+        fillers++;
+    }
+    assert(space > 0 && space < strlen(str));
+    assert(GDMPParserFeed(parser, str, space) == 0);
+
+    GDMPMessage msg = GDMPParserNext(parser);
+    assert(msg != NULL);
+    GDMPFree(msg);
+
+    msg = GDMPParserNext(parser);
+    assert(msg != NULL);
+    assert(strcmp(GDMPGetValue(msg, "Content"), "message 0") == 0);
+    GDMPFree(msg);
+
+    // Asking for space in the middle of decompressing (like a reader held
+    // back by the rate limit) moves the compressed bytes left to the front
+    GDMPParserBuffer(parser, &space);
+    assert(space > 0);
+
+    char content[32];
+    for (int i = 1; i < count; i++) {
+        msg = GDMPParserNext(parser);
+        assert(msg != NULL);
+        snprintf(content, sizeof(content), "message %d", i);
+        assert(strcmp(GDMPGetValue(msg, "Content"), content) == 0);
+        GDMPFree(msg);
+    }
+
+    for (int i = 0; i < fillers; i++) {
+        msg = GDMPParserNext(parser);
+        assert(msg != NULL);
+        assert(strcmp(GDMPGetValue(msg, "Content"), "G'day mate!") == 0);
+        GDMPFree(msg);
+    }
+    assert(GDMPParserNext(parser) == NULL);
+
+    // The partly received message is still whole once the rest arrives
+    size_t received = GDMP_PARSER_BUFFER_SIZE - (strlen(str) + compressed_len + fillers * strlen(str));
+    assert(GDMPParserFeed(parser, str + received, strlen(str) - received) == 0);
+    msg = GDMPParserNext(parser);
+    assert(msg != NULL);
+    assert(strcmp(GDMPGetValue(msg, "Username"), "Will") == 0);
+    GDMPFree(msg);
+
+    free(messages);
+    free(compressed);
+    GDMPParserFree(parser);
+    GDMPCompressorFree(comp);
+}
@@ -0,0 +1,79 @@
+// GDMP Scanner Tests
+
+#include <stdio.h>
+#include <assert.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include "gdmp_scan.h"
+
+void test_GDMPScan(void);
+void test_GDMPScanMaxDelims(void);
+void test_GDMPScanMatchesScalar(void);
+
+int main(void) {
+    test_GDMPScan();
+    test_GDMPScanMaxDelims();
+    test_GDMPScanMatchesScalar();
+
+    printf("All GDMP scanner tests passed (%s)\n", GDMPScanName());
+    return 0;
+}
+
+void test_GDMPScan(void) {
+    char *str = "GDMP_TEXT_MESSAGE\n"
+                "Username: Will\n"
+                "Content: a: b:c\n";
+
+    GDMPDelim delims[16];
+    size_t count = GDMPScan(str, strlen(str), delims, 16);
+    assert(count == 6);
+
+    assert(delims[0].type == GDMP_DELIM_NEWLINE && delims[0].offset == 17);
+    assert(delims[1].type == GDMP_DELIM_SEPARATOR && delims[1].offset == 26);
+    assert(delims[2].type == GDMP_DELIM_NEWLINE && delims[2].offset == 32);
+    assert(delims[3].type == GDMP_DELIM_SEPARATOR && delims[3].offset == 40);
+    assert(delims[4].type == GDMP_DELIM_SEPARATOR && delims[4].offset == 43);
+    assert(delims[5].type == GDMP_DELIM_NEWLINE && delims[5].offset == 48);
+}
+
+void test_GDMPScanMaxDelims(void) {
+    char str[100];
+    memset(str, '\n', sizeof(str));
+
+    GDMPDelim delims[10];
+    size_t count = GDMPScan(str, sizeof(str), delims, 10);
+    assert(count == 10);
+    assert(delims[9].offset == 9);
+}
+
+void test_GDMPScanMatchesScalar(void) {
+    char alphabet[] = "ab: \n:";
+    size_t len = 4096;
+    char *str = malloc(len);
+
+    GDMPDelim *expected = malloc(len * sizeof(GDMPDelim));
+    GDMPDelim *actual = malloc(len * sizeof(GDMPDelim));
+
+    srand(1);
+    for (int round = 0; round < 50; round++) {
+        for (size_t i = 0; i < len; i++) {
+            str[i] = alphabet[rand() % (sizeof(alphabet) - 1)];
+        }
+
+        // Vary the length to cover every tail size
+        size_t str_len = len - round;
+        size_t expected_count = GDMPScanScalar(str, str_len, expected, len);
+        size_t actual_count = GDMPScan(str, str_len, actual, len);
+
+        assert(expected_count == actual_count);
+        for (size_t i = 0; i < expected_count; i++) {
+            assert(expected[i].offset == actual[i].offset);
+            assert(expected[i].type == actual[i].type);
+        }
+    }
+
+    free(str);
+    free(expected);
+    free(actual);
+}
@@ -0,0 +1,146 @@
+// Hash Table Tests
+
+#include <stdio.h>
+#include <assert.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include "hash_table.h"
+
+#define NUM_KEYS 1000
+
+void test_HashTableInsert(void);
+void test_HashTableGrow(void);
+void test_HashTableDelete(void);
+void test_HashTableCopy(void);
+void test_HashTableIterate(void);
+
+char keys[NUM_KEYS][16];
+
+int main(void) {
+    for (int i = 0; i < NUM_KEYS; i++) {
+        snprintf(keys[i], sizeof(keys[i]), "key%d", i);
+    }
+
+    test_HashTableInsert();
+    test_HashTableGrow();
+    test_HashTableDelete();
+    test_HashTableCopy();
+    test_HashTableIterate();
+
+    printf("All hash table tests passed\n");
+    return 0;
+}
+
+void test_HashTableInsert(void) {
+    HashTable ht = HashTableNew(4);
+
+    HashTableInsert(ht, "Username", "Will");
+    HashTableInsert(ht, "Content", "G'day mate!");
+    assert(HashTableSize(ht) == 2);
+    assert(HashTableContains(ht, "Username"));
+    assert(strcmp(HashTableGet(ht, "Username"), "Will") == 0);
+    assert(!HashTableContains(ht, "Timestamp"));
+    assert(HashTableGet(ht, "Timestamp") == NULL);
+
+    // Anagrams used to collide
+    HashTableInsert(ht, "Contnet", "swapped");
+    assert(strcmp(HashTableGet(ht, "Content"), "G'day mate!") == 0);
+    assert(strcmp(HashTableGet(ht, "Contnet"), "swapped") == 0);
+
+    // Replaces the value of an existing key
+    HashTableInsert(ht, "Username", "Jack");
+    assert(HashTableSize(ht) == 3);
+    assert(strcmp(HashTableGet(ht, "Username"), "Jack") == 0);
+
+    HashTableFree(ht);
+}
+
+void test_HashTableGrow(void) {
+    HashTable ht = HashTableNew(1);
+
+    for (int i = 0; i < NUM_KEYS; i++) {
+        HashTableInsert(ht, keys[i], keys[i]);
+    }
+
+    assert(HashTableSize(ht) == NUM_KEYS);
+    for (int i = 0; i < NUM_KEYS; i++) {
+        assert(HashTableGet(ht, keys[i]) == keys[i]);
+    }
+
+    HashTableFree(ht);
+}
+
+void test_HashTableDelete(void) {
+    HashTable ht = HashTableNew(NUM_KEYS);
+
+    for (int i = 0; i < NUM_KEYS; i++) {
+        HashTableInsert(ht, keys[i], keys[i]);
+    }
+
+    // Delete every other key, the rest must stay reachable
+    for (int i = 0; i < NUM_KEYS; i += 2) {
+        assert(HashTableDelete(ht, keys[i]));
+    }
+    assert(!HashTableDelete(ht, keys[0]));
+    assert(HashTableSize(ht) == NUM_KEYS / 2);
+
+    for (int i = 0; i < NUM_KEYS; i++) {
+        if (i % 2 == 0) {
+            assert(!HashTableContains(ht, keys[i]));
+        } else {
+            assert(HashTableGet(ht, keys[i]) == keys[i]);
+        }
+    }
+
+    // Deleted keys can be inserted again
+    HashTableInsert(ht, keys[0], "again");
+    assert(strcmp(HashTableGet(ht, keys[0]), "again") == 0);
+
+    HashTableFree(ht);
+}
+
+void test_HashTableCopy(void) {
+    HashTable ht = HashTableNew(4);
+    HashTableInsert(ht, "Username", "Will");
+
+    HashTable copy = HashTableCopy(ht);
+    HashTableInsert(copy, "Content", "G'day mate!");
+    HashTableDelete(copy, "Username");
+
+    // The original is unaffected
+    assert(HashTableSize(ht) == 1);
+    assert(strcmp(HashTableGet(ht, "Username"), "Will") == 0);
+    assert(!HashTableContains(ht, "Content"));
+
+    assert(HashTableSize(copy) == 1);
+    assert(strcmp(HashTableGet(copy, "Content"), "G'day mate!") == 0);
+
+    HashTableFree(ht);
+    HashTableFree(copy);
+}
+
+void test_HashTableIterate(void) {
+    HashTable ht = HashTableNew(1);
+
+    for (int i = 0; i < NUM_KEYS; i++) {
+        HashTableInsert(ht, keys[i], keys[i]);
+    }
+
+    int seen[NUM_KEYS] = {0};
+    int count = 0;
+
+    HashTableIterator it = HashTableIterate(ht);
+    Key key;
+    Value value;
+    while (HashTableNext(&it, &key, &value)) {
+        assert(key == value);
+        seen[atoi(key + 3)]++;
+        count++;
+    }
+
+    assert(count == NUM_KEYS);
+    for (int i = 0; i < NUM_KEYS; i++) assert(seen[i] == 1);
+
+    HashTableFree(ht);
+}
@@ -0,0 +1,164 @@
+// Logger Tests
+
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include <pthread.h>
+
+#include "logger.h"
+
+#define THREAD_COUNT 4
+#define LOGS_PER_THREAD 5000
+
+struct log_thread_arg {
+    Logger logger;
+    int id;
+};
+
+void test_LoggerFormats(void);
+void test_LoggerLevels(void);
+void test_LoggerLevelNamed(void);
+void test_LoggerTruncated(void);
+void test_LoggerThreads(void);
+void *log_many(void *arg);
+void read_log(FILE *file, char *buf, size_t size);
+
+int main(void) {
+    test_LoggerFormats();
+    test_LoggerLevels();
+    test_LoggerLevelNamed();
+    test_LoggerTruncated();
+    test_LoggerThreads();
+
+    printf("All Logger tests passed\n");
+    return 0;
+}
+
+void test_LoggerFormats(void) {
+    FILE *out = tmpfile();
+    Logger logger = LoggerNew(out, out, LOG_DEBUG);
+    assert(logger != NULL);
+
+    char name[] = "alice";
+    LoggerLog(logger, LOG_INFO, "[%s] %d %u %05x %c %%", name, -42, 42u, 0xbeef, 'z');
+    name[0] = 'b'; // Copied when logged
+    LoggerLog(logger, LOG_INFO, "%lu %lld %zu %.2f %-4s|", 123456789012UL, -5LL, (size_t)7, 1.5, "ab");
+    LoggerFree(logger);
+
+    char buf[256];
+    read_log(out, buf, sizeof(buf));
+    assert(strcmp(buf, "[alice] -42 42 0beef z %\n123456789012 -5 7 1.50 ab  |\n") == 0);
+    fclose(out);
+}
+
+void test_LoggerLevels(void) {
+    FILE *out = tmpfile();
+    FILE *err = tmpfile();
+    Logger logger = LoggerNew(out, err, LOG_INFO);
+    assert(LoggerLevel(logger) == LOG_INFO);
+
+    LoggerLog(logger, LOG_DEBUG, "hidden %d", 1);
+    LoggerLog(logger, LOG_INFO, "info %d", 2);
+    LoggerLog(logger, LOG_WARN, "warn %d", 3);
+
+    LoggerSetLevel(logger, LOG_DEBUG);
+    assert(LoggerLevel(logger) == LOG_DEBUG);
+    LoggerLog(logger, LOG_DEBUG, "debug %d", 4);
+
+    LoggerSetLevel(logger, LOG_ERROR);
+    LoggerLog(logger, LOG_WARN, "hidden %d", 5);
+    LoggerLog(logger, LOG_ERROR, "error %d", 6);
+    assert(LoggerDropped(logger) == 0);
+    LoggerFree(logger);
+
+    char buf[256];
+    read_log(out, buf, sizeof(buf));
+    assert(strcmp(buf, "info 2\ndebug 4\n") == 0);
+    read_log(err, buf, sizeof(buf));
+    assert(strcmp(buf, "warn 3\nerror 6\n") == 0);
+    fclose(out);
+    fclose(err);
+}
+
+void test_LoggerLevelNamed(void) {
+    assert(LoggerLevelNamed("debug") == LOG_DEBUG);
+    assert(LoggerLevelNamed("info") == LOG_INFO);
+    assert(LoggerLevelNamed("warn") == LOG_WARN);
+    assert(LoggerLevelNamed("error") == LOG_ERROR);
+    assert(LoggerLevelNamed("verbose") == -1);
+}
+
+void test_LoggerTruncated(void) {
+    FILE *out = tmpfile();
+    Logger logger = LoggerNew(out, out, LOG_INFO);
+
+    // A string longer than the record is cut short, and what follows left out
+    char long_string[LOGGER_ARGS_SIZE * 2];
+    memset(long_string, 'a', sizeof(long_string) - 1);
+    long_string[sizeof(long_string) - 1] = '\0';
+    LoggerLog(logger, LOG_INFO, "<%s> %d", long_string, 7);
+    LoggerFree(logger);
+
+    char buf[LOGGER_ARGS_SIZE * 2];
+    read_log(out, buf, sizeof(buf));
+    assert(buf[0] == '<');
+    assert(strspn(buf + 1, "a") == LOGGER_ARGS_SIZE - 1);
+    assert(strcmp(buf + LOGGER_ARGS_SIZE, "> ...\n") == 0);
+    fclose(out);
+}
+
+void test_LoggerThreads(void) {
+    FILE *out = tmpfile();
+    Logger logger = LoggerNew(out, out, LOG_INFO);
+
+    pthread_t threads[THREAD_COUNT];
+    struct log_thread_arg args[THREAD_COUNT];
+    for (int i = 0; i < THREAD_COUNT; i++) {
+        args[i].logger = logger;
+        args[i].id = i;
+        pthread_create(&threads[i], NULL, log_many, &args[i]);
+    }
+    for (int i = 0; i < THREAD_COUNT; i++) {
+        pthread_join(threads[i], NULL);
+    }
+
+    unsigned long dropped = LoggerDropped(logger);
+    LoggerFree(logger);
+
+    // Each thread's records are in the order it logged them, and every record
+    // is either written or counted as dropped
+    int last[THREAD_COUNT];
+    for (int i = 0; i < THREAD_COUNT; i++) last[i] = -1;
+
+    rewind(out);
+    int id, seq;
+    unsigned long lines = 0;
+    while (fscanf(out, "thread %d: %d\n", &id, &seq) == 2) {
+        assert(id >= 0 && id < THREAD_COUNT);
+        assert(seq > last[id]);
+        last[id] = seq;
+        lines++;
+    }
+
+    assert(lines + dropped == THREAD_COUNT * LOGS_PER_THREAD);
+    fclose(out);
+}
+
+void *log_many(void *arg) {
+    struct log_thread_arg *thread_arg = (struct log_thread_arg *)arg;
+
+    for (int i = 0; i < LOGS_PER_THREAD; i++) {
+        LoggerLog(thread_arg->logger, LOG_INFO, "thread %d: %d", thread_arg->id, i);
+    }
+
+    return NULL;
+}
+
+/**
+ * Reads what was written to a file into buf (null terminated).
+ */
+void read_log(FILE *file, char *buf, size_t size) {
+    rewind(file);
+    size_t len = fread(buf, 1, size - 1, file);
+    buf[len] = '\0';
+}
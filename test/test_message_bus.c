@@ -0,0 +1,185 @@
+// Message Bus Tests
+
+#include <stdio.h>
+#include <assert.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <limits.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "message_bus.h"
+
+#define BUS_SIZE (16 * 1024)
+
+/**
+ * The messages a consumer read.
+ */
+struct read_log {
+    int count;
+    char last[MESSAGE_BUS_RECORD_MAX_LEN + 1];
+    int next; // Number expected in the next message
+    int out_of_order;
+};
+
+void test_MessageBusPublish(void);
+void test_MessageBusWrap(void);
+void test_MessageBusLost(void);
+void test_MessageBusWait(void);
+char *bus_name(void);
+void remove_bus(char *name);
+void log_message(const char *data, size_t len, void *arg);
+void *publish_later(void *arg);
+
+int main(void) {
+    test_MessageBusPublish();
+    test_MessageBusWrap();
+    test_MessageBusLost();
+    test_MessageBusWait();
+
+    printf("All MessageBus tests passed\n");
+    return 0;
+}
+
+void test_MessageBusPublish(void) {
+    char *name = bus_name();
+    MessageBus a = MessageBusOpen(name, BUS_SIZE);
+    MessageBus b = MessageBusOpen(name, BUS_SIZE);
+    assert(a != NULL && b != NULL);
+
+    assert(MessageBusPublish(a, "0", 1) == 0);
+
+    // Every other consumer reads it, but not the one that published it
+    struct read_log log = {0};
+    assert(MessageBusRead(b, log_message, &log, 0) == 1);
+    assert(strcmp(log.last, "0") == 0);
+    assert(MessageBusRead(b, log_message, &log, 0) == 0);
+    assert(MessageBusRead(a, log_message, &log, 0) == 0);
+
+    // Too long to publish
+    char *big = calloc(MESSAGE_BUS_RECORD_MAX_LEN + 1, 1);
+    assert(MessageBusPublish(a, big, MESSAGE_BUS_RECORD_MAX_LEN + 1) == -1);
+    free(big);
+
+    // A late consumer only reads what is published after it joins
+    MessageBus c = MessageBusOpen(name, BUS_SIZE);
+    assert(MessageBusRead(c, log_message, &log, 0) == 0);
+
+    MessageBusClose(a);
+    MessageBusClose(b);
+    MessageBusClose(c);
+    remove_bus(name);
+}
+
+void test_MessageBusWrap(void) {
+    char *name = bus_name();
+    MessageBus a = MessageBusOpen(name, BUS_SIZE);
+    MessageBus b = MessageBusOpen(name, BUS_SIZE);
+
+    // Many times around the ring, reading as it goes
+    struct read_log log = {0};
+    char data[200];
+    for (int i = 0; i < 5000; i++) {
+        int len = snprintf(data, sizeof(data), "%d %.*s", i, i % 150, "................................................................................................................................................................");
+        assert(MessageBusPublish(a, data, len) == 0);
+        if (i % 20 == 19) MessageBusRead(b, log_message, &log, 0);
+    }
+
+    MessageBusRead(b, log_message, &log, 0);
+    assert(log.count == 5000);
+    assert(log.out_of_order == 0);
+    assert(MessageBusLost(b) == 0);
+
+    MessageBusClose(a);
+    MessageBusClose(b);
+    remove_bus(name);
+}
+
+void test_MessageBusLost(void) {
+    char *name = bus_name();
+    MessageBus a = MessageBusOpen(name, BUS_SIZE);
+    MessageBus b = MessageBusOpen(name, BUS_SIZE);
+
+    // Fall a few times around the ring behind
+    char data[100];
+    memset(data, 'x', sizeof(data));
+    for (int i = 0; i < 1000; i++) {
+        assert(MessageBusPublish(a, data, sizeof(data)) == 0);
+    }
+
+    // The consumer skips ahead, then counts what it missed
+    struct read_log log = {0};
+    assert(MessageBusRead(b, log_message, &log, 0) == 0);
+    assert(MessageBusPublish(a, "1000", 4) == 0);
+    assert(MessageBusRead(b, log_message, &log, 0) == 1);
+    assert(strcmp(log.last, "1000") == 0);
+    assert(MessageBusLost(b) == 1000);
+
+    MessageBusClose(a);
+    MessageBusClose(b);
+    remove_bus(name);
+}
+
+void test_MessageBusWait(void) {
+    char *name = bus_name();
+    MessageBus a = MessageBusOpen(name, BUS_SIZE);
+    MessageBus b = MessageBusOpen(name, BUS_SIZE);
+
+    // Nothing to read before the timeout
+    struct read_log log = {0};
+    assert(MessageBusRead(b, log_message, &log, 10) == 0);
+
+    // Woken by a publish, well before the timeout
+    pthread_t thread;
+    pthread_create(&thread, NULL, publish_later, a);
+
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    int count = 0;
+    while (count == 0) count = MessageBusRead(b, log_message, &log, 5000);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    assert(count == 1);
+    assert(end.tv_sec - start.tv_sec < 2);
+
+    pthread_join(thread, NULL);
+    MessageBusClose(a);
+    MessageBusClose(b);
+    remove_bus(name);
+}
+
+/**
+ * Returns a bus name no other test run uses (in a static buffer).
+ */
+char *bus_name(void) {
+    static char name[64];
+    static int count = 0;
+    snprintf(name, sizeof(name), "gdaymate-test-%d-%d", getpid(), count++);
+    return name;
+}
+
+void remove_bus(char *name) {
+    char path[PATH_MAX];
+    snprintf(path, sizeof(path), "%s%s", MESSAGE_BUS_DIR, name);
+    unlink(path);
+}
+
+/**
+ * Counts the messages read, checking their numbers (their first word) are in order.
+ */
+void log_message(const char *data, size_t len, void *arg) {
+    struct read_log *log = arg;
+    assert(strlen(data) == len);
+
+    if (atoi(data) != log->next) log->out_of_order++;
+    log->next = atoi(data) + 1;
+    log->count++;
+    memcpy(log->last, data, len + 1);
+}
+
+void *publish_later(void *arg) {
+    usleep(50000);
+    MessageBusPublish(arg, "0", 1);
+    return NULL;
+}
@@ -0,0 +1,344 @@
+// Message Log Tests
+
+#include <stdio.h>
+#include <assert.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <limits.h>
+#include <stdbool.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "message_log.h"
+
+#define SEGMENT_SIZE 4096
+#define THREAD_COUNT 4
+#define RECORDS_PER_THREAD 1000
+
+void test_MessageLogAppend(void);
+void test_MessageLogSegments(void);
+void test_MessageLogRecover(void);
+void test_MessageLogConcurrent(void);
+void test_MessageLogRead(void);
+void test_MessageLogReadBack(void);
+void test_MessageLogFindTime(void);
+char *make_dir(void);
+void remove_dir(char *dir);
+int count_records(char *dir, uint64_t *last_seq);
+void *append_records(void *arg);
+MessageLog fill_log(char *dir, int count);
+bool check_record(LogRecord *record, const char *data, void *arg);
+int64_t time_ns(void);
+
+int main(void) {
+    test_MessageLogAppend();
+    test_MessageLogSegments();
+    test_MessageLogRecover();
+    test_MessageLogConcurrent();
+    test_MessageLogRead();
+    test_MessageLogReadBack();
+    test_MessageLogFindTime();
+
+    printf("All MessageLog tests passed\n");
+    return 0;
+}
+
+void test_MessageLogAppend(void) {
+    char *dir = make_dir();
+
+    MessageLog log = MessageLogNew(dir, MESSAGE_LOG_SYNC_BATCH, SEGMENT_SIZE);
+    assert(log != NULL);
+
+    assert(MessageLogAppend(log, "G'day mate!", 11) == 0);
+    assert(MessageLogAppend(log, "How ya going?", 13) == 0);
+    MessageLogFlush(log);
+
+    uint64_t last_seq;
+    assert(count_records(dir, &last_seq) == 2);
+    assert(last_seq == 2);
+
+    // Reopening continues the sequence
+    MessageLogFree(log);
+    log = MessageLogNew(dir, MESSAGE_LOG_SYNC_EACH, SEGMENT_SIZE);
+    assert(MessageLogAppend(log, "Not bad", 7) == 0);
+    MessageLogFree(log);
+
+    assert(count_records(dir, &last_seq) == 3);
+    assert(last_seq == 3);
+
+    remove_dir(dir);
+}
+
+void test_MessageLogSegments(void) {
+    char *dir = make_dir();
+
+    // Fill several segments
+    char data[1000];
+    memset(data, 'a', sizeof(data));
+
+    MessageLog log = MessageLogNew(dir, MESSAGE_LOG_SYNC_NONE, SEGMENT_SIZE);
+    for (int i = 0; i < 10; i++) {
+        assert(MessageLogAppend(log, data, sizeof(data)) == 0);
+    }
+    MessageLogFree(log);
+
+    uint64_t last_seq;
+    assert(count_records(dir, &last_seq) == 10);
+    assert(last_seq == 10);
+
+    int segments = 0;
+    DIR *d = opendir(dir);
+    struct dirent *dirent;
+    while ((dirent = readdir(d)) != NULL) {
+        if (dirent->d_name[0] != '.') segments++;
+    }
+    closedir(d);
+    assert(segments == 3); // 4 records of 1024 bytes fit in a segment
+
+    remove_dir(dir);
+}
+
+void test_MessageLogRecover(void) {
+    char *dir = make_dir();
+
+    MessageLog log = MessageLogNew(dir, MESSAGE_LOG_SYNC_BATCH, SEGMENT_SIZE);
+    assert(MessageLogAppend(log, "G'day mate!", 11) == 0);
+    MessageLogFree(log);
+
+    // Leave half a record behind, as a crash could
+    char path[PATH_MAX];
+    snprintf(path, sizeof(path), "%s/%020d.log", dir, 1);
+    int fd = open(path, O_WRONLY | O_APPEND);
+    LogRecord torn = {0, 100, 2, 0};
+    assert(write(fd, &torn, sizeof(torn)) == sizeof(torn));
+    assert(write(fd, "How ya", 6) == 6);
+    close(fd);
+
+    log = MessageLogNew(dir, MESSAGE_LOG_SYNC_BATCH, SEGMENT_SIZE);
+    assert(MessageLogAppend(log, "How ya going?", 13) == 0);
+    MessageLogFree(log);
+
+    uint64_t last_seq;
+    assert(count_records(dir, &last_seq) == 2);
+    assert(last_seq == 2);
+
+    remove_dir(dir);
+}
+
+void test_MessageLogConcurrent(void) {
+    char *dir = make_dir();
+
+    MessageLog log = MessageLogNew(dir, MESSAGE_LOG_SYNC_BATCH, 64 * SEGMENT_SIZE);
+
+    pthread_t threads[THREAD_COUNT];
+    for (int i = 0; i < THREAD_COUNT; i++) {
+        pthread_create(&threads[i], NULL, append_records, log);
+    }
+    for (int i = 0; i < THREAD_COUNT; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    MessageLogFree(log);
+
+    uint64_t last_seq;
+    assert(count_records(dir, &last_seq) == THREAD_COUNT * RECORDS_PER_THREAD);
+    assert(last_seq == THREAD_COUNT * RECORDS_PER_THREAD);
+
+    remove_dir(dir);
+}
+
+/**
+ * The state of check_record: the next sequence number expected,
+ * the step between records, and how many are left to visit.
+ */
+struct read_check {
+    uint64_t seq;
+    int step;
+    int left;
+};
+
+void test_MessageLogRead(void) {
+    char *dir = make_dir();
+    MessageLog log = fill_log(dir, 1000);
+    assert(MessageLogLastSeq(log) == 1000);
+
+    struct read_check check = {500, 1, 1000};
+    MessageLogRead(log, 500, check_record, &check);
+    assert(check.seq == 1001);
+
+    // Stop early
+    check = (struct read_check){1, 1, 10};
+    MessageLogRead(log, 1, check_record, &check);
+    assert(check.seq == 11 && check.left == 0);
+
+    // Reopening rebuilds the index
+    MessageLogFree(log);
+    log = MessageLogNew(dir, MESSAGE_LOG_SYNC_NONE, SEGMENT_SIZE);
+    assert(MessageLogLastSeq(log) == 1000);
+
+    check = (struct read_check){937, 1, 1000};
+    MessageLogRead(log, 937, check_record, &check);
+    assert(check.seq == 1001);
+
+    // Records appended after reopening are readable too
+    assert(MessageLogAppend(log, "record 1001", 11) == 0);
+    MessageLogFlush(log);
+    check = (struct read_check){1001, 1, 1000};
+    MessageLogRead(log, 1001, check_record, &check);
+    assert(check.seq == 1002);
+
+    MessageLogFree(log);
+    remove_dir(dir);
+}
+
+void test_MessageLogReadBack(void) {
+    char *dir = make_dir();
+    MessageLog log = fill_log(dir, 1000);
+
+    struct read_check check = {1000, -1, 1000};
+    MessageLogReadBack(log, MessageLogLastSeq(log), check_record, &check);
+    assert(check.seq == 0 && check.left == 0);
+
+    // From the middle of a segment, across several
+    check = (struct read_check){555, -1, 300};
+    MessageLogReadBack(log, 555, check_record, &check);
+    assert(check.seq == 255 && check.left == 0);
+
+    // Past the end starts at the last record
+    check = (struct read_check){1000, -1, 1};
+    MessageLogReadBack(log, 5000, check_record, &check);
+    assert(check.seq == 999);
+
+    MessageLogFree(log);
+    remove_dir(dir);
+}
+
+void test_MessageLogFindTime(void) {
+    char *dir = make_dir();
+    MessageLog log = fill_log(dir, 300);
+
+    int64_t time = time_ns();
+    struct timespec pause = {0, 1000000};
+    nanosleep(&pause, NULL);
+
+    for (int i = 301; i <= 400; i++) {
+        char data[32];
+        int len = snprintf(data, sizeof(data), "record %d", i);
+        assert(MessageLogAppend(log, data, len) == 0);
+    }
+    MessageLogFlush(log);
+
+    assert(MessageLogFindTime(log, 0) == 1);
+    assert(MessageLogFindTime(log, time) == 301);
+    assert(MessageLogFindTime(log, time_ns() + 1000000000) == 401);
+
+    MessageLogFree(log);
+    remove_dir(dir);
+}
+
+char *make_dir(void) {
+    static char dir[64];
+    strcpy(dir, "/tmp/test_message_log_XXXXXX");
+    assert(mkdtemp(dir) != NULL);
+    return dir;
+}
+
+void remove_dir(char *dir) {
+    DIR *d = opendir(dir);
+    struct dirent *dirent;
+    while ((dirent = readdir(d)) != NULL) {
+        if (dirent->d_name[0] == '.') continue;
+        char path[PATH_MAX];
+        snprintf(path, sizeof(path), "%s/%s", dir, dirent->d_name);
+        unlink(path);
+    }
+    closedir(d);
+    rmdir(dir);
+}
+
+/**
+ * Reads every segment in order, checking each record.
+ * Returns the number of records, and stores the last sequence number.
+ */
+int count_records(char *dir, uint64_t *last_seq) {
+    int count = 0;
+    *last_seq = 0;
+
+    // Segments are named after their first sequence number
+    for (uint64_t first_seq = 1; ; first_seq = *last_seq + 1) {
+        char path[PATH_MAX];
+        snprintf(path, sizeof(path), "%s/%020lu.log", dir, (unsigned long)first_seq);
+        int fd = open(path, O_RDONLY);
+        if (fd == -1) break;
+
+        LogRecord record;
+        char data[2048];
+        while (read(fd, &record, sizeof(record)) == sizeof(record)) {
+            assert(record.len <= sizeof(data));
+            assert(read(fd, data, record.len) == record.len);
+            assert(record.crc == LogRecordCRC(&record, data));
+            assert(record.seq == *last_seq + 1);
+
+            *last_seq = record.seq;
+            count++;
+        }
+
+        close(fd);
+    }
+
+    return count;
+}
+
+void *append_records(void *arg) {
+    MessageLog log = arg;
+
+    for (int i = 0; i < RECORDS_PER_THREAD; i++) {
+        char data[32];
+        int len = snprintf(data, sizeof(data), "record %d", i);
+        assert(MessageLogAppend(log, data, len) == 0);
+    }
+
+    return NULL;
+}
+
+/**
+ * Opens a log with small segments, holding the given number of records
+ * ("record 1", "record 2", ...).
+ */
+MessageLog fill_log(char *dir, int count) {
+    MessageLog log = MessageLogNew(dir, MESSAGE_LOG_SYNC_NONE, SEGMENT_SIZE);
+    assert(log != NULL);
+
+    for (int i = 1; i <= count; i++) {
+        char data[32];
+        int len = snprintf(data, sizeof(data), "record %d", i);
+        assert(MessageLogAppend(log, data, len) == 0);
+    }
+
+    MessageLogFlush(log);
+    return log;
+}
+
+/**
+ * Checks a record visited by a read is the one expected.
+ */
+bool check_record(LogRecord *record, const char *data, void *arg) {
+    struct read_check *check = arg;
+
+    char expected[32];
+    int len = snprintf(expected, sizeof(expected), "record %lu", (unsigned long)check->seq);
+    assert(record->seq == check->seq);
+    assert(record->len == (uint32_t)len && memcmp(data, expected, len) == 0);
+    assert(record->crc == LogRecordCRC(record, data));
+
+    check->seq += check->step;
+    return --check->left > 0;
+}
+
+int64_t time_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
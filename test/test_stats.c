@@ -0,0 +1,129 @@
+// Stats Tests
+
+#include <stdio.h>
+#include <assert.h>
+#include <stdint.h>
+#include <pthread.h>
+
+#include "stats.h"
+
+#define THREAD_COUNT 8
+#define ADDS_PER_THREAD 100000
+
+void test_StatsNew(void);
+void test_StatsAdd(void);
+void test_StatsThreads(void);
+void test_StatsPercentile(void);
+void test_StatsPercentileLarge(void);
+void *add_many(void *arg);
+
+int main(void) {
+    test_StatsNew();
+    test_StatsAdd();
+    test_StatsThreads();
+    test_StatsPercentile();
+    test_StatsPercentileLarge();
+
+    printf("All Stats tests passed\n");
+    return 0;
+}
+
+void test_StatsNew(void) {
+    Stats stats = StatsNew(4, 2);
+    assert(stats != NULL);
+    assert(StatsRead(stats, 0) == 0);
+    assert(StatsRead(stats, 3) == 0);
+    StatsFree(stats);
+
+    assert(StatsNew(STATS_MAX_COUNTERS + 1, 0) == NULL);
+    assert(StatsNew(1, STATS_MAX_HISTOGRAMS + 1) == NULL);
+}
+
+void test_StatsAdd(void) {
+    Stats stats = StatsNew(2, 0);
+
+    StatsAdd(stats, 0, 5);
+    StatsAdd(stats, 0, 2);
+    assert(StatsRead(stats, 0) == 7);
+    assert(StatsRead(stats, 1) == 0);
+
+    // A gauge goes back down
+    StatsAdd(stats, 1, 3);
+    StatsAdd(stats, 1, -1);
+    assert(StatsRead(stats, 1) == 2);
+
+    StatsFree(stats);
+}
+
+void test_StatsThreads(void) {
+    Stats stats = StatsNew(2, 0);
+
+    // Counters updated in other threads' shards still sum up
+    pthread_t threads[THREAD_COUNT];
+    for (int i = 0; i < THREAD_COUNT; i++) {
+        pthread_create(&threads[i], NULL, add_many, stats);
+    }
+    for (int i = 0; i < THREAD_COUNT; i++) {
+        pthread_join(threads[i], NULL);
+    }
+
+    assert(StatsRead(stats, 0) == THREAD_COUNT * ADDS_PER_THREAD);
+    assert(StatsRead(stats, 1) == 0);
+
+    StatsFree(stats);
+}
+
+void test_StatsPercentile(void) {
+    Stats stats = StatsNew(0, 1);
+    assert(StatsPercentile(stats, 0, 50) == 0);
+
+    // Small values are counted exactly
+    for (int i = 1; i <= 10; i++) {
+        StatsRecord(stats, 0, i);
+    }
+
+    assert(StatsRecorded(stats, 0) == 10);
+    assert(StatsPercentile(stats, 0, 50) == 5);
+    assert(StatsPercentile(stats, 0, 90) == 9);
+    assert(StatsPercentile(stats, 0, 100) == 10);
+    assert(StatsPercentile(stats, 0, 0) == 1);
+
+    StatsFree(stats);
+}
+
+void test_StatsPercentileLarge(void) {
+    Stats stats = StatsNew(0, 1);
+
+    // 1 to 100000, where percentiles are within a bucket's width of the value
+    for (int i = 1; i <= 100000; i++) {
+        StatsRecord(stats, 0, i);
+    }
+
+    uint64_t p50 = StatsPercentile(stats, 0, 50);
+    uint64_t p99 = StatsPercentile(stats, 0, 99);
+    uint64_t p999 = StatsPercentile(stats, 0, 99.9);
+    assert(p50 >= 50000 && p50 <= 50000 + 50000 / STATS_HISTOGRAM_SUB_COUNT);
+    assert(p99 >= 99000 && p99 <= 99000 + 99000 / STATS_HISTOGRAM_SUB_COUNT);
+    assert(p999 >= 99900 && p999 <= 99900 + 99900 / STATS_HISTOGRAM_SUB_COUNT);
+
+    // Too large values count as the largest
+    StatsRecord(stats, 0, UINT64_MAX);
+    assert(StatsPercentile(stats, 0, 100) == ((uint64_t)1 << STATS_HISTOGRAM_MAX_BITS) - 1);
+
+    StatsFree(stats);
+}
+
+/**
+ * Adds to the first counter many times, and to the second and back.
+ */
+void *add_many(void *arg) {
+    Stats stats = arg;
+
+    for (int i = 0; i < ADDS_PER_THREAD; i++) {
+        StatsAdd(stats, 0, 1);
+        StatsAdd(stats, 1, 1);
+        StatsAdd(stats, 1, -1);
+    }
+
+    return NULL;
+}
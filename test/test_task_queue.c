@@ -68,10 +68,12 @@ void test_TaskQueueIsEmpty(void) {
     Task task = TaskNew(log_task, &task_arg);
     TaskQueueEnqueue(q, task);
     assert(!TaskQueueIsEmpty(q));
+    assert(TaskQueueLength(q) == 1);
 
     Task dequeuedTask = TaskQueueDequeue(q);
     assert(dequeuedTask == task);
     assert(TaskQueueIsEmpty(q));
+    assert(TaskQueueLength(q) == 0);
 
     TaskFree(dequeuedTask);
     TaskQueueFree(q);
@@ -3,6 +3,7 @@
 #include <stdio.h>
 #include <assert.h>
 #include <unistd.h>
+#include <pthread.h>
 
 #include "thread_pool.h"
 #include "task_queue.h"
@@ -10,11 +11,14 @@
 
 void test_ThreadPoolNew(void);
 void test_ThreadPoolAddTask(void);
+void test_ThreadPoolParallel(void);
 void *log_task(void *arg);
+void *barrier_task(void *arg);
 
 int main(void) {
     test_ThreadPoolNew();
     test_ThreadPoolAddTask();
+    test_ThreadPoolParallel();
 
     printf("All ThreadPool tests passed\n");
     return 0;
@@ -46,8 +50,29 @@ void test_ThreadPoolAddTask(void) {
     ThreadPoolFree(pool);
 }
 
+void test_ThreadPoolParallel(void) {
+    ThreadPool pool = ThreadPoolNew(3);
+
+    // Each task waits for the others, so they only finish if they run at once
+    pthread_barrier_t barrier;
+    pthread_barrier_init(&barrier, NULL, 4);
+    for (int i = 0; i < 3; i++) {
+        ThreadPoolAddTask(pool, TaskNew(barrier_task, &barrier));
+    }
+
+    pthread_barrier_wait(&barrier);
+    pthread_barrier_destroy(&barrier);
+
+    ThreadPoolFree(pool);
+}
+
 void *log_task(void *arg) {
     int log_task_arg = *(int *)arg;
     printf("Executing task with argument: %d\n", log_task_arg);
     return NULL;
 }
+
+void *barrier_task(void *arg) {
+    pthread_barrier_wait((pthread_barrier_t *)arg);
+    return NULL;
+}
@@ -0,0 +1,71 @@
+// Token Bucket Tests
+
+#include <stdio.h>
+#include <assert.h>
+
+#include "token_bucket.h"
+
+void test_TokenBucketTake(void);
+void test_TokenBucketRefill(void);
+void test_TokenBucketCharge(void);
+void test_TokenBucketWait(void);
+
+int main(void) {
+    test_TokenBucketTake();
+    test_TokenBucketRefill();
+    test_TokenBucketCharge();
+    test_TokenBucketWait();
+
+    printf("All Token Bucket tests passed\n");
+
+    return 0;
+}
+
+void test_TokenBucketTake(void) {
+    TokenBucket bucket;
+    TokenBucketInit(&bucket, 10, 3, 1000);
+
+    // A full bucket lets a burst through, then nothing more
+    assert(TokenBucketTake(&bucket, 1, 1000));
+    assert(TokenBucketTake(&bucket, 2, 1000));
+    assert(!TokenBucketTake(&bucket, 1, 1000));
+    assert(TokenBucketTokens(&bucket, 1000) == 0);
+}
+
+void test_TokenBucketRefill(void) {
+    TokenBucket bucket;
+    TokenBucketInit(&bucket, 10, 3, 1000);
+    assert(TokenBucketTake(&bucket, 3, 1000));
+
+    // 10 tokens per second is one every 100ms
+    assert(!TokenBucketTake(&bucket, 1, 1050));
+    assert(TokenBucketTake(&bucket, 1, 1100));
+
+    // Refills stop at the burst
+    assert(TokenBucketTokens(&bucket, 60000) == 3);
+
+    // Time going backwards is ignored
+    assert(TokenBucketTokens(&bucket, 0) == 3);
+}
+
+void test_TokenBucketCharge(void) {
+    TokenBucket bucket;
+    TokenBucketInit(&bucket, 100, 50, 0);
+
+    // Charges go into debt, which is paid back first
+    TokenBucketCharge(&bucket, 150, 0);
+    assert(TokenBucketTokens(&bucket, 0) == -100);
+    assert(!TokenBucketTake(&bucket, 0, 500));
+    assert(TokenBucketTake(&bucket, 0, 1000));
+}
+
+void test_TokenBucketWait(void) {
+    TokenBucket bucket;
+    TokenBucketInit(&bucket, 10, 3, 0);
+    assert(TokenBucketWait(&bucket, 3, 0) == 0);
+
+    TokenBucketCharge(&bucket, 5, 0);
+    assert(TokenBucketWait(&bucket, 1, 0) == 300);
+    assert(TokenBucketWait(&bucket, 1, 250) == 50);
+    assert(TokenBucketWait(&bucket, 1, 300) == 0);
+}
@@ -0,0 +1,165 @@
+// Directory Implementation (Lock Striping)
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <pthread.h>
+
+#include "directory.h"
+#include "hash_table.h"
+
+#define STRIPE_INITIAL_SLOTS 64
+
+struct directory {
+    struct stripe *stripes;
+    DirectoryRetain retain;
+};
+
+struct stripe {
+    pthread_rwlock_t lock;
+    HashTable entries; // Maps names to entries
+} __attribute__((aligned(64))); // Keep stripes on separate cache lines
+
+struct directory_entry {
+    void *value;
+    char name[]; // The entry's key in the hash table
+};
+
+struct stripe *get_stripe(Directory dir, char *name);
+
+////////////////////////////////// FUNCTIONS ///////////////////////////////////
+
+Directory DirectoryNew(DirectoryRetain retain) {
+    Directory dir = malloc(sizeof(*dir));
+    if (dir == NULL) {
+        perror("malloc");
+        return NULL;
+    }
+
+    dir->stripes = aligned_alloc(64, DIRECTORY_STRIPE_COUNT * sizeof(struct stripe));
+    if (dir->stripes == NULL) {
+        perror("aligned_alloc");
+        free(dir);
+        return NULL;
+    }
+
+    for (int i = 0; i < DIRECTORY_STRIPE_COUNT; i++) {
+        pthread_rwlock_init(&dir->stripes[i].lock, NULL);
+        dir->stripes[i].entries = HashTableNew(STRIPE_INITIAL_SLOTS);
+    }
+
+    dir->retain = retain;
+
+    return dir;
+}
+
+void DirectoryFree(Directory dir) {
+    for (int i = 0; i < DIRECTORY_STRIPE_COUNT; i++) {
+        struct stripe *stripe = &dir->stripes[i];
+
+        // Free every entry
+        HashTableIterator it = HashTableIterate(stripe->entries);
+        Key name;
+        Value entry;
+        while (HashTableNext(&it, &name, &entry)) {
+            free(entry);
+        }
+
+        HashTableFree(stripe->entries);
+        pthread_rwlock_destroy(&stripe->lock);
+    }
+
+    free(dir->stripes);
+    free(dir);
+}
+
+int DirectoryAdd(Directory dir, char *name, void *value) {
+    size_t name_len = strlen(name);
+    struct directory_entry *entry = malloc(sizeof(*entry) + name_len + 1);
+    if (entry == NULL) {
+        perror("malloc");
+        return -1;
+    }
+
+    entry->value = value;
+    memcpy(entry->name, name, name_len + 1);
+
+    struct stripe *stripe = get_stripe(dir, name);
+    pthread_rwlock_wrlock(&stripe->lock);
+
+    if (HashTableContains(stripe->entries, name)) {
+        pthread_rwlock_unlock(&stripe->lock);
+        free(entry);
+        return -1;
+    }
+
+    HashTableInsert(stripe->entries, entry->name, entry);
+
+    pthread_rwlock_unlock(&stripe->lock);
+
+    return 0;
+}
+
+void *DirectoryGet(Directory dir, char *name) {
+    struct stripe *stripe = get_stripe(dir, name);
+    pthread_rwlock_rdlock(&stripe->lock);
+
+    void *value = NULL;
+    struct directory_entry *entry = HashTableGet(stripe->entries, name);
+    if (entry != NULL) {
+        value = entry->value;
+        if (dir->retain != NULL) dir->retain(value);
+    }
+
+    pthread_rwlock_unlock(&stripe->lock);
+
+    return value;
+}
+
+bool DirectoryRemove(Directory dir, char *name, void *value) {
+    struct stripe *stripe = get_stripe(dir, name);
+    pthread_rwlock_wrlock(&stripe->lock);
+
+    // Leave the name alone if it was taken again since
+    struct directory_entry *entry = HashTableGet(stripe->entries, name);
+    if (entry == NULL || entry->value != value) {
+        pthread_rwlock_unlock(&stripe->lock);
+        return false;
+    }
+
+    HashTableDelete(stripe->entries, name);
+
+    pthread_rwlock_unlock(&stripe->lock);
+
+    free(entry);
+    return true;
+}
+
+int DirectoryCount(Directory dir) {
+    int count = 0;
+
+    for (int i = 0; i < DIRECTORY_STRIPE_COUNT; i++) {
+        struct stripe *stripe = &dir->stripes[i];
+        pthread_rwlock_rdlock(&stripe->lock);
+        count += HashTableSize(stripe->entries);
+        pthread_rwlock_unlock(&stripe->lock);
+    }
+
+    return count;
+}
+
+////////////////////////////// HELPER FUNCTIONS ////////////////////////////////
+
+/**
+ * Returns the stripe a name belongs to (by its FNV-1a hash).
+ */
+struct stripe *get_stripe(Directory dir, char *name) {
+    uint32_t h = 2166136261u;
+    while (*name) {
+        h ^= (unsigned char)*name++;
+        h *= 16777619u;
+    }
+
+    return &dir->stripes[h % DIRECTORY_STRIPE_COUNT];
+}
@@ -4,15 +4,74 @@
 #include <stdlib.h>
 #include <string.h>
 #include <stdbool.h>
+#include <stdint.h>
 
 #include "gdmp.h"
+#include "gdmp_scan.h"
+#include "gdmp_compress.h"
 #include "hash_table.h"
 
+#define SCAN_BATCH_SIZE 64
+#define INLINE_HEADERS_MAX 8 // Above this, lookups go through a hash table
+
+struct gdmp_header {
+    uint32_t name; // Offsets into the message's data
+    uint32_t value;
+};
+
+/**
+ * A message is a single allocation, holding its headers and
+ * the strings they point to, so it can be copied with one memcpy.
+ * Headers are found by scanning their tags, which rules out most names
+ * without comparing them. Messages with many headers also get an index.
+ */
 struct gdmp_message {
     MessageType type;
-    HashTable data;
+    int header_count;
+    size_t used;
+    size_t capacity;
+    HashTable index; // Maps names to header positions (plus one), or NULL
+    uint32_t tags[GDMP_HEADERS_MAX_COUNT];
+    struct gdmp_header headers[GDMP_HEADERS_MAX_COUNT];
+    char data[];
 };
 
+enum parser_state {
+    PARSER_HEADERS,
+    PARSER_BODY,
+    PARSER_BATCH,
+    PARSER_INFLATE,
+    PARSER_FAILED,
+};
+
+struct gdmp_parser {
+    char *buffer;
+    size_t start;
+    size_t end;
+    size_t scan_pos;
+    enum parser_state state;
+    GDMPMessage msg;
+    size_t body_len;
+    MessageType batch_type;
+    size_t batch_end;
+    GDMPParser inner; // Parses decompressed bytes
+    GDMPDecompressor decompressor;
+    bool inflate_done;
+};
+
+GDMPMessage alloc_message(MessageType type, size_t capacity);
+int find_header(GDMPMessage msg, const char *name);
+int set_header(GDMPMessage msg, size_t name, size_t value);
+long append_string(GDMPMessage msg, const char *str);
+uint32_t header_tag(const char *name);
+void build_index(GDMPMessage msg);
+GDMPMessage parse_message(const char *str, size_t len, MessageType *type);
+GDMPMessage next_headers(GDMPParser parser);
+GDMPMessage next_batched(GDMPParser parser);
+int start_inflate(GDMPParser parser);
+GDMPMessage next_inflated(GDMPParser parser);
+int get_body_len(GDMPMessage msg, size_t *body_len);
+void compact_parser(GDMPParser parser);
 char **get_headers(MessageType type);
 MessageType str_to_type(char *type_string);
 char *type_to_str(MessageType type);
@@ -20,30 +79,30 @@ char *type_to_str(MessageType type);
 ////////////////////////////////// FUNCTIONS ///////////////////////////////////
 
 GDMPMessage GDMPNew(MessageType type) {
-    GDMPMessage msg = malloc(sizeof(*msg));
-    if (msg == NULL) {
-        perror("malloc");
-        return NULL;
-    }
-
-    msg->type = type;
-    msg->data = HashTableNew(GDMP_HEADERS_MAX_COUNT);
-
-    return msg;
+    return alloc_message(type, GDMP_MESSAGE_MAX_LEN);
 }
 
 void GDMPFree(GDMPMessage msg) {
-    HashTableFree(msg->data);
+    if (msg->index != NULL) HashTableFree(msg->index);
     free(msg);
 }
 
-void GDMPAddHeader(GDMPMessage msg, char *header, char *value) {
-    HashTableInsert(msg->data, header, value);
+int GDMPAddHeader(GDMPMessage msg, char *header, char *value) {
+    // Reuse the stored name if the header already exists
+    int idx = find_header(msg, header);
+    long name = idx == -1 ? append_string(msg, header) : msg->headers[idx].name;
+    if (name == -1) return -1;
+
+    long value_offset = append_string(msg, value);
+    if (value_offset == -1) return -1;
+
+    return set_header(msg, name, value_offset);
 }
 
 char *GDMPGetValue(GDMPMessage msg, char *header) {
-    if (!HashTableContains(msg->data, header)) return NULL;
-    return HashTableGet(msg->data, header);
+    int idx = find_header(msg, header);
+    if (idx == -1) return NULL;
+    return msg->data + msg->headers[idx].value;
 }
 
 MessageType GDMPGetType(GDMPMessage msg) {
@@ -59,69 +118,40 @@ char *GDMPStringify(GDMPMessage msg) {
     str[0] = '\0';
 
     MessageType type = GDMPGetType(msg);
-    char **headers = get_headers(type);
 
     // Concatenate the type to the string
     char *type_str = type_to_str(type);
     strcat(str, type_str);
     strcat(str, "\n");
 
-    for (int i = 0; i < GDMP_HEADERS_MAX_COUNT && headers[i] != NULL; i++) {
+    // Leave room for the empty line that ends the message
+    size_t max_len = GDMP_MESSAGE_MAX_LEN - 1;
+
+    for (int i = 0; i < msg->header_count; i++) {
         // Get a header and its value
-        char *header = headers[i];
-        char *value = GDMPGetValue(msg, header);
-        if (value == NULL) continue;
+        char *header = msg->data + msg->headers[i].name;
+        char *value = msg->data + msg->headers[i].value;
 
         // Form the pair string
         char pair[GDMP_MESSAGE_MAX_LEN];
         snprintf(pair, sizeof(pair), "%s: %s\n", header, value);
 
         // Concatenate the pair to the string
-        if (strlen(str) + strlen(pair) < GDMP_MESSAGE_MAX_LEN) {
+        if (strlen(str) + strlen(pair) < max_len) {
             strcat(str, pair);
         } else {
             break;
         }
     }
 
-    free(headers);
+    // End the message
+    strcat(str, "\n");
+
     return str;
 }
 
 GDMPMessage GDMPParse(char *str) {
-    // Extract message type
-    char *pos = strchr(str, '\n');
-    int message_type_len = pos - str;
-    char type_str[GDMP_MESSAGE_MAX_LEN + 1];
-    strncpy(type_str, str, message_type_len);
-    type_str[message_type_len] = '\0';
-
-    // Set message type
-    MessageType type = str_to_type(type_str);
-    GDMPMessage msg = GDMPNew(type);
-    str = pos + 1;
-
-    char *pair;
-    char *str_copy = strdup(str);
-
-    while ((pair = strsep(&str_copy, "\n")) != NULL) {
-        // Exit condition
-        if (*pair == '\0') {
-            break;
-        }
-
-        // Extract header-value pair
-        pos = strstr(pair, ": ");
-        *pos = '\0';
-        char *header = pair;
-        char *value = pos + 2;
-
-        // Set header-value pair
-        GDMPAddHeader(msg, header, value);
-    }
-
-    free(str_copy);
-    return msg;
+    return parse_message(str, strlen(str), NULL);
 }
 
 bool GDMPValidate(GDMPMessage msg, MessageType type) {
@@ -130,29 +160,544 @@ bool GDMPValidate(GDMPMessage msg, MessageType type) {
 
     // Check if headers match message type
     char **headers = get_headers(msg->type);
+    bool valid = true;
     for (int i = 0; i < GDMP_HEADERS_MAX_COUNT && headers[i] != NULL; i++) {
         char *value = GDMPGetValue(msg, headers[i]);
-        if (value == NULL) return false;
+        if (value == NULL) {
+            valid = false;
+            break;
+        }
     }   
 
-    return true;
+    free(headers);
+    return valid;
 }
 
 GDMPMessage GDMPCopy(GDMPMessage msg) {
-    GDMPMessage copy = malloc(sizeof(*msg));
+    GDMPMessage copy = malloc(sizeof(*msg) + msg->capacity);
     if (copy == NULL) {
         perror("malloc");
         return NULL;
     }
 
-    copy->type = msg->type;
-    copy->data = HashTableCopy(msg->data);
+    // Headers are offsets, so they stay valid in the copy
+    memcpy(copy, msg, sizeof(*msg) + msg->used);
+
+    // The index holds pointers into the original, so build a new one
+    copy->index = NULL;
+    if (msg->index != NULL) build_index(copy);
 
     return copy;
 }
 
+GDMPParser GDMPParserNew(void) {
+    GDMPParser parser = malloc(sizeof(*parser));
+    if (parser == NULL) {
+        perror("malloc");
+        return NULL;
+    }
+
+    parser->buffer = malloc(GDMP_PARSER_BUFFER_SIZE);
+    if (parser->buffer == NULL) {
+        perror("malloc");
+        free(parser);
+        return NULL;
+    }
+
+    parser->start = 0;
+    parser->end = 0;
+    parser->scan_pos = 0;
+    parser->state = PARSER_HEADERS;
+    parser->msg = NULL;
+    parser->inner = NULL;
+    parser->decompressor = NULL;
+
+    return parser;
+}
+
+void GDMPParserFree(GDMPParser parser) {
+    if (parser->msg != NULL) GDMPFree(parser->msg);
+    if (parser->inner != NULL) GDMPParserFree(parser->inner);
+    if (parser->decompressor != NULL) GDMPDecompressorFree(parser->decompressor);
+    free(parser->buffer);
+    free(parser);
+}
+
+int GDMPParserFeed(GDMPParser parser, const char *data, size_t len) {
+    size_t space;
+    char *dest = GDMPParserBuffer(parser, &space);
+    if (len > space) return -1;
+
+    memcpy(dest, data, len);
+    GDMPParserCommit(parser, len);
+    return 0;
+}
+
+char *GDMPParserBuffer(GDMPParser parser, size_t *len) {
+    if (parser->state == PARSER_FAILED) {
+        *len = 0;
+        return parser->buffer + parser->end;
+    }
+
+    // Only move the partial message once the end of the buffer is reached
+    if (parser->end == GDMP_PARSER_BUFFER_SIZE) {
+        compact_parser(parser);
+    }
+
+    *len = GDMP_PARSER_BUFFER_SIZE - parser->end;
+    return parser->buffer + parser->end;
+}
+
+void GDMPParserCommit(GDMPParser parser, size_t len) {
+    parser->end += len;
+}
+
+GDMPMessage GDMPParserNext(GDMPParser parser) {
+    while (parser->state != PARSER_FAILED) {
+        if (parser->state == PARSER_INFLATE) {
+            // Return the messages of a compressed message one at a time
+            GDMPMessage msg = next_inflated(parser);
+            if (msg != NULL) return msg;
+            continue;
+        }
+
+        if (parser->state == PARSER_BATCH) {
+            // Return the messages of a batch one at a time
+            if (parser->start < parser->batch_end) {
+                return next_batched(parser);
+            }
+
+            parser->state = PARSER_HEADERS;
+            parser->scan_pos = parser->start;
+        }
+
+        if (parser->state == PARSER_BODY) {
+            // Wait for the whole body
+            if (parser->end - parser->start < parser->body_len) break;
+
+            GDMPMessage msg = parser->msg;
+            parser->msg = NULL;
+
+            if (GDMPValidate(msg, GDMP_BATCH_MESSAGE)) {
+                parser->state = PARSER_BATCH;
+                parser->batch_type = str_to_type(GDMPGetValue(msg, "Type"));
+                parser->batch_end = parser->start + parser->body_len;
+                parser->scan_pos = parser->batch_end;
+                GDMPFree(msg);
+                continue;
+            }
+
+            if (GDMPValidate(msg, GDMP_COMPRESSED_MESSAGE)) {
+                GDMPFree(msg);
+                if (start_inflate(parser) == -1) {
+                    parser->state = PARSER_FAILED;
+                }
+                continue;
+            }
+
+            // Bodies of other message types are ignored
+            parser->start += parser->body_len;
+            parser->scan_pos = parser->start;
+            parser->state = PARSER_HEADERS;
+            return msg;
+        }
+
+        GDMPMessage msg = next_headers(parser);
+        if (msg == NULL) break;
+
+        size_t body_len;
+        if (get_body_len(msg, &body_len) == -1) {
+            GDMPFree(msg);
+            parser->state = PARSER_FAILED;
+            break;
+        }
+
+        if (body_len == 0) return msg;
+
+        parser->state = PARSER_BODY;
+        parser->msg = msg;
+        parser->body_len = body_len;
+    }
+
+    // Reuse the buffer from the start once everything is consumed
+    if (parser->state == PARSER_HEADERS && parser->start == parser->end) {
+        parser->start = 0;
+        parser->end = 0;
+        parser->scan_pos = 0;
+    }
+
+    return NULL;
+}
+
+ssize_t GDMPParserPending(GDMPParser parser, const char **data) {
+    if (parser->state != PARSER_HEADERS) return -1;
+    if (parser->inner != NULL && parser->inner->end > parser->inner->start) return -1;
+
+    *data = parser->buffer + parser->start;
+    return parser->end - parser->start;
+}
+
+ssize_t GDMPParserWindow(GDMPParser parser, char *buf) {
+    if (parser->decompressor == NULL) return 0;
+
+    return GDMPDecompressorWindow(parser->decompressor, buf);
+}
+
+int GDMPParserSetWindow(GDMPParser parser, const char *window, size_t len) {
+    if (parser->decompressor == NULL) {
+        parser->decompressor = GDMPDecompressorNew();
+        if (parser->decompressor == NULL) return -1;
+    }
+
+    return GDMPDecompressorSetWindow(parser->decompressor, window, len);
+}
+
+int GDMPBatchHeader(char *buf, size_t size, MessageType type, int count, size_t body_len) {
+    int len = snprintf(
+        buf, size, "%s\nType: %s\nCount: %d\nLength: %zu\n\n",
+        type_to_str(GDMP_BATCH_MESSAGE), type_to_str(type), count, body_len
+    );
+    if (len < 0 || (size_t)len >= size) return -1;
+
+    return len;
+}
+
 ////////////////////////////// HELPER FUNCTIONS ////////////////////////////////
 
+/**
+ * Returns the next message whose headers have been received,
+ * or NULL if more bytes are needed. The headers end with an empty line.
+ */
+GDMPMessage next_headers(GDMPParser parser) {
+    char *buffer = parser->buffer;
+
+    // Resume the search for an empty line where the last one stopped
+    while (parser->scan_pos < parser->end) {
+        char *newline = memchr(
+            buffer + parser->scan_pos, '\n', parser->end - parser->scan_pos
+        );
+        if (newline == NULL) {
+            parser->scan_pos = parser->end;
+            break;
+        }
+
+        size_t pos = newline - buffer;
+        parser->scan_pos = pos + 1;
+
+        // Skip empty lines between messages
+        if (pos == parser->start) {
+            parser->start = pos + 1;
+            continue;
+        }
+
+        // An empty line ends the headers
+        if (buffer[pos - 1] == '\n') {
+            GDMPMessage msg = parse_message(buffer + parser->start, pos + 1 - parser->start, NULL);
+            parser->start = pos + 1;
+            return msg;
+        }
+    }
+
+    return NULL;
+}
+
+/**
+ * Returns the next message of the batch being read.
+ * Batched messages have no type line, and each ends with an empty line.
+ */
+GDMPMessage next_batched(GDMPParser parser) {
+    char *buffer = parser->buffer;
+    size_t msg_end = parser->batch_end;
+
+    // Skip empty lines between messages
+    while (parser->start < parser->batch_end && buffer[parser->start] == '\n') {
+        parser->start++;
+    }
+
+    for (size_t pos = parser->start; pos < parser->batch_end; ) {
+        char *newline = memchr(buffer + pos, '\n', parser->batch_end - pos);
+        if (newline == NULL) break;
+
+        pos = newline - buffer + 1;
+        if (pos < parser->batch_end && buffer[pos] == '\n') {
+            msg_end = pos + 1;
+            break;
+        }
+    }
+
+    if (parser->start == msg_end) return NULL;
+
+    GDMPMessage msg = parse_message(
+        buffer + parser->start, msg_end - parser->start, &parser->batch_type
+    );
+    parser->start = msg_end;
+    return msg;
+}
+
+/**
+ * Starts decompressing the body of a compressed message, 
+ * creating the decompressor on the first one. Returns -1 on error.
+ */
+int start_inflate(GDMPParser parser) {
+    if (parser->decompressor == NULL) {
+        parser->decompressor = GDMPDecompressorNew();
+        if (parser->decompressor == NULL) return -1;
+    }
+
+    if (parser->inner == NULL) {
+        parser->inner = GDMPParserNew();
+        if (parser->inner == NULL) return -1;
+    }
+
+    GDMPDecompressorInput(parser->decompressor, parser->buffer + parser->start, parser->body_len);
+    parser->inflate_done = false;
+    parser->scan_pos = parser->start + parser->body_len;
+    parser->state = PARSER_INFLATE;
+
+    return 0;
+}
+
+/**
+ * Returns the next message of the compressed message being read,
+ * decompressing into the inner parser as it needs more bytes.
+ * Returns NULL once the body is fully read, or on error.
+ */
+GDMPMessage next_inflated(GDMPParser parser) {
+    while (true) {
+        GDMPMessage msg = GDMPParserNext(parser->inner);
+        if (msg != NULL) return msg;
+
+        if (parser->inflate_done) {
+            parser->start += parser->body_len;
+            parser->scan_pos = parser->start;
+            parser->state = PARSER_HEADERS;
+            return NULL;
+        }
+
+        size_t space;
+        char *buf = GDMPParserBuffer(parser->inner, &space);
+        if (space == 0) {
+            parser->state = PARSER_FAILED;
+            return NULL;
+        }
+
+        ssize_t len = GDMPDecompress(parser->decompressor, buf, space, &parser->inflate_done);
+        if (len == -1) {
+            parser->state = PARSER_FAILED;
+            return NULL;
+        }
+
+        GDMPParserCommit(parser->inner, len);
+    }
+}
+
+/**
+ * Stores the length of the message's body (0 if it has none) in body_len.
+ * Returns -1 if the length is invalid, or too long to ever be received.
+ */
+int get_body_len(GDMPMessage msg, size_t *body_len) {
+    *body_len = 0;
+
+    char *value = GDMPGetValue(msg, "Length");
+    if (value == NULL) return 0;
+
+    char *end;
+    unsigned long len = strtoul(value, &end, 10);
+    if (*value == '\0' || *end != '\0' || len > GDMP_PARSER_BUFFER_SIZE) return -1;
+
+    *body_len = len;
+    return 0;
+}
+
+/**
+ * Moves the partially received message to the front of the parser's buffer.
+ */
+void compact_parser(GDMPParser parser) {
+    size_t partial_len = parser->end - parser->start;
+    memmove(parser->buffer, parser->buffer + parser->start, partial_len);
+
+    parser->scan_pos -= parser->start;
+    if (parser->state == PARSER_BATCH) parser->batch_end -= parser->start;
+
+    // The compressed message being read moved too
+    if (parser->state == PARSER_INFLATE) {
+        GDMPDecompressorMoveInput(parser->decompressor, parser->start);
+    }
+    parser->start = 0;
+    parser->end = partial_len;
+}
+
+/**
+ * Allocates a message with room for capacity bytes of header strings.
+ */
+GDMPMessage alloc_message(MessageType type, size_t capacity) {
+    GDMPMessage msg = malloc(sizeof(*msg) + capacity);
+    if (msg == NULL) {
+        perror("malloc");
+        return NULL;
+    }
+
+    msg->type = type;
+    msg->header_count = 0;
+    msg->used = 0;
+    msg->capacity = capacity;
+    msg->index = NULL;
+
+    return msg;
+}
+
+/**
+ * Returns the index of the header with the given name, or -1 if it doesn't exist.
+ */
+int find_header(GDMPMessage msg, const char *name) {
+    if (msg->index != NULL) {
+        uintptr_t pos = (uintptr_t)HashTableGet(msg->index, (char *)name);
+        return (int)pos - 1;
+    }
+
+    uint32_t tag = header_tag(name);
+    for (int i = 0; i < msg->header_count; i++) {
+        if (msg->tags[i] != tag) continue;
+        if (strcmp(msg->data + msg->headers[i].name, name) == 0) return i;
+    }
+
+    return -1;
+}
+
+/**
+ * Points the header whose name is stored at the given offset to a new value,
+ * adding the header if it doesn't exist.
+ * Returns -1 if the message already has the maximum number of headers.
+ */
+int set_header(GDMPMessage msg, size_t name, size_t value) {
+    int idx = find_header(msg, msg->data + name);
+    if (idx == -1) {
+        if (msg->header_count == GDMP_HEADERS_MAX_COUNT) return -1;
+        idx = msg->header_count++;
+        msg->headers[idx].name = name;
+        msg->tags[idx] = header_tag(msg->data + name);
+
+        if (msg->index != NULL) {
+            HashTableInsert(msg->index, msg->data + name, (void *)(uintptr_t)(idx + 1));
+        } else if (msg->header_count > INLINE_HEADERS_MAX) {
+            build_index(msg);
+        }
+    }
+
+    msg->headers[idx].value = value;
+    return 0;
+}
+
+/**
+ * Copies a string into the message's data.
+ * Returns its offset, or -1 if the message has no room left.
+ */
+long append_string(GDMPMessage msg, const char *str) {
+    size_t len = strlen(str) + 1;
+    if (msg->used + len > msg->capacity) return -1;
+
+    long offset = msg->used;
+    memcpy(msg->data + offset, str, len);
+    msg->used += len;
+
+    return offset;
+}
+
+/**
+ * Returns a summary of a header name (its length, first and last characters),
+ * which differs between any two headers of the protocol.
+ */
+uint32_t header_tag(const char *name) {
+    size_t len = strlen(name);
+    if (len == 0) return 0;
+
+    return (uint32_t)len << 16 | (unsigned char)name[0] << 8 | (unsigned char)name[len - 1];
+}
+
+/**
+ * Indexes the message's headers in a hash table, for messages with too many
+ * headers to scan.
+ */
+void build_index(GDMPMessage msg) {
+    msg->index = HashTableNew(GDMP_HEADERS_MAX_COUNT);
+
+    for (int i = 0; i < msg->header_count; i++) {
+        HashTableInsert(msg->index, msg->data + msg->headers[i].name, (void *)(uintptr_t)(i + 1));
+    }
+}
+
+/**
+ * Deserializes the first len bytes of str into a GDMP message.
+ * If type is NULL the first line is the message type,
+ * otherwise every line is a header and the message has the given type.
+ * The bytes are copied into the message's data and split in place,
+ * so headers and values need no further copies.
+ * Lines are split using the delimiters found by the GDMP scanner,
+ * scanning the frame once instead of searching each line separately.
+ */
+GDMPMessage parse_message(const char *str, size_t len, MessageType *type) {
+    GDMPMessage msg = alloc_message(type == NULL ? GDMP_ERROR_MESSAGE : *type, len + 1);
+    if (msg == NULL) return NULL;
+
+    char *buffer = msg->data;
+    memcpy(buffer, str, len);
+    buffer[len] = '\0';
+    msg->used = len + 1;
+
+    bool typed = type != NULL;
+    GDMPDelim delims[SCAN_BATCH_SIZE];
+    size_t line_start = 0;
+    char *separator = NULL;
+    size_t offset = 0;
+    bool done = false;
+
+    while (!done) {
+        size_t count = GDMPScan(buffer + offset, len - offset, delims, SCAN_BATCH_SIZE);
+
+        for (size_t i = 0; i < count; i++) {
+            size_t pos = offset + delims[i].offset;
+
+            // Only the first separator of a line splits header and value
+            if (delims[i].type == GDMP_DELIM_SEPARATOR) {
+                if (typed && separator == NULL) separator = buffer + pos;
+                continue;
+            }
+
+            buffer[pos] = '\0';
+
+            if (!typed) {
+                // Extract message type
+                msg->type = str_to_type(buffer);
+                typed = true;
+            } else if (pos == line_start) {
+                // Exit condition
+                done = true;
+                break;
+            } else if (separator != NULL) {
+                // Set header-value pair (extra headers are dropped)
+                *separator = '\0';
+                set_header(msg, line_start, separator + 2 - buffer);
+            }
+
+            line_start = pos + 1;
+            separator = NULL;
+        }
+
+        if (count < SCAN_BATCH_SIZE) break;
+        offset += delims[count - 1].offset + 1;
+    }
+
+    // Handle a last line without a trailing newline
+    if (!typed) {
+        msg->type = str_to_type(buffer);
+    } else if (!done && separator != NULL) {
+        *separator = '\0';
+        set_header(msg, line_start, separator + 2 - buffer);
+    }
+
+    return msg;
+}
+
 /** 
  * Returns an array of headers used by the given message type (NULL terminated).
  */
@@ -169,7 +714,39 @@ char **get_headers(MessageType type) {
             headers[2] = "Timestamp";
             break;
         case GDMP_JOIN_MESSAGE:
-            // TODO
+            headers[0] = "Username";
+            headers[1] = "Room";
+            break;
+        case GDMP_BATCH_MESSAGE:
+            headers[0] = "Type";
+            headers[1] = "Count";
+            headers[2] = "Length";
+            break;
+        case GDMP_HELLO_MESSAGE:
+            headers[0] = "Compression";
+            break;
+        case GDMP_COMPRESSED_MESSAGE:
+            headers[0] = "Length";
+            break;
+        case GDMP_LEAVE_MESSAGE:
+            headers[0] = "Room";
+            break;
+        case GDMP_DIRECT_MESSAGE:
+            headers[0] = "Username";
+            headers[1] = "Recipient";
+            headers[2] = "Content";
+            headers[3] = "Timestamp";
+            break;
+        case GDMP_REJECT_MESSAGE:
+            headers[0] = "Type";
+            headers[1] = "Reason";
+            break;
+        case GDMP_TYPING_MESSAGE:
+        case GDMP_PRESENCE_MESSAGE:
+            headers[0] = "Room";
+            break;
+        case GDMP_PEER_MESSAGE:
+            headers[0] = "Server";
             break;
         case GDMP_ERROR_MESSAGE:
             break;
@@ -187,6 +764,24 @@ MessageType str_to_type(char *str) {
         return GDMP_TEXT_MESSAGE;
     } else if (strcmp(str, "GDMP_JOIN_MESSAGE") == 0) {
         return GDMP_JOIN_MESSAGE;
+    } else if (strcmp(str, "GDMP_BATCH_MESSAGE") == 0) {
+        return GDMP_BATCH_MESSAGE;
+    } else if (strcmp(str, "GDMP_HELLO_MESSAGE") == 0) {
+        return GDMP_HELLO_MESSAGE;
+    } else if (strcmp(str, "GDMP_COMPRESSED_MESSAGE") == 0) {
+        return GDMP_COMPRESSED_MESSAGE;
+    } else if (strcmp(str, "GDMP_LEAVE_MESSAGE") == 0) {
+        return GDMP_LEAVE_MESSAGE;
+    } else if (strcmp(str, "GDMP_DIRECT_MESSAGE") == 0) {
+        return GDMP_DIRECT_MESSAGE;
+    } else if (strcmp(str, "GDMP_REJECT_MESSAGE") == 0) {
+        return GDMP_REJECT_MESSAGE;
+    } else if (strcmp(str, "GDMP_TYPING_MESSAGE") == 0) {
+        return GDMP_TYPING_MESSAGE;
+    } else if (strcmp(str, "GDMP_PRESENCE_MESSAGE") == 0) {
+        return GDMP_PRESENCE_MESSAGE;
+    } else if (strcmp(str, "GDMP_PEER_MESSAGE") == 0) {
+        return GDMP_PEER_MESSAGE;
     } else {
         return GDMP_ERROR_MESSAGE;
     }
@@ -201,6 +796,24 @@ char *type_to_str(MessageType type) {
         return "GDMP_TEXT_MESSAGE";
     } else if (type == GDMP_JOIN_MESSAGE) {
         return "GDMP_JOIN_MESSAGE";
+    } else if (type == GDMP_BATCH_MESSAGE) {
+        return "GDMP_BATCH_MESSAGE";
+    } else if (type == GDMP_HELLO_MESSAGE) {
+        return "GDMP_HELLO_MESSAGE";
+    } else if (type == GDMP_COMPRESSED_MESSAGE) {
+        return "GDMP_COMPRESSED_MESSAGE";
+    } else if (type == GDMP_LEAVE_MESSAGE) {
+        return "GDMP_LEAVE_MESSAGE";
+    } else if (type == GDMP_DIRECT_MESSAGE) {
+        return "GDMP_DIRECT_MESSAGE";
+    } else if (type == GDMP_REJECT_MESSAGE) {
+        return "GDMP_REJECT_MESSAGE";
+    } else if (type == GDMP_TYPING_MESSAGE) {
+        return "GDMP_TYPING_MESSAGE";
+    } else if (type == GDMP_PRESENCE_MESSAGE) {
+        return "GDMP_PRESENCE_MESSAGE";
+    } else if (type == GDMP_PEER_MESSAGE) {
+        return "GDMP_PEER_MESSAGE";
     } else {
         return NULL;
     }
@@ -0,0 +1,164 @@
+// GDMP Compression Implementation
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <zlib.h>
+
+#include "gdmp_compress.h"
+#include "gdmp.h"
+
+#define COMPRESSED_HEADER_MAX_LEN 64
+
+struct gdmp_compressor {
+    z_stream stream;
+};
+
+struct gdmp_decompressor {
+    z_stream stream;
+};
+
+////////////////////////////////// FUNCTIONS ///////////////////////////////////
+
+GDMPCompressor GDMPCompressorNew(void) {
+    GDMPCompressor comp = calloc(1, sizeof(*comp));
+    if (comp == NULL) {
+        perror("calloc");
+        return NULL;
+    }
+
+    // Negative window bits select raw deflate (no zlib header or checksum)
+    int res = deflateInit2(
+        &comp->stream, GDMP_COMPRESSION_LEVEL, Z_DEFLATED,
+        -GDMP_COMPRESSION_WINDOW_BITS, GDMP_COMPRESSION_MEM_LEVEL, Z_DEFAULT_STRATEGY
+    );
+    if (res != Z_OK) {
+        fprintf(stderr, "deflateInit2: error\n");
+        free(comp);
+        return NULL;
+    }
+
+    return comp;
+}
+
+void GDMPCompressorFree(GDMPCompressor comp) {
+    deflateEnd(&comp->stream);
+    free(comp);
+}
+
+char *GDMPCompress(GDMPCompressor comp, const struct iovec *iov, int iov_count, size_t *len) {
+    size_t in_len = 0;
+    for (int i = 0; i < iov_count; i++) {
+        in_len += iov[i].iov_len;
+    }
+
+    // Leave room for the headers, and the marker added by each flush
+    size_t size = COMPRESSED_HEADER_MAX_LEN + deflateBound(&comp->stream, in_len) + 16;
+    char *msg_str = malloc(size);
+    if (msg_str == NULL) {
+        perror("malloc");
+        return NULL;
+    }
+
+    char *body = msg_str + COMPRESSED_HEADER_MAX_LEN;
+    z_stream *stream = &comp->stream;
+    stream->next_out = (Bytef *)body;
+    stream->avail_out = size - COMPRESSED_HEADER_MAX_LEN;
+
+    for (int i = 0; i < iov_count; i++) {
+        stream->next_in = (Bytef *)iov[i].iov_base;
+        stream->avail_in = iov[i].iov_len;
+
+        // Flush after the last iovec, so the receiver can decompress everything
+        int flush = i == iov_count - 1 ? Z_SYNC_FLUSH : Z_NO_FLUSH;
+        int res = deflate(stream, flush);
+        if (res == Z_STREAM_ERROR || stream->avail_in != 0) {
+            fprintf(stderr, "deflate: error\n");
+            free(msg_str);
+            return NULL;
+        }
+    }
+
+    size_t body_len = (char *)stream->next_out - body;
+
+    // Write the headers right before the body
+    char header[COMPRESSED_HEADER_MAX_LEN];
+    int header_len = snprintf(
+        header, sizeof(header), "GDMP_COMPRESSED_MESSAGE\nLength: %zu\n\n", body_len
+    );
+
+    char *start = body - header_len;
+    memcpy(start, header, header_len);
+    memmove(msg_str, start, header_len + body_len);
+
+    *len = header_len + body_len;
+    return msg_str;
+}
+
+GDMPDecompressor GDMPDecompressorNew(void) {
+    GDMPDecompressor decomp = calloc(1, sizeof(*decomp));
+    if (decomp == NULL) {
+        perror("calloc");
+        return NULL;
+    }
+
+    int res = inflateInit2(&decomp->stream, -GDMP_COMPRESSION_WINDOW_BITS);
+    if (res != Z_OK) {
+        fprintf(stderr, "inflateInit2: error\n");
+        free(decomp);
+        return NULL;
+    }
+
+    return decomp;
+}
+
+void GDMPDecompressorFree(GDMPDecompressor decomp) {
+    inflateEnd(&decomp->stream);
+    free(decomp);
+}
+
+void GDMPDecompressorInput(GDMPDecompressor decomp, const char *data, size_t len) {
+    decomp->stream.next_in = (Bytef *)data;
+    decomp->stream.avail_in = len;
+}
+
+void GDMPDecompressorMoveInput(GDMPDecompressor decomp, size_t offset) {
+    decomp->stream.next_in -= offset;
+}
+
+ssize_t GDMPDecompress(GDMPDecompressor decomp, char *buf, size_t size, bool *done) {
+    z_stream *stream = &decomp->stream;
+    stream->next_out = (Bytef *)buf;
+    stream->avail_out = size;
+
+    int res = inflate(stream, Z_SYNC_FLUSH);
+    if (res != Z_OK && res != Z_BUF_ERROR) {
+        fprintf(stderr, "inflate: error\n");
+        return -1;
+    }
+
+    // With output space left over, inflate has nothing more to give
+    *done = stream->avail_in == 0 && stream->avail_out > 0;
+    return size - stream->avail_out;
+}
+
+ssize_t GDMPDecompressorWindow(GDMPDecompressor decomp, char *buf) {
+    uInt len = GDMP_COMPRESSION_WINDOW_SIZE;
+    if (inflateGetDictionary(&decomp->stream, (Bytef *)buf, &len) != Z_OK) {
+        fprintf(stderr, "inflateGetDictionary: error\n");
+        return -1;
+    }
+
+    return len;
+}
+
+int GDMPDecompressorSetWindow(GDMPDecompressor decomp, const char *window, size_t len) {
+    // A raw stream takes a dictionary at any point
+    if (inflateSetDictionary(&decomp->stream, (const Bytef *)window, len) != Z_OK) {
+        fprintf(stderr, "inflateSetDictionary: error\n");
+        return -1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,173 @@
+// GDMP Scanner Implementation
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <pthread.h>
+
+#include "gdmp_scan.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define GDMP_SCAN_X86 1
+#endif
+
+typedef size_t (*ScanFunction)(const char *, size_t, GDMPDelim *, size_t);
+
+ScanFunction gdmp_scan_function;
+const char *gdmp_scan_name;
+pthread_once_t gdmp_scan_once = PTHREAD_ONCE_INIT;
+
+void select_scan_function(void);
+size_t scan_tail(const char *str, size_t len, size_t start, GDMPDelim *delims, size_t count, size_t max_delims);
+size_t emit_delims(uint32_t nl_mask, uint32_t sep_mask, size_t base, GDMPDelim *delims, size_t count, size_t max_delims);
+
+#ifdef GDMP_SCAN_X86
+size_t scan_sse2(const char *str, size_t len, GDMPDelim *delims, size_t max_delims);
+size_t scan_avx2(const char *str, size_t len, GDMPDelim *delims, size_t max_delims);
+#endif
+
+////////////////////////////////// FUNCTIONS ///////////////////////////////////
+
+size_t GDMPScan(const char *str, size_t len, GDMPDelim *delims, size_t max_delims) {
+    pthread_once(&gdmp_scan_once, select_scan_function);
+    return gdmp_scan_function(str, len, delims, max_delims);
+}
+
+size_t GDMPScanScalar(const char *str, size_t len, GDMPDelim *delims, size_t max_delims) {
+    return scan_tail(str, len, 0, delims, 0, max_delims);
+}
+
+const char *GDMPScanName(void) {
+    pthread_once(&gdmp_scan_once, select_scan_function);
+    return gdmp_scan_name;
+}
+
+////////////////////////////// HELPER FUNCTIONS ////////////////////////////////
+
+/**
+ * Picks the widest implementation supported by the CPU.
+ */
+void select_scan_function(void) {
+    gdmp_scan_function = GDMPScanScalar;
+    gdmp_scan_name = "scalar";
+
+#ifdef GDMP_SCAN_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        gdmp_scan_function = scan_avx2;
+        gdmp_scan_name = "avx2";
+    } else if (__builtin_cpu_supports("sse2")) {
+        gdmp_scan_function = scan_sse2;
+        gdmp_scan_name = "sse2";
+    }
+#endif
+}
+
+/**
+ * Scans str byte by byte from start, appending to the count delimiters
+ * already stored. Returns the new count.
+ */
+size_t scan_tail(const char *str, size_t len, size_t start, GDMPDelim *delims, size_t count, size_t max_delims) {
+    for (size_t i = start; i < len && count < max_delims; i++) {
+        if (str[i] == '\n') {
+            delims[count].offset = i;
+            delims[count].type = GDMP_DELIM_NEWLINE;
+            count++;
+        } else if (str[i] == ':' && i + 1 < len && str[i + 1] == ' ') {
+            delims[count].offset = i;
+            delims[count].type = GDMP_DELIM_SEPARATOR;
+            count++;
+        }
+    }
+
+    return count;
+}
+
+/**
+ * Appends the delimiters marked in a block's bit masks (bit i is the byte at
+ * base + i) in offset order. Returns the new count.
+ */
+size_t emit_delims(uint32_t nl_mask, uint32_t sep_mask, size_t base, GDMPDelim *delims, size_t count, size_t max_delims) {
+    uint32_t mask = nl_mask | sep_mask;
+
+    while (mask != 0 && count < max_delims) {
+        int bit = __builtin_ctz(mask);
+        delims[count].offset = base + bit;
+        delims[count].type = (nl_mask >> bit) & 1 ? GDMP_DELIM_NEWLINE : GDMP_DELIM_SEPARATOR;
+        count++;
+        mask &= mask - 1;
+    }
+
+    return count;
+}
+
+#ifdef GDMP_SCAN_X86
+
+/**
+ * Scans 16 bytes at a time. A separator is a ':' whose next byte is ' ',
+ * so each block is compared against a copy of itself shifted by one byte.
+ */
+__attribute__((target("sse2")))
+size_t scan_sse2(const char *str, size_t len, GDMPDelim *delims, size_t max_delims) {
+    const __m128i newline = _mm_set1_epi8('\n');
+    const __m128i colon = _mm_set1_epi8(':');
+    const __m128i space = _mm_set1_epi8(' ');
+
+    size_t count = 0;
+    size_t i = 0;
+
+    // The shifted load reads one byte past the block, so stop one byte early
+    while (i + 16 < len && count < max_delims) {
+        __m128i block = _mm_loadu_si128((const __m128i *)(str + i));
+        __m128i next = _mm_loadu_si128((const __m128i *)(str + i + 1));
+
+        uint32_t nl_mask = _mm_movemask_epi8(_mm_cmpeq_epi8(block, newline));
+        uint32_t sep_mask = _mm_movemask_epi8(_mm_and_si128(
+            _mm_cmpeq_epi8(block, colon), _mm_cmpeq_epi8(next, space)
+        ));
+
+        if ((nl_mask | sep_mask) != 0) {
+            count = emit_delims(nl_mask, sep_mask, i, delims, count, max_delims);
+        }
+
+        i += 16;
+    }
+
+    if (count == max_delims) return count;
+    return scan_tail(str, len, i, delims, count, max_delims);
+}
+
+/**
+ * Same as scan_sse2, 32 bytes at a time.
+ */
+__attribute__((target("avx2")))
+size_t scan_avx2(const char *str, size_t len, GDMPDelim *delims, size_t max_delims) {
+    const __m256i newline = _mm256_set1_epi8('\n');
+    const __m256i colon = _mm256_set1_epi8(':');
+    const __m256i space = _mm256_set1_epi8(' ');
+
+    size_t count = 0;
+    size_t i = 0;
+
+    while (i + 32 < len && count < max_delims) {
+        __m256i block = _mm256_loadu_si256((const __m256i *)(str + i));
+        __m256i next = _mm256_loadu_si256((const __m256i *)(str + i + 1));
+
+        uint32_t nl_mask = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(block, newline));
+        uint32_t sep_mask = (uint32_t)_mm256_movemask_epi8(_mm256_and_si256(
+            _mm256_cmpeq_epi8(block, colon), _mm256_cmpeq_epi8(next, space)
+        ));
+
+        if ((nl_mask | sep_mask) != 0) {
+            count = emit_delims(nl_mask, sep_mask, i, delims, count, max_delims);
+        }
+
+        i += 32;
+    }
+
+    if (count == max_delims) return count;
+    return scan_tail(str, len, i, delims, count, max_delims);
+}
+
+#endif
@@ -3,40 +3,60 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
 
 #include "hash_table.h"
 
-#define RESIZE_FACTOR 4
+#define MIN_SLOTS 8
+#define MAX_LOAD_NUM 3 // Grows beyond 3/4 full
+#define MAX_LOAD_DEN 4
+
+#define FNV_OFFSET 14695981039346656037ULL
+#define FNV_PRIME 1099511628211ULL
 
 struct hash_table {
 	struct slot *slots;
-	int num_slots;
+	int num_slots; // Always a power of two
+	int count;
 };
 
 struct slot {
 	Key key;
 	Value value;
-	bool empty;
+	uint64_t hash; // Cached, to skip comparing keys that can't match
+	bool used;
 };
 
-int hash(Key key, int num_slots);
-bool key_compare(Key key1, Key key2);
+uint64_t hash_table_seed;
+pthread_once_t hash_table_seed_once = PTHREAD_ONCE_INIT;
+
+void init_seed(void);
+uint64_t hash(Key key);
+int find_slot(HashTable ht, Key key, uint64_t key_hash);
+void grow(HashTable ht);
+struct slot *new_slots(int num_slots);
 
 ////////////////////////////////// FUNCTIONS ///////////////////////////////////
 
 HashTable HashTableNew(int num_slots) {
+    pthread_once(&hash_table_seed_once, init_seed);
+
     HashTable ht = malloc(sizeof(struct hash_table));
     if (ht == NULL) {
         perror("malloc");
 		exit(EXIT_FAILURE);
     }
 
-    ht->slots = malloc(num_slots * RESIZE_FACTOR * sizeof(struct slot));
-    ht->num_slots = num_slots * RESIZE_FACTOR;
+    // Start with enough slots to hold num_slots keys below the max load
+    int size = MIN_SLOTS;
+    while (size * MAX_LOAD_NUM < num_slots * MAX_LOAD_DEN) size *= 2;
 
-    for (int i = 0; i < ht->num_slots; i++) {
-        ht->slots[i].empty = true;
-	}
+    ht->slots = new_slots(size);
+    ht->num_slots = size;
+    ht->count = 0;
 
     return ht;
 }
@@ -47,43 +67,65 @@ void HashTableFree(HashTable ht) {
 }
 
 void HashTableInsert(HashTable ht, Key key, Value value) {
-    int idx = hash(key, ht->num_slots);
+    uint64_t key_hash = hash(key);
+    int idx = find_slot(ht, key, key_hash);
 
-    for (int i = 0; i < ht->num_slots; i++) {
-        if (ht->slots[idx].empty || key_compare(ht->slots[idx].key, key)) {
-            struct slot new_slot = {key, value, false};
-            ht->slots[idx] = new_slot;
-            break;
-        }
+    // Replace the value if key already exists
+    if (ht->slots[idx].used) {
+        ht->slots[idx].value = value;
+        return;
+    }
 
-        idx = (idx + 1) % ht->num_slots;
+    if ((ht->count + 1) * MAX_LOAD_DEN > ht->num_slots * MAX_LOAD_NUM) {
+        grow(ht);
+        idx = find_slot(ht, key, key_hash);
     }
+
+    struct slot new_slot = {key, value, key_hash, true};
+    ht->slots[idx] = new_slot;
+    ht->count++;
 }
 
 bool HashTableContains(HashTable ht, Key key) {
-    int idx = hash(key, ht->num_slots);
-
-    for (int i = 0; i < ht->num_slots; i++) {
-        if (ht->slots[idx].empty) break;
-        if (key_compare(ht->slots[idx].key, key)) return true;
-        
-        idx = (idx + 1) % ht->num_slots;
-    }
-
-    return false;
+    int idx = find_slot(ht, key, hash(key));
+    return ht->slots[idx].used;
 }
 
 Value HashTableGet(HashTable ht, Key key) {
-    int idx = hash(key, ht->num_slots);
+    int idx = find_slot(ht, key, hash(key));
+    return ht->slots[idx].used ? ht->slots[idx].value : NULL;
+}
 
-    for (int i = 0; i < ht->num_slots; i++) {
-        if (ht->slots[idx].empty) break;
-        if (key_compare(ht->slots[idx].key, key)) return ht->slots[idx].value;
-        
-        idx = (idx + 1) % ht->num_slots;
+bool HashTableDelete(HashTable ht, Key key) {
+    int idx = find_slot(ht, key, hash(key));
+    if (!ht->slots[idx].used) return false;
+
+    // Shift back the following keys that probed past the removed one,
+    // so lookups never need tombstones
+    int mask = ht->num_slots - 1;
+    int next = idx;
+    while (true) {
+        next = (next + 1) & mask;
+        if (!ht->slots[next].used) break;
+
+        // Keys whose home slot is cyclically within (idx, next] stay put
+        int home = ht->slots[next].hash & mask;
+        bool in_place = idx <= next
+            ? (idx < home && home <= next)
+            : (idx < home || home <= next);
+        if (in_place) continue;
+
+        ht->slots[idx] = ht->slots[next];
+        idx = next;
     }
 
-    return NULL;
+    ht->slots[idx].used = false;
+    ht->count--;
+    return true;
+}
+
+int HashTableSize(HashTable ht) {
+    return ht->count;
 }
 
 HashTable HashTableCopy(HashTable table) {
@@ -93,31 +135,123 @@ HashTable HashTableCopy(HashTable table) {
 		exit(EXIT_FAILURE);
     }
 
-    copy->slots = malloc(table->num_slots * RESIZE_FACTOR * sizeof(struct slot));
-    copy->num_slots = table->num_slots;
+    copy->slots = malloc(table->num_slots * sizeof(struct slot));
+    if (copy->slots == NULL) {
+        perror("malloc");
+		exit(EXIT_FAILURE);
+    }
 
-    for (int i = 0; i < copy->num_slots; i++) {
-        copy->slots[i] = table->slots[i];
-	}
+    memcpy(copy->slots, table->slots, table->num_slots * sizeof(struct slot));
+    copy->num_slots = table->num_slots;
+    copy->count = table->count;
 
     return copy;
 }
 
+HashTableIterator HashTableIterate(HashTable table) {
+    HashTableIterator it = {table, 0};
+    return it;
+}
+
+bool HashTableNext(HashTableIterator *it, Key *key, Value *value) {
+    HashTable ht = it->table;
+
+    while (it->idx < ht->num_slots) {
+        struct slot *slot = &ht->slots[it->idx];
+        it->idx++;
+
+        if (slot->used) {
+            *key = slot->key;
+            *value = slot->value;
+            return true;
+        }
+    }
+
+    return false;
+}
+
 ////////////////////////////// HELPER FUNCTIONS ////////////////////////////////
 
+/**
+ * Picks the seed mixed into every hash, so colliding keys can't be
+ * prepared in advance.
+ */
+void init_seed(void) {
+    hash_table_seed = (uint64_t)time(NULL) * FNV_PRIME ^ (uint64_t)getpid();
+}
+
 /**
  * Hash function for the hash table.
- * Sums the ASCII value of each character of the key.
+ * Seeded FNV-1a, followed by a final mix so the low bits (used to pick
+ * the slot) depend on every byte of the key.
+ */
+uint64_t hash(Key key) {
+    uint64_t h = FNV_OFFSET ^ hash_table_seed;
+    while (*key) {
+        h ^= (unsigned char)*key++;
+        h *= FNV_PRIME;
+    }
+
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    return h;
+}
+
+/**
+ * Returns the index of the slot holding the key,
+ * or of the empty slot where it would be inserted.
+ */
+int find_slot(HashTable ht, Key key, uint64_t key_hash) {
+    int mask = ht->num_slots - 1;
+    int idx = key_hash & mask;
+
+    while (ht->slots[idx].used) {
+        struct slot *slot = &ht->slots[idx];
+        if (slot->hash == key_hash && strcmp(slot->key, key) == 0) break;
+        idx = (idx + 1) & mask;
+    }
+
+    return idx;
+}
+
+/**
+ * Doubles the number of slots, reinserting every key with its cached hash.
  */
-int hash(Key key, int num_slots) {
-    int hash = 0;
-    while (*key) hash += *key++;
-    return hash % num_slots;
+void grow(HashTable ht) {
+    struct slot *old_slots = ht->slots;
+    int old_num_slots = ht->num_slots;
+
+    ht->num_slots *= 2;
+    ht->slots = new_slots(ht->num_slots);
+
+    int mask = ht->num_slots - 1;
+    for (int i = 0; i < old_num_slots; i++) {
+        if (!old_slots[i].used) continue;
+
+        int idx = old_slots[i].hash & mask;
+        while (ht->slots[idx].used) idx = (idx + 1) & mask;
+        ht->slots[idx] = old_slots[i];
+    }
+
+    free(old_slots);
 }
 
 /**
- * Checks if two keys are equal.
+ * Allocates the given number of empty slots.
  */
-bool key_compare(Key key1, Key key2) {
-    return strcmp(key1, key2) == 0;                     
+struct slot *new_slots(int num_slots) {
+    struct slot *slots = malloc(num_slots * sizeof(struct slot));
+    if (slots == NULL) {
+        perror("malloc");
+		exit(EXIT_FAILURE);
+    }
+
+    for (int i = 0; i < num_slots; i++) {
+        slots[i].used = false;
+	}
+
+    return slots;
 }
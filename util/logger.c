@@ -0,0 +1,472 @@
+// Logger Implementation
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <pthread.h>
+#include <time.h>
+#include <sys/types.h>
+
+#include "logger.h"
+
+#define LOGGER_CACHE_LINE 64
+#define LOGGER_SPEC_MAX_LEN 32
+
+/**
+ * A record logged by a thread: its format, and its arguments packed one after
+ * another (integers, pointers and doubles as 8 bytes, and strings as their
+ * characters and a null terminator).
+ */
+struct log_record {
+    uint64_t time; // When it was logged (in ns), to order the records of every ring
+    const char *format;
+    LogLevel level;
+    size_t args_len;
+    char args[LOGGER_ARGS_SIZE];
+};
+
+/**
+ * The records logged by one thread, read by the background thread.
+ * Each index only counts up, and only one side writes it.
+ */
+struct log_ring {
+    _Alignas(LOGGER_CACHE_LINE) atomic_size_t head; // Next record to read
+    _Alignas(LOGGER_CACHE_LINE) atomic_size_t tail; // Next record to write
+    atomic_ulong dropped;
+    pthread_t thread;
+    struct log_record records[LOGGER_RING_SIZE];
+};
+
+struct logger {
+    unsigned long id; // Never reused, unlike the logger's address
+    FILE *out;
+    FILE *err;
+    atomic_int level;
+    struct log_ring *rings[LOGGER_MAX_THREADS];
+    atomic_int ring_count;
+    atomic_ulong dropped; // By threads without a ring
+    pthread_mutex_t lock; // Adding rings
+    pthread_t writer;
+    atomic_bool stop;
+};
+
+/**
+ * A conversion in a format (from its % up to its conversion character).
+ */
+struct log_spec {
+    const char *start;
+    size_t prefix_len; // Of its flags, width and precision (and the %)
+    char length; // 0 for int (or shorter), 'l', 'L' (long long), 'z', 'j' or 't'
+    char conversion; // Or 0, if it isn't one this takes
+};
+
+char *log_level_names[] = {"debug", "info", "warn", "error"};
+
+atomic_ulong logger_count;
+_Thread_local unsigned long log_ring_logger; // Whose ring this thread has (by id)
+_Thread_local struct log_ring *log_ring;
+
+struct log_ring *log_ring_for(Logger logger);
+uint64_t log_time(void);
+const char *parse_log_spec(const char *p, struct log_spec *spec);
+size_t pack_log_args(char *args, const char *format, va_list *ap);
+size_t format_log_record(struct log_record *record, char *line, size_t size);
+void *write_logs(void *arg);
+void write_log_records(Logger logger);
+
+////////////////////////////////// FUNCTIONS ///////////////////////////////////
+
+Logger LoggerNew(FILE *out, FILE *err, LogLevel level) {
+    Logger logger = malloc(sizeof(struct logger));
+    if (logger == NULL) {
+        perror("malloc");
+        return NULL;
+    }
+
+    logger->id = atomic_fetch_add(&logger_count, 1) + 1;
+    logger->out = out;
+    logger->err = err;
+    atomic_init(&logger->level, level);
+    atomic_init(&logger->ring_count, 0);
+    atomic_init(&logger->dropped, 0);
+    atomic_init(&logger->stop, false);
+    pthread_mutex_init(&logger->lock, NULL);
+
+    if (pthread_create(&logger->writer, NULL, write_logs, logger) != 0) {
+        fprintf(stderr, "pthread_create: error\n");
+        pthread_mutex_destroy(&logger->lock);
+        free(logger);
+        return NULL;
+    }
+
+    return logger;
+}
+
+void LoggerFree(Logger logger) {
+    atomic_store(&logger->stop, true);
+    pthread_join(logger->writer, NULL);
+
+    int count = atomic_load(&logger->ring_count);
+    for (int i = 0; i < count; i++) {
+        free(logger->rings[i]);
+    }
+
+    pthread_mutex_destroy(&logger->lock);
+    free(logger);
+}
+
+void LoggerLog(Logger logger, LogLevel level, const char *format, ...) {
+    if (level < atomic_load_explicit(&logger->level, memory_order_relaxed)) return;
+
+    struct log_ring *ring = log_ring_for(logger);
+    if (ring == NULL) {
+        atomic_fetch_add_explicit(&logger->dropped, 1, memory_order_relaxed);
+        return;
+    }
+
+    // Acquire the head, so the background thread is done with the record
+    // before it's written again
+    size_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    if (tail - atomic_load_explicit(&ring->head, memory_order_acquire) == LOGGER_RING_SIZE) {
+        atomic_fetch_add_explicit(&ring->dropped, 1, memory_order_relaxed);
+        return;
+    }
+
+    struct log_record *record = &ring->records[tail % LOGGER_RING_SIZE];
+    record->time = log_time();
+    record->format = format;
+    record->level = level;
+
+    va_list args;
+    va_start(args, format);
+    record->args_len = pack_log_args(record->args, format, &args);
+    va_end(args);
+
+    // Release the tail, so the record is written before it's read
+    atomic_store_explicit(&ring->tail, tail + 1, memory_order_release);
+}
+
+void LoggerSetLevel(Logger logger, LogLevel level) {
+    atomic_store_explicit(&logger->level, level, memory_order_relaxed);
+}
+
+LogLevel LoggerLevel(Logger logger) {
+    return atomic_load_explicit(&logger->level, memory_order_relaxed);
+}
+
+int LoggerLevelNamed(const char *name) {
+    for (int i = LOG_DEBUG; i <= LOG_ERROR; i++) {
+        if (strcmp(name, log_level_names[i]) == 0) return i;
+    }
+
+    return -1;
+}
+
+unsigned long LoggerDropped(Logger logger) {
+    unsigned long dropped = atomic_load_explicit(&logger->dropped, memory_order_relaxed);
+
+    int count = atomic_load_explicit(&logger->ring_count, memory_order_acquire);
+    for (int i = 0; i < count; i++) {
+        dropped += atomic_load_explicit(&logger->rings[i]->dropped, memory_order_relaxed);
+    }
+
+    return dropped;
+}
+
+////////////////////////////// HELPER FUNCTIONS ////////////////////////////////
+
+/**
+ * Returns the calling thread's ring in a logger, adding one the first time
+ * (or NULL, if it can't).
+ */
+struct log_ring *log_ring_for(Logger logger) {
+    if (log_ring_logger == logger->id) return log_ring;
+
+    pthread_mutex_lock(&logger->lock);
+
+    // The thread may have logged to another logger since it last logged here
+    struct log_ring *ring = NULL;
+    int count = atomic_load_explicit(&logger->ring_count, memory_order_relaxed);
+    for (int i = 0; i < count; i++) {
+        if (pthread_equal(logger->rings[i]->thread, pthread_self())) ring = logger->rings[i];
+    }
+
+    if (ring == NULL && count < LOGGER_MAX_THREADS) {
+        ring = aligned_alloc(LOGGER_CACHE_LINE, sizeof(struct log_ring));
+        if (ring == NULL) {
+            perror("aligned_alloc");
+        } else {
+            atomic_init(&ring->head, 0);
+            atomic_init(&ring->tail, 0);
+            atomic_init(&ring->dropped, 0);
+            ring->thread = pthread_self();
+
+            // Release the count, so the ring is set up before it's read
+            logger->rings[count] = ring;
+            atomic_store_explicit(&logger->ring_count, count + 1, memory_order_release);
+        }
+    }
+
+    pthread_mutex_unlock(&logger->lock);
+
+    if (ring != NULL) {
+        log_ring_logger = logger->id;
+        log_ring = ring;
+    }
+
+    return ring;
+}
+
+/**
+ * Returns the monotonic time in ns.
+ */
+uint64_t log_time(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/**
+ * Parses the conversion starting at p (at its %) into spec.
+ * Returns where the conversion ends.
+ */
+const char *parse_log_spec(const char *p, struct log_spec *spec) {
+    spec->start = p++;
+
+    while (*p != '\0' && strchr("-+ #0", *p) != NULL) p++;
+    while (*p >= '0' && *p <= '9') p++;
+    if (*p == '.') {
+        p++;
+        while (*p >= '0' && *p <= '9') p++;
+    }
+    spec->prefix_len = p - spec->start;
+
+    spec->length = 0;
+    if (*p == 'h') {
+        p += p[1] == 'h' ? 2 : 1;
+    } else if (*p == 'l') {
+        spec->length = p[1] == 'l' ? 'L' : 'l';
+        p += p[1] == 'l' ? 2 : 1;
+    } else if (*p == 'z' || *p == 'j' || *p == 't') {
+        spec->length = *p++;
+    }
+
+    spec->conversion = *p != '\0' && strchr("%diuxXocspfeEgG", *p) != NULL ? *p : 0;
+
+    return *p != '\0' ? p + 1 : p;
+}
+
+/**
+ * Packs the arguments of a format into args (LOGGER_ARGS_SIZE bytes),
+ * stopping at the first one that doesn't fit. Returns the bytes packed.
+ */
+size_t pack_log_args(char *args, const char *format, va_list *ap) {
+    size_t len = 0;
+
+    for (const char *p = format; *p != '\0';) {
+        if (*p != '%') {
+            p++;
+            continue;
+        }
+
+        struct log_spec spec;
+        p = parse_log_spec(p, &spec);
+
+        if (spec.conversion == '%') continue;
+        if (spec.conversion == 0) break;
+
+        if (spec.conversion == 's') {
+            const char *s = va_arg(*ap, const char *);
+            if (s == NULL) s = "(null)";
+
+            size_t room = LOGGER_ARGS_SIZE - len;
+            if (room == 0) break;
+
+            size_t n = strlen(s);
+            if (n >= room) n = room - 1;
+
+            memcpy(args + len, s, n);
+            args[len + n] = '\0';
+            len += n + 1;
+            continue;
+        }
+
+        if (LOGGER_ARGS_SIZE - len < 8) break;
+
+        if (strchr("feEgG", spec.conversion) != NULL) {
+            double value = va_arg(*ap, double);
+            memcpy(args + len, &value, 8);
+        } else if (spec.conversion == 'p') {
+            uint64_t value = (uintptr_t)va_arg(*ap, void *);
+            memcpy(args + len, &value, 8);
+        } else if (strchr("dic", spec.conversion) != NULL) {
+            int64_t value;
+            switch (spec.length) {
+            case 'l': value = va_arg(*ap, long); break;
+            case 'L': value = va_arg(*ap, long long); break;
+            case 'z': value = va_arg(*ap, ssize_t); break;
+            case 'j': value = va_arg(*ap, intmax_t); break;
+            case 't': value = va_arg(*ap, ptrdiff_t); break;
+            default: value = va_arg(*ap, int);
+            }
+            memcpy(args + len, &value, 8);
+        } else {
+            uint64_t value;
+            switch (spec.length) {
+            case 'l': value = va_arg(*ap, unsigned long); break;
+            case 'L': value = va_arg(*ap, unsigned long long); break;
+            case 'z': value = va_arg(*ap, size_t); break;
+            case 'j': value = va_arg(*ap, uintmax_t); break;
+            case 't': value = va_arg(*ap, ptrdiff_t); break;
+            default: value = va_arg(*ap, unsigned int);
+            }
+            memcpy(args + len, &value, 8);
+        }
+        len += 8;
+    }
+
+    return len;
+}
+
+/**
+ * Formats a record into line (of the given size, at least 2), ending it with
+ * a newline. Arguments that didn't fit in the record are left out (with the
+ * rest of the format), and "..." is written instead. Returns the line's length.
+ */
+size_t format_log_record(struct log_record *record, char *line, size_t size) {
+    size_t n = 0;
+    size_t off = 0; // In the record's arguments
+    size_t max = size - 2; // Leaving room for the newline and null terminator
+
+    for (const char *p = record->format; *p != '\0' && n < max;) {
+        if (*p != '%') {
+            line[n++] = *p++;
+            continue;
+        }
+
+        struct log_spec spec;
+        p = parse_log_spec(p, &spec);
+
+        if (spec.conversion == '%') {
+            line[n++] = '%';
+            continue;
+        }
+
+        // The spec, with the argument's (packed) length
+        char format[LOGGER_SPEC_MAX_LEN];
+        bool integer = strchr("diouxX", spec.conversion) != NULL;
+        if (spec.prefix_len > LOGGER_SPEC_MAX_LEN - 4) spec.conversion = 0;
+        snprintf(format, sizeof(format), "%.*s%s%c", (int)spec.prefix_len, spec.start, integer ? "ll" : "", spec.conversion);
+
+        size_t left = record->args_len - off;
+        bool packed = spec.conversion != 0 && (spec.conversion == 's' ? left > 0 : left >= 8);
+        if (!packed) {
+            n += snprintf(line + n, max + 1 - n, "...");
+            break;
+        }
+
+        int written;
+        if (spec.conversion == 's') {
+            char *s = record->args + off;
+            written = snprintf(line + n, max + 1 - n, format, s);
+            off += strlen(s) + 1;
+        } else {
+            uint64_t value;
+            memcpy(&value, record->args + off, 8);
+            off += 8;
+
+            if (strchr("feEgG", spec.conversion) != NULL) {
+                double d;
+                memcpy(&d, &value, 8);
+                written = snprintf(line + n, max + 1 - n, format, d);
+            } else if (spec.conversion == 'p') {
+                written = snprintf(line + n, max + 1 - n, format, (void *)(uintptr_t)value);
+            } else if (spec.conversion == 'c') {
+                written = snprintf(line + n, max + 1 - n, format, (int)value);
+            } else if (spec.conversion == 'd' || spec.conversion == 'i') {
+                written = snprintf(line + n, max + 1 - n, format, (long long)value);
+            } else {
+                written = snprintf(line + n, max + 1 - n, format, (unsigned long long)value);
+            }
+        }
+
+        if (written > 0) n += written;
+    }
+
+    if (n > max) n = max;
+    line[n++] = '\n';
+    line[n] = '\0';
+
+    return n;
+}
+
+/**
+ * Writes the records of a logger's rings every LOGGER_FLUSH_MS,
+ * until it's stopped.
+ */
+void *write_logs(void *arg) {
+    Logger logger = (Logger)arg;
+    struct timespec pause = {0, LOGGER_FLUSH_MS * 1000000L};
+
+    while (!atomic_load(&logger->stop)) {
+        write_log_records(logger);
+        nanosleep(&pause, NULL);
+    }
+
+    // The records logged before the logger stopped
+    write_log_records(logger);
+
+    return NULL;
+}
+
+/**
+ * Writes the records in a logger's rings, oldest first.
+ */
+void write_log_records(Logger logger) {
+    size_t heads[LOGGER_MAX_THREADS];
+    size_t tails[LOGGER_MAX_THREADS];
+
+    // Only the records in the rings now, so a busy thread can't hold up the
+    // flush (the rest are written next time)
+    int count = atomic_load_explicit(&logger->ring_count, memory_order_acquire);
+    for (int i = 0; i < count; i++) {
+        heads[i] = atomic_load_explicit(&logger->rings[i]->head, memory_order_relaxed);
+        tails[i] = atomic_load_explicit(&logger->rings[i]->tail, memory_order_acquire);
+    }
+
+    bool written = false;
+    char line[LOGGER_LINE_MAX_LEN];
+
+    while (true) {
+        int oldest = -1;
+        for (int i = 0; i < count; i++) {
+            if (heads[i] == tails[i]) continue;
+
+            struct log_record *record = &logger->rings[i]->records[heads[i] % LOGGER_RING_SIZE];
+            if (oldest == -1 || record->time < logger->rings[oldest]->records[heads[oldest] % LOGGER_RING_SIZE].time) {
+                oldest = i;
+            }
+        }
+        if (oldest == -1) break;
+
+        struct log_record *record = &logger->rings[oldest]->records[heads[oldest] % LOGGER_RING_SIZE];
+        size_t len = format_log_record(record, line, sizeof(line));
+        fwrite(line, 1, len, record->level >= LOG_WARN ? logger->err : logger->out);
+        written = true;
+
+        // Release the head, so the record is read before it's written again
+        heads[oldest]++;
+        atomic_store_explicit(&logger->rings[oldest]->head, heads[oldest], memory_order_release);
+    }
+
+    if (written) {
+        fflush(logger->out);
+        fflush(logger->err);
+    }
+}
@@ -0,0 +1,389 @@
+// Message Bus Implementation
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <limits.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+#include "message_bus.h"
+
+#define BUS_MAGIC 0x42444d47 // "GDMB"
+#define BUS_PADDING UINT32_MAX // Length of the record filling the end of the ring
+#define BUS_ALIGN 16 // The size of a record header, so one always fits before the end
+#define CACHE_LINE 64
+
+/**
+ * A consumer's slot, on its own cache line.
+ */
+struct bus_consumer {
+    _Atomic(int32_t) pid; // 0 while the slot is free
+    _Atomic(uint64_t) cursor; // Position of the next record to read
+} __attribute__((aligned(CACHE_LINE)));
+
+/**
+ * The start of the shared memory, followed by the ring.
+ * Positions keep increasing, a record at position p is at p % size in the ring.
+ */
+struct bus_shared {
+    uint32_t magic; // Set once the rest is initialised
+    uint64_t size;
+    pthread_mutex_t publish_lock; // Process-shared, and robust
+    uint64_t next_seq;
+
+    // Records below head are published, those below reserved may be
+    // being written (over the oldest ones)
+    _Atomic(uint64_t) reserved __attribute__((aligned(CACHE_LINE)));
+    _Atomic(uint64_t) head;
+
+    // Futex, bumped after each publish
+    _Atomic(uint32_t) wake __attribute__((aligned(CACHE_LINE)));
+    _Atomic(uint32_t) waiters;
+
+    struct bus_consumer consumers[MESSAGE_BUS_MAX_CONSUMERS];
+};
+
+/**
+ * The header of a record, followed by len bytes of data (and padding,
+ * up to BUS_ALIGN bytes).
+ */
+struct bus_record {
+    uint32_t len;
+    uint32_t consumer; // That published it
+    uint64_t seq;
+};
+
+struct message_bus {
+    int fd;
+    struct bus_shared *shared;
+    size_t map_len;
+    char *ring;
+    uint64_t size;
+    int consumer;
+    uint64_t cursor;
+    uint64_t next_seq;
+    unsigned long lost;
+    char buffer[MESSAGE_BUS_RECORD_MAX_LEN + 1];
+};
+
+int map_bus(MessageBus bus, size_t size);
+int init_bus(struct bus_shared *shared, size_t size);
+int join_bus(MessageBus bus);
+void lock_bus(struct bus_shared *shared);
+bool read_record(MessageBus bus, uint64_t head, BusVisit visit, void *arg);
+void wait_bus(MessageBus bus, int timeout_ms);
+size_t record_len(size_t len);
+
+////////////////////////////////// FUNCTIONS ///////////////////////////////////
+
+MessageBus MessageBusOpen(const char *name, size_t size) {
+    if (size < 2 * record_len(MESSAGE_BUS_RECORD_MAX_LEN) || (size & (size - 1)) != 0) {
+        fprintf(stderr, "MessageBusOpen: invalid size\n");
+        return NULL;
+    }
+
+    MessageBus bus = malloc(sizeof(struct message_bus));
+    if (bus == NULL) {
+        perror("malloc");
+        return NULL;
+    }
+
+    char path[PATH_MAX];
+    snprintf(path, sizeof(path), "%s%s", MESSAGE_BUS_DIR, name);
+
+    bus->fd = open(path, O_RDWR | O_CREAT, 0600);
+    if (bus->fd == -1) {
+        perror("open");
+        free(bus);
+        return NULL;
+    }
+
+    // Map the bus (creating it first if needed)
+    int res = map_bus(bus, size);
+    if (res == -1) {
+        fprintf(stderr, "map_bus: error\n");
+        close(bus->fd);
+        free(bus);
+        return NULL;
+    }
+
+    res = join_bus(bus);
+    if (res == -1) {
+        fprintf(stderr, "MessageBusOpen: too many consumers\n");
+        munmap(bus->shared, bus->map_len);
+        close(bus->fd);
+        free(bus);
+        return NULL;
+    }
+
+    bus->lost = 0;
+
+    return bus;
+}
+
+void MessageBusClose(MessageBus bus) {
+    atomic_store(&bus->shared->consumers[bus->consumer].pid, 0);
+
+    munmap(bus->shared, bus->map_len);
+    close(bus->fd);
+    free(bus);
+}
+
+int MessageBusPublish(MessageBus bus, const char *data, size_t len) {
+    if (len > MESSAGE_BUS_RECORD_MAX_LEN) return -1;
+
+    struct bus_shared *shared = bus->shared;
+    lock_bus(shared);
+
+    uint64_t pos = atomic_load_explicit(&shared->head, memory_order_relaxed);
+    uint64_t offset = pos & (bus->size - 1);
+    size_t rec_len = record_len(len);
+
+    // A record isn't split over the end of the ring, padding fills it instead
+    size_t pad = offset + rec_len > bus->size ? bus->size - offset : 0;
+
+    // Mark what is about to be overwritten before writing over it
+    atomic_store_explicit(&shared->reserved, pos + pad + rec_len, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+
+    if (pad > 0) {
+        struct bus_record padding = { BUS_PADDING, bus->consumer, 0 };
+        memcpy(bus->ring + offset, &padding, sizeof(padding));
+        pos += pad;
+        offset = 0;
+    }
+
+    struct bus_record record = { len, bus->consumer, shared->next_seq++ };
+    memcpy(bus->ring + offset, &record, sizeof(record));
+    memcpy(bus->ring + offset + sizeof(record), data, len);
+
+    atomic_store_explicit(&shared->head, pos + rec_len, memory_order_release);
+    pthread_mutex_unlock(&shared->publish_lock);
+
+    // Only wake consumers (a system call) if one is waiting
+    atomic_fetch_add(&shared->wake, 1);
+    if (atomic_load(&shared->waiters) > 0) {
+        syscall(SYS_futex, &shared->wake, FUTEX_WAKE, INT_MAX, NULL, NULL, 0);
+    }
+
+    return 0;
+}
+
+int MessageBusRead(MessageBus bus, BusVisit visit, void *arg, int timeout_ms) {
+    struct bus_shared *shared = bus->shared;
+
+    uint64_t head = atomic_load_explicit(&shared->head, memory_order_acquire);
+    if (bus->cursor == head && timeout_ms > 0) {
+        wait_bus(bus, timeout_ms);
+        head = atomic_load_explicit(&shared->head, memory_order_acquire);
+    }
+
+    int count = 0;
+    while (bus->cursor != head) {
+        if (read_record(bus, head, visit, arg)) count++;
+    }
+
+    atomic_store_explicit(&shared->consumers[bus->consumer].cursor, bus->cursor, memory_order_release);
+    return count;
+}
+
+unsigned long MessageBusLost(MessageBus bus) {
+    return bus->lost;
+}
+
+////////////////////////////// HELPER FUNCTIONS ////////////////////////////////
+
+/**
+ * Maps the bus' file, initialising it if it's new (or was never finished).
+ * Processes opening the bus at the same time wait on a file lock.
+ * Returns -1 on error.
+ */
+int map_bus(MessageBus bus, size_t size) {
+    flock(bus->fd, LOCK_EX);
+
+    struct stat st;
+    if (fstat(bus->fd, &st) == -1) {
+        perror("fstat");
+        flock(bus->fd, LOCK_UN);
+        return -1;
+    }
+
+    // An existing bus keeps its size
+    bool created = (size_t)st.st_size <= sizeof(struct bus_shared);
+    if (created) {
+        if (ftruncate(bus->fd, sizeof(struct bus_shared) + size) == -1) {
+            perror("ftruncate");
+            flock(bus->fd, LOCK_UN);
+            return -1;
+        }
+    } else {
+        size = st.st_size - sizeof(struct bus_shared);
+    }
+
+    bus->map_len = sizeof(struct bus_shared) + size;
+    bus->shared = mmap(NULL, bus->map_len, PROT_READ | PROT_WRITE, MAP_SHARED, bus->fd, 0);
+    if (bus->shared == MAP_FAILED) {
+        perror("mmap");
+        flock(bus->fd, LOCK_UN);
+        return -1;
+    }
+
+    if (bus->shared->magic != BUS_MAGIC && init_bus(bus->shared, size) == -1) {
+        munmap(bus->shared, bus->map_len);
+        flock(bus->fd, LOCK_UN);
+        return -1;
+    }
+
+    flock(bus->fd, LOCK_UN);
+
+    bus->ring = (char *)(bus->shared + 1);
+    bus->size = bus->shared->size;
+    return 0;
+}
+
+/**
+ * Initialises the shared state of a new bus. Returns -1 on error.
+ */
+int init_bus(struct bus_shared *shared, size_t size) {
+    memset(shared, 0, sizeof(*shared));
+    shared->size = size;
+
+    pthread_mutexattr_t attr;
+    pthread_mutexattr_init(&attr);
+    pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+    pthread_mutexattr_setrobust(&attr, PTHREAD_MUTEX_ROBUST);
+    int res = pthread_mutex_init(&shared->publish_lock, &attr);
+    pthread_mutexattr_destroy(&attr);
+    if (res != 0) {
+        fprintf(stderr, "pthread_mutex_init: error\n");
+        return -1;
+    }
+
+    atomic_thread_fence(memory_order_release);
+    shared->magic = BUS_MAGIC;
+    return 0;
+}
+
+/**
+ * Takes a free consumer slot (or one left by a process that died),
+ * starting from the newest message. Returns -1 if there are none.
+ */
+int join_bus(MessageBus bus) {
+    struct bus_shared *shared = bus->shared;
+    int32_t pid = getpid();
+
+    for (int i = 0; i < MESSAGE_BUS_MAX_CONSUMERS; i++) {
+        struct bus_consumer *slot = &shared->consumers[i];
+        int32_t owner = atomic_load(&slot->pid);
+        bool free_slot = owner == 0 || (kill(owner, 0) == -1 && errno == ESRCH);
+        if (!free_slot || !atomic_compare_exchange_strong(&slot->pid, &owner, pid)) continue;
+
+        // The sequence number is read first, so no message is counted as lost
+        lock_bus(shared);
+        bus->next_seq = shared->next_seq;
+        bus->cursor = atomic_load(&shared->head);
+        pthread_mutex_unlock(&shared->publish_lock);
+
+        atomic_store(&slot->cursor, bus->cursor);
+        bus->consumer = i;
+        return 0;
+    }
+
+    return -1;
+}
+
+/**
+ * Takes the publish lock. If its last owner died while publishing, what it
+ * was writing is abandoned (it was never published).
+ */
+void lock_bus(struct bus_shared *shared) {
+    if (pthread_mutex_lock(&shared->publish_lock) == EOWNERDEAD) {
+        atomic_store(&shared->reserved, atomic_load(&shared->head));
+        pthread_mutex_consistent(&shared->publish_lock);
+    }
+}
+
+/**
+ * Reads the record at the cursor (below head), visiting it unless this
+ * consumer published it. A record written over while it was read (as the
+ * consumer fell a whole ring behind) is dropped, and the consumer skips to head.
+ * Returns whether it visited a record.
+ */
+bool read_record(MessageBus bus, uint64_t head, BusVisit visit, void *arg) {
+    struct bus_shared *shared = bus->shared;
+    uint64_t offset = bus->cursor & (bus->size - 1);
+
+    // Copy the record out, then check it wasn't written over meanwhile
+    struct bus_record record;
+    memcpy(&record, bus->ring + offset, sizeof(record));
+
+    bool padding = record.len == BUS_PADDING;
+    bool valid = padding || (record.len <= MESSAGE_BUS_RECORD_MAX_LEN
+        && offset + sizeof(record) + record.len <= bus->size);
+    if (valid && !padding) {
+        memcpy(bus->buffer, bus->ring + offset + sizeof(record), record.len);
+    }
+
+    atomic_thread_fence(memory_order_acquire);
+    uint64_t reserved = atomic_load_explicit(&shared->reserved, memory_order_relaxed);
+    if (!valid || reserved - bus->cursor > bus->size) {
+        bus->cursor = head;
+        return false;
+    }
+
+    if (padding) {
+        bus->cursor += bus->size - offset;
+        return false;
+    }
+
+    bus->cursor += record_len(record.len);
+
+    // Gaps in sequence numbers are the messages lost when skipping ahead
+    if (record.seq > bus->next_seq) bus->lost += record.seq - bus->next_seq;
+    bus->next_seq = record.seq + 1;
+
+    if (record.consumer == (uint32_t)bus->consumer) return false;
+
+    bus->buffer[record.len] = '\0';
+    visit(bus->buffer, record.len, arg);
+    return true;
+}
+
+/**
+ * Waits until a message is published or the timeout runs out.
+ */
+void wait_bus(MessageBus bus, int timeout_ms) {
+    struct bus_shared *shared = bus->shared;
+
+    // A publish after reading wake changes it, so the wait returns straight away
+    uint32_t wake = atomic_load(&shared->wake);
+    if (atomic_load(&shared->head) != bus->cursor) return;
+
+    struct timespec timeout;
+    timeout.tv_sec = timeout_ms / 1000;
+    timeout.tv_nsec = (timeout_ms % 1000) * 1000000L;
+
+    atomic_fetch_add(&shared->waiters, 1);
+    syscall(SYS_futex, &shared->wake, FUTEX_WAIT, wake, &timeout, NULL, 0);
+    atomic_fetch_sub(&shared->waiters, 1);
+}
+
+/**
+ * Returns the length of a record holding len bytes of data, with its padding.
+ */
+size_t record_len(size_t len) {
+    return (sizeof(struct bus_record) + len + BUS_ALIGN - 1) & ~(size_t)(BUS_ALIGN - 1);
+}
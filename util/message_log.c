@@ -0,0 +1,790 @@
+// Message Log Implementation
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <stdatomic.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/uio.h>
+#include <zlib.h>
+
+#include "message_log.h"
+
+#define SEGMENT_SUFFIX ".log"
+#define INDEX_BLOCK_SIZE 4096
+#define INDEX_MAX_BLOCKS 4096
+
+typedef struct log_entry *LogEntry;
+
+/**
+ * A queued record. Entries form a lock-free queue with many producers
+ * (appending threads) and a single consumer (the writer).
+ */
+struct log_entry {
+    _Atomic(LogEntry) next;
+    size_t len;
+    char data[];
+};
+
+/**
+ * A segment, mapped read-only. Readers only look at the first len bytes,
+ * which hold whole records that were written (and synced).
+ */
+struct log_segment {
+    uint64_t first_seq;
+    char *map;
+    size_t map_len;
+    atomic_size_t len;
+};
+
+/**
+ * An entry of the sparse index, locating a record.
+ */
+struct log_index_entry {
+    uint64_t seq;
+    int64_t time;
+    uint32_t segment;
+    uint32_t offset;
+};
+
+/**
+ * The state of MessageLogFindTime.
+ */
+struct time_search {
+    int64_t time;
+    uint64_t seq;
+};
+
+struct message_log {
+    char *dir;
+    MessageLogSync sync;
+    size_t segment_size;
+
+    // Queue (producers swap the head, the writer owns the tail)
+    _Atomic(LogEntry) head;
+    LogEntry tail;
+    struct log_entry stub;
+    sem_t wakeup;
+
+    // Writer state
+    pthread_t writer;
+    atomic_bool shutdown;
+    int fd;
+    size_t segment_len;
+    uint64_t next_seq;
+
+    // Progress, for MessageLogFlush
+    atomic_ulong appended;
+    unsigned long written;
+    pthread_mutex_t written_lock;
+    pthread_cond_t written_cond;
+
+    // Read side, only ever appended to by the writer
+    struct log_segment *segments;
+    atomic_int segment_count;
+    struct log_index_entry *index[INDEX_MAX_BLOCKS];
+    atomic_size_t index_count;
+    _Atomic(uint64_t) last_seq;
+};
+
+void *write_log(void *arg);
+void write_batches(MessageLog log);
+int write_records(MessageLog log, struct iovec *iov, int iov_count);
+void push_entry(MessageLog log, LogEntry entry);
+LogEntry pop_entry(MessageLog log);
+void publish_records(MessageLog log, LogRecord *records, size_t *offsets, int count);
+void discard_records(MessageLog log, int count);
+int open_log(MessageLog log);
+int compare_segments(const void *a, const void *b);
+uint64_t load_segment(MessageLog log, int segment, bool last);
+int map_segment(MessageLog log, uint64_t first_seq, int fd, size_t len);
+int open_segment(MessageLog log, uint64_t first_seq, bool create);
+void index_record(MessageLog log, int segment, size_t offset, LogRecord *record);
+struct log_index_entry *index_entry(MessageLog log, size_t idx);
+size_t find_seq_entry(MessageLog log, uint64_t seq, size_t count);
+size_t find_time_entry(MessageLog log, int64_t time, size_t count);
+void read_records(MessageLog log, size_t idx, uint64_t seq, LogVisit visit, void *arg);
+bool find_time(LogRecord *record, const char *data, void *arg);
+void free_log(MessageLog log);
+void segment_path(MessageLog log, uint64_t first_seq, char *path, size_t size);
+int64_t log_time_ns(void);
+
+////////////////////////////////// FUNCTIONS ///////////////////////////////////
+
+MessageLog MessageLogNew(const char *dir, MessageLogSync sync, size_t segment_size) {
+    MessageLog log = malloc(sizeof(*log));
+    if (log == NULL) {
+        perror("malloc");
+        return NULL;
+    }
+
+    log->dir = strdup(dir);
+    log->sync = sync;
+    log->segment_size = segment_size;
+
+    atomic_store(&log->stub.next, NULL);
+    atomic_store(&log->head, &log->stub);
+    log->tail = &log->stub;
+    sem_init(&log->wakeup, 0, 0);
+
+    atomic_store(&log->shutdown, false);
+    log->fd = -1;
+
+    atomic_store(&log->appended, 0);
+    log->written = 0;
+    pthread_mutex_init(&log->written_lock, NULL);
+    pthread_cond_init(&log->written_cond, NULL);
+
+    log->segments = calloc(MESSAGE_LOG_MAX_SEGMENTS, sizeof(struct log_segment));
+    atomic_store(&log->segment_count, 0);
+    memset(log->index, 0, sizeof(log->index));
+    atomic_store(&log->index_count, 0);
+
+    // Index every segment, and continue the last one
+    if (log->dir == NULL || log->segments == NULL || open_log(log) == -1) {
+        fprintf(stderr, "MessageLogNew: can't open log in %s\n", dir);
+        free_log(log);
+        return NULL;
+    }
+
+    int res = pthread_create(&log->writer, NULL, write_log, log);
+    if (res != 0) {
+        perror("pthread_create");
+        free_log(log);
+        return NULL;
+    }
+
+    return log;
+}
+
+void MessageLogFree(MessageLog log) {
+    // The writer drains the queue before exiting
+    atomic_store(&log->shutdown, true);
+    sem_post(&log->wakeup);
+    pthread_join(log->writer, NULL);
+
+    free_log(log);
+}
+
+int MessageLogAppend(MessageLog log, const char *data, size_t len) {
+    if (len > MESSAGE_LOG_RECORD_MAX_LEN) return -1;
+
+    LogEntry entry = malloc(sizeof(*entry) + len);
+    if (entry == NULL) {
+        perror("malloc");
+        return -1;
+    }
+
+    entry->len = len;
+    memcpy(entry->data, data, len);
+
+    push_entry(log, entry);
+    atomic_fetch_add(&log->appended, 1);
+    sem_post(&log->wakeup);
+
+    return 0;
+}
+
+void MessageLogFlush(MessageLog log) {
+    unsigned long target = atomic_load(&log->appended);
+
+    pthread_mutex_lock(&log->written_lock);
+    while (log->written < target) {
+        pthread_cond_wait(&log->written_cond, &log->written_lock);
+    }
+    pthread_mutex_unlock(&log->written_lock);
+}
+
+uint64_t MessageLogLastSeq(MessageLog log) {
+    return atomic_load_explicit(&log->last_seq, memory_order_acquire);
+}
+
+uint64_t MessageLogFindTime(MessageLog log, int64_t time) {
+    uint64_t last_seq = MessageLogLastSeq(log);
+    size_t count = atomic_load_explicit(&log->index_count, memory_order_acquire);
+
+    // Walk from the last indexed record before the time
+    struct time_search found = {time, last_seq + 1};
+    if (count > 0) read_records(log, find_time_entry(log, time, count), 0, find_time, &found);
+
+    return found.seq;
+}
+
+void MessageLogRead(MessageLog log, uint64_t seq, LogVisit visit, void *arg) {
+    size_t count = atomic_load_explicit(&log->index_count, memory_order_acquire);
+    if (count == 0) return;
+
+    read_records(log, find_seq_entry(log, seq, count), seq, visit, arg);
+}
+
+void MessageLogReadBack(MessageLog log, uint64_t seq, LogVisit visit, void *arg) {
+    // Everything up to the last sequence number is indexed
+    uint64_t last_seq = MessageLogLastSeq(log);
+    size_t count = atomic_load_explicit(&log->index_count, memory_order_acquire);
+    if (seq > last_seq) seq = last_seq;
+    if (seq == 0 || count == 0) return;
+
+    // Each index entry starts a run of at most MESSAGE_LOG_INDEX_INTERVAL records
+    size_t offsets[MESSAGE_LOG_INDEX_INTERVAL];
+
+    for (size_t idx = find_seq_entry(log, seq, count) + 1; idx-- > 0; ) {
+        struct log_index_entry *entry = index_entry(log, idx);
+        struct log_segment *segment = &log->segments[entry->segment];
+        size_t len = atomic_load_explicit(&segment->len, memory_order_acquire);
+
+        // Find the run's records
+        int run = 0;
+        size_t offset = entry->offset;
+        while (run < MESSAGE_LOG_INDEX_INTERVAL && offset + sizeof(LogRecord) <= len) {
+            LogRecord record;
+            memcpy(&record, segment->map + offset, sizeof(record));
+            if (record.seq > seq) break;
+
+            offsets[run++] = offset;
+            offset += sizeof(record) + record.len;
+        }
+
+        // Visit them newest first
+        while (run-- > 0) {
+            LogRecord record;
+            memcpy(&record, segment->map + offsets[run], sizeof(record));
+            if (!visit(&record, segment->map + offsets[run] + sizeof(record), arg)) return;
+        }
+    }
+}
+
+uint32_t LogRecordCRC(LogRecord *record, const char *data) {
+    size_t offset = offsetof(LogRecord, len);
+    uLong crc = crc32(0L, (const Bytef *)record + offset, sizeof(LogRecord) - offset);
+    return crc32(crc, (const Bytef *)data, record->len);
+}
+
+////////////////////////////// HELPER FUNCTIONS ////////////////////////////////
+
+/**
+ * Writes queued records until the log is freed. Executed by the writer thread.
+ */
+void *write_log(void *arg) {
+    MessageLog log = (MessageLog)arg;
+
+    while (true) {
+        sem_wait(&log->wakeup);
+
+        bool shutdown = atomic_load(&log->shutdown);
+        write_batches(log);
+        if (shutdown) break;
+    }
+
+    return NULL;
+}
+
+/**
+ * Writes every queued record, a batch at a time: each batch is written with
+ * one system call and synced with another (unless records are synced one by one).
+ */
+void write_batches(MessageLog log) {
+    int batch_max = log->sync == MESSAGE_LOG_SYNC_EACH ? 1 : MESSAGE_LOG_BATCH_MAX;
+    LogEntry entry = pop_entry(log);
+
+    while (entry != NULL) {
+        // Start a new segment once the current one is full
+        if (log->segment_len > 0 && log->segment_len + sizeof(LogRecord) + entry->len > log->segment_size) {
+            if (open_segment(log, log->next_seq, true) == 0) {
+                log->segment_len = 0;
+            } else {
+                fprintf(stderr, "write_batches: can't start a segment\n");
+            }
+        }
+
+        LogRecord records[MESSAGE_LOG_BATCH_MAX];
+        size_t offsets[MESSAGE_LOG_BATCH_MAX];
+        LogEntry entries[MESSAGE_LOG_BATCH_MAX];
+        struct iovec iov[2 * MESSAGE_LOG_BATCH_MAX];
+        int count = 0;
+
+        // Take the queued records that fit in the segment
+        do {
+            LogRecord *record = &records[count];
+            record->len = entry->len;
+            record->seq = log->next_seq++;
+            record->time = log_time_ns();
+            record->crc = LogRecordCRC(record, entry->data);
+
+            iov[2 * count].iov_base = record;
+            iov[2 * count].iov_len = sizeof(LogRecord);
+            iov[2 * count + 1].iov_base = entry->data;
+            iov[2 * count + 1].iov_len = entry->len;
+            offsets[count] = log->segment_len;
+            entries[count] = entry;
+            count++;
+            log->segment_len += sizeof(LogRecord) + entry->len;
+
+            entry = pop_entry(log);
+        } while (entry != NULL && count < batch_max
+            && log->segment_len + sizeof(LogRecord) + entry->len <= log->segment_size);
+
+        if (write_records(log, iov, 2 * count) == 0) {
+            publish_records(log, records, offsets, count);
+        } else {
+            fprintf(stderr, "write_batches: dropped %d records\n", count);
+            discard_records(log, count);
+        }
+
+        for (int i = 0; i < count; i++) free(entries[i]);
+
+        // Wake threads waiting for these records
+        pthread_mutex_lock(&log->written_lock);
+        log->written += count;
+        pthread_cond_broadcast(&log->written_cond);
+        pthread_mutex_unlock(&log->written_lock);
+    }
+}
+
+/**
+ * Writes records to the current segment, and syncs it (unless the log never syncs).
+ * Returns -1 on error.
+ */
+int write_records(MessageLog log, struct iovec *iov, int iov_count) {
+    while (iov_count > 0) {
+        ssize_t bytes_written = writev(log->fd, iov, iov_count);
+        if (bytes_written == -1) {
+            if (errno == EINTR) continue;
+            perror("writev");
+            return -1;
+        }
+
+        // Skip what was written
+        while (iov_count > 0 && (size_t)bytes_written >= iov->iov_len) {
+            bytes_written -= iov->iov_len;
+            iov++;
+            iov_count--;
+        }
+        if (iov_count > 0) {
+            iov->iov_base = (char *)iov->iov_base + bytes_written;
+            iov->iov_len -= bytes_written;
+        }
+    }
+
+    if (log->sync != MESSAGE_LOG_SYNC_NONE && fdatasync(log->fd) == -1) {
+        perror("fdatasync");
+        return -1;
+    }
+
+    return 0;
+}
+
+/**
+ * Makes written records visible to readers: first their bytes, then their
+ * index entries, then their sequence numbers.
+ */
+void publish_records(MessageLog log, LogRecord *records, size_t *offsets, int count) {
+    int segment = atomic_load(&log->segment_count) - 1;
+    atomic_store_explicit(&log->segments[segment].len, log->segment_len, memory_order_release);
+
+    for (int i = 0; i < count; i++) {
+        index_record(log, segment, offsets[i], &records[i]);
+    }
+
+    atomic_store_explicit(&log->last_seq, records[count - 1].seq, memory_order_release);
+}
+
+/**
+ * Cuts records that failed to be written from the current segment,
+ * so their sequence numbers are reused.
+ */
+void discard_records(MessageLog log, int count) {
+    int segment = atomic_load(&log->segment_count) - 1;
+    log->segment_len = atomic_load(&log->segments[segment].len);
+    log->next_seq -= count;
+
+    if (ftruncate(log->fd, log->segment_len) == -1) perror("ftruncate");
+}
+
+/**
+ * Adds an entry to the queue. Safe to call from any number of threads.
+ */
+void push_entry(MessageLog log, LogEntry entry) {
+    atomic_store(&entry->next, NULL);
+    LogEntry prev = atomic_exchange(&log->head, entry);
+    atomic_store(&prev->next, entry);
+}
+
+/**
+ * Removes the oldest entry from the queue. Only called by the writer.
+ * Returns NULL if the queue is empty, or the next entry isn't fully added yet
+ * (its producer then wakes the writer again).
+ */
+LogEntry pop_entry(MessageLog log) {
+    LogEntry tail = log->tail;
+    LogEntry next = atomic_load(&tail->next);
+
+    // Skip the stub, which keeps the queue from ever being empty
+    if (tail == &log->stub) {
+        if (next == NULL) return NULL;
+        log->tail = next;
+        tail = next;
+        next = atomic_load(&tail->next);
+    }
+
+    if (next != NULL) {
+        log->tail = next;
+        return tail;
+    }
+
+    // The tail is the last entry, put the stub behind it before taking it
+    if (tail != atomic_load(&log->head)) return NULL;
+
+    push_entry(log, &log->stub);
+    next = atomic_load(&tail->next);
+    if (next == NULL) return NULL;
+
+    log->tail = next;
+    return tail;
+}
+
+/**
+ * Creates the log directory if needed, maps and indexes its segments,
+ * and continues the last one (or starts the first). Returns -1 on error.
+ */
+int open_log(MessageLog log) {
+    if (mkdir(log->dir, 0755) == -1 && errno != EEXIST) {
+        perror("mkdir");
+        return -1;
+    }
+
+    DIR *dir = opendir(log->dir);
+    if (dir == NULL) {
+        perror("opendir");
+        return -1;
+    }
+
+    // Find every segment
+    int count = 0;
+    struct dirent *dirent;
+    while ((dirent = readdir(dir)) != NULL) {
+        uint64_t first_seq;
+        char suffix[8];
+        if (sscanf(dirent->d_name, "%20" SCNu64 "%7s", &first_seq, suffix) != 2) continue;
+        if (strcmp(suffix, SEGMENT_SUFFIX) != 0) continue;
+
+        if (count == MESSAGE_LOG_MAX_SEGMENTS) {
+            fprintf(stderr, "open_log: too many segments\n");
+            closedir(dir);
+            return -1;
+        }
+        log->segments[count++].first_seq = first_seq;
+    }
+    closedir(dir);
+
+    if (count == 0) {
+        log->next_seq = 1;
+        atomic_store(&log->last_seq, 0);
+        return open_segment(log, 1, true);
+    }
+
+    qsort(log->segments, count, sizeof(struct log_segment), compare_segments);
+
+    // Only the last segment can hold a torn record
+    for (int i = 0; i < count; i++) {
+        log->next_seq = load_segment(log, i, i == count - 1);
+        if (log->next_seq == 0) return -1;
+    }
+
+    atomic_store(&log->last_seq, log->next_seq - 1);
+    return open_segment(log, log->segments[count - 1].first_seq, false);
+}
+
+/**
+ * Orders segments by their first sequence number.
+ */
+int compare_segments(const void *a, const void *b) {
+    uint64_t seq_a = ((const struct log_segment *)a)->first_seq;
+    uint64_t seq_b = ((const struct log_segment *)b)->first_seq;
+    return (seq_a > seq_b) - (seq_a < seq_b);
+}
+
+/**
+ * Maps an existing segment and indexes its records. The records of the last
+ * segment are also checked, and it's truncated after the last intact one.
+ * Returns the sequence number following the segment's records, or 0 on error.
+ */
+uint64_t load_segment(MessageLog log, int segment, bool last) {
+    uint64_t first_seq = log->segments[segment].first_seq;
+    char path[PATH_MAX];
+    segment_path(log, first_seq, path, sizeof(path));
+
+    int fd = open(path, last ? O_RDWR : O_RDONLY);
+    if (fd == -1) {
+        perror("open");
+        return 0;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) == -1 || map_segment(log, first_seq, fd, st.st_size) != segment) {
+        fprintf(stderr, "load_segment: can't map %s\n", path);
+        close(fd);
+        return 0;
+    }
+
+    char *map = log->segments[segment].map;
+    uint64_t next_seq = first_seq;
+    size_t offset = 0;
+
+    while (offset + sizeof(LogRecord) <= (size_t)st.st_size) {
+        LogRecord record;
+        memcpy(&record, map + offset, sizeof(record));
+        if (record.len > MESSAGE_LOG_RECORD_MAX_LEN || record.seq != next_seq) break;
+        if (offset + sizeof(record) + record.len > (size_t)st.st_size) break;
+        if (last && LogRecordCRC(&record, map + offset + sizeof(record)) != record.crc) break;
+
+        index_record(log, segment, offset, &record);
+        offset += sizeof(record) + record.len;
+        next_seq++;
+    }
+
+    atomic_store(&log->segments[segment].len, offset);
+    if (last) log->segment_len = offset;
+
+    // Drop a torn record left by a crash
+    if (last && offset < (size_t)st.st_size && ftruncate(fd, offset) == -1) {
+        perror("ftruncate");
+        next_seq = 0;
+    }
+
+    close(fd);
+    return next_seq;
+}
+
+/**
+ * Maps a segment, which can grow up to the segment size (or one record),
+ * and adds it to the segment table. The file can be closed afterwards.
+ * Returns the segment's position in the table, or -1 on error.
+ */
+int map_segment(MessageLog log, uint64_t first_seq, int fd, size_t len) {
+    int segment = atomic_load(&log->segment_count);
+    if (segment == MESSAGE_LOG_MAX_SEGMENTS) {
+        fprintf(stderr, "map_segment: too many segments\n");
+        return -1;
+    }
+
+    // Map past the end of the file, so appended records are visible
+    size_t map_len = log->segment_size;
+    if (map_len < sizeof(LogRecord) + MESSAGE_LOG_RECORD_MAX_LEN) {
+        map_len = sizeof(LogRecord) + MESSAGE_LOG_RECORD_MAX_LEN;
+    }
+    if (map_len < len) map_len = len;
+
+    char *map = mmap(NULL, map_len, PROT_READ, MAP_SHARED, fd, 0);
+    if (map == MAP_FAILED) {
+        perror("mmap");
+        return -1;
+    }
+
+    struct log_segment *seg = &log->segments[segment];
+    seg->first_seq = first_seq;
+    seg->map = map;
+    seg->map_len = map_len;
+    atomic_store(&seg->len, 0);
+
+    atomic_store_explicit(&log->segment_count, segment + 1, memory_order_release);
+    return segment;
+}
+
+/**
+ * Opens the segment starting at the given sequence number for appending
+ * (creating and mapping it if asked), closing the current one.
+ * Returns -1 on error.
+ */
+int open_segment(MessageLog log, uint64_t first_seq, bool create) {
+    char path[PATH_MAX];
+    segment_path(log, first_seq, path, sizeof(path));
+
+    int fd = open(path, O_RDWR | O_CREAT | O_APPEND, 0644);
+    if (fd == -1) {
+        perror("open");
+        return -1;
+    }
+
+    if (create && map_segment(log, first_seq, fd, 0) == -1) {
+        close(fd);
+        unlink(path);
+        return -1;
+    }
+
+    if (log->fd != -1) close(log->fd);
+    log->fd = fd;
+
+    // Make the new file itself durable
+    if (log->sync != MESSAGE_LOG_SYNC_NONE) {
+        int dir_fd = open(log->dir, O_RDONLY | O_DIRECTORY);
+        if (dir_fd != -1) {
+            fsync(dir_fd);
+            close(dir_fd);
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * Adds a record to the sparse index if it's the first of its segment,
+ * or the first of a run of MESSAGE_LOG_INDEX_INTERVAL records.
+ */
+void index_record(MessageLog log, int segment, size_t offset, LogRecord *record) {
+    if ((record->seq - log->segments[segment].first_seq) % MESSAGE_LOG_INDEX_INTERVAL != 0) return;
+
+    size_t count = atomic_load(&log->index_count);
+    size_t block = count / INDEX_BLOCK_SIZE;
+    if (block == INDEX_MAX_BLOCKS) {
+        fprintf(stderr, "index_record: index is full\n");
+        return;
+    }
+
+    if (log->index[block] == NULL) {
+        log->index[block] = malloc(INDEX_BLOCK_SIZE * sizeof(struct log_index_entry));
+        if (log->index[block] == NULL) {
+            perror("malloc");
+            return;
+        }
+    }
+
+    struct log_index_entry *entry = &log->index[block][count % INDEX_BLOCK_SIZE];
+    entry->seq = record->seq;
+    entry->time = record->time;
+    entry->segment = segment;
+    entry->offset = offset;
+
+    atomic_store_explicit(&log->index_count, count + 1, memory_order_release);
+}
+
+/**
+ * Returns an entry of the index.
+ */
+struct log_index_entry *index_entry(MessageLog log, size_t idx) {
+    return &log->index[idx / INDEX_BLOCK_SIZE][idx % INDEX_BLOCK_SIZE];
+}
+
+/**
+ * Returns the last of the first count index entries at or before
+ * the given sequence number (or the first entry if there is none).
+ */
+size_t find_seq_entry(MessageLog log, uint64_t seq, size_t count) {
+    size_t low = 0;
+    size_t high = count;
+
+    while (high - low > 1) {
+        size_t mid = low + (high - low) / 2;
+        if (index_entry(log, mid)->seq <= seq) {
+            low = mid;
+        } else {
+            high = mid;
+        }
+    }
+
+    return low;
+}
+
+/**
+ * Returns the last of the first count index entries strictly before
+ * the given time (or the first entry if there is none).
+ */
+size_t find_time_entry(MessageLog log, int64_t time, size_t count) {
+    size_t low = 0;
+    size_t high = count;
+
+    while (high - low > 1) {
+        size_t mid = low + (high - low) / 2;
+        if (index_entry(log, mid)->time < time) {
+            low = mid;
+        } else {
+            high = mid;
+        }
+    }
+
+    return low;
+}
+
+/**
+ * Visits the records from the given index entry onwards, skipping those
+ * before the given sequence number, until the visitor returns false.
+ */
+void read_records(MessageLog log, size_t idx, uint64_t seq, LogVisit visit, void *arg) {
+    struct log_index_entry *entry = index_entry(log, idx);
+    int segment_count = atomic_load_explicit(&log->segment_count, memory_order_acquire);
+    size_t offset = entry->offset;
+
+    for (int i = entry->segment; i < segment_count; i++) {
+        struct log_segment *segment = &log->segments[i];
+        size_t len = atomic_load_explicit(&segment->len, memory_order_acquire);
+
+        while (offset + sizeof(LogRecord) <= len) {
+            LogRecord record;
+            memcpy(&record, segment->map + offset, sizeof(record));
+            if (record.seq >= seq && !visit(&record, segment->map + offset + sizeof(record), arg)) return;
+            offset += sizeof(record) + record.len;
+        }
+
+        offset = 0;
+    }
+}
+
+/**
+ * Stops at the first record at or after a time. Used by MessageLogFindTime.
+ */
+bool find_time(LogRecord *record, const char *data, void *arg) {
+    struct time_search *found = arg;
+    if (record->time < found->time) return true;
+
+    found->seq = record->seq;
+    return false;
+}
+
+/**
+ * Unmaps the segments and frees the log. The writer must not be running.
+ */
+void free_log(MessageLog log) {
+    if (log->fd != -1) close(log->fd);
+
+    int segment_count = atomic_load(&log->segment_count);
+    for (int i = 0; i < segment_count; i++) {
+        munmap(log->segments[i].map, log->segments[i].map_len);
+    }
+    for (int i = 0; i < INDEX_MAX_BLOCKS; i++) {
+        free(log->index[i]);
+    }
+
+    sem_destroy(&log->wakeup);
+    pthread_mutex_destroy(&log->written_lock);
+    pthread_cond_destroy(&log->written_cond);
+    free(log->segments);
+    free(log->dir);
+    free(log);
+}
+
+/**
+ * Writes the path of the segment starting at the given sequence number.
+ */
+void segment_path(MessageLog log, uint64_t first_seq, char *path, size_t size) {
+    snprintf(path, size, "%s/%020" PRIu64 SEGMENT_SUFFIX, log->dir, first_seq);
+}
+
+/**
+ * Returns the current time in nanoseconds since the epoch.
+ */
+int64_t log_time_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
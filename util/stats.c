@@ -0,0 +1,167 @@
+// Stats Implementation
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdatomic.h>
+#include <string.h>
+#include <time.h>
+
+#include "stats.h"
+
+/**
+ * The counters and histograms updated by one thread (or a few, once there
+ * are more threads than shards).
+ */
+struct stats_shard {
+    _Alignas(STATS_CACHE_LINE) atomic_long counters[STATS_MAX_COUNTERS];
+    atomic_ulong buckets[STATS_MAX_HISTOGRAMS][STATS_HISTOGRAM_BUCKET_COUNT];
+};
+
+struct stats {
+    int count;
+    int histogram_count;
+    struct stats_shard *shards;
+};
+
+_Thread_local int stats_thread = -1; // Numbers threads as they first add
+atomic_int stats_thread_count;
+
+int stats_shard(void);
+int stats_bucket(uint64_t value);
+uint64_t bucket_max(int bucket);
+
+////////////////////////////////// FUNCTIONS ///////////////////////////////////
+
+Stats StatsNew(int count, int histogram_count) {
+    if (count > STATS_MAX_COUNTERS || histogram_count > STATS_MAX_HISTOGRAMS) return NULL;
+
+    Stats stats = malloc(sizeof(struct stats));
+    if (stats == NULL) {
+        perror("malloc");
+        return NULL;
+    }
+
+    stats->shards = aligned_alloc(STATS_CACHE_LINE, STATS_SHARD_COUNT * sizeof(struct stats_shard));
+    if (stats->shards == NULL) {
+        perror("aligned_alloc");
+        free(stats);
+        return NULL;
+    }
+
+    memset(stats->shards, 0, STATS_SHARD_COUNT * sizeof(struct stats_shard));
+
+    stats->count = count;
+    stats->histogram_count = histogram_count;
+
+    return stats;
+}
+
+void StatsFree(Stats stats) {
+    free(stats->shards);
+    free(stats);
+}
+
+void StatsAdd(Stats stats, int counter, long n) {
+    // Relaxed, since nothing is ordered by a counter (and the shard's cache
+    // line stays with this thread)
+    atomic_fetch_add_explicit(&stats->shards[stats_shard()].counters[counter], n, memory_order_relaxed);
+}
+
+long StatsRead(Stats stats, int counter) {
+    long sum = 0;
+    for (int i = 0; i < STATS_SHARD_COUNT; i++) {
+        sum += atomic_load_explicit(&stats->shards[i].counters[counter], memory_order_relaxed);
+    }
+
+    return sum;
+}
+
+void StatsRecord(Stats stats, int histogram, uint64_t value) {
+    atomic_ulong *bucket = &stats->shards[stats_shard()].buckets[histogram][stats_bucket(value)];
+    atomic_fetch_add_explicit(bucket, 1, memory_order_relaxed);
+}
+
+uint64_t StatsRecorded(Stats stats, int histogram) {
+    uint64_t count = 0;
+    for (int i = 0; i < STATS_SHARD_COUNT; i++) {
+        for (int j = 0; j < STATS_HISTOGRAM_BUCKET_COUNT; j++) {
+            count += atomic_load_explicit(&stats->shards[i].buckets[histogram][j], memory_order_relaxed);
+        }
+    }
+
+    return count;
+}
+
+uint64_t StatsPercentile(Stats stats, int histogram, double percentile) {
+    // Sum the shards' buckets
+    uint64_t counts[STATS_HISTOGRAM_BUCKET_COUNT] = {0};
+    uint64_t total = 0;
+    for (int i = 0; i < STATS_SHARD_COUNT; i++) {
+        for (int j = 0; j < STATS_HISTOGRAM_BUCKET_COUNT; j++) {
+            uint64_t count = atomic_load_explicit(&stats->shards[i].buckets[histogram][j], memory_order_relaxed);
+            counts[j] += count;
+            total += count;
+        }
+    }
+
+    if (total == 0) return 0;
+
+    // The bucket of the value ranked at the percentile (at least the first)
+    uint64_t rank = (uint64_t)(percentile / 100 * total + 0.5);
+    if (rank == 0) rank = 1;
+
+    uint64_t seen = 0;
+    for (int i = 0; i < STATS_HISTOGRAM_BUCKET_COUNT; i++) {
+        seen += counts[i];
+        if (seen >= rank) return bucket_max(i);
+    }
+
+    return bucket_max(STATS_HISTOGRAM_BUCKET_COUNT - 1);
+}
+
+uint64_t StatsTime(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+////////////////////////////// HELPER FUNCTIONS ////////////////////////////////
+
+/**
+ * Returns the shard of the calling thread.
+ */
+int stats_shard(void) {
+    if (stats_thread == -1) {
+        stats_thread = atomic_fetch_add(&stats_thread_count, 1);
+    }
+
+    return stats_thread % STATS_SHARD_COUNT;
+}
+
+/**
+ * Returns the histogram bucket of a value. The first STATS_HISTOGRAM_SUB_COUNT
+ * values have a bucket each, then each power of two is split evenly.
+ */
+int stats_bucket(uint64_t value) {
+    uint64_t max = ((uint64_t)1 << STATS_HISTOGRAM_MAX_BITS) - 1;
+    if (value > max) value = max;
+    if (value < STATS_HISTOGRAM_SUB_COUNT) return (int)value;
+
+    // The value's highest bit picks the power of two, the next bits the bucket in it
+    int shift = 63 - __builtin_clzll(value) - STATS_HISTOGRAM_SUB_BITS;
+    int sub = (int)(value >> shift) & (STATS_HISTOGRAM_SUB_COUNT - 1);
+
+    return (shift + 1) * STATS_HISTOGRAM_SUB_COUNT + sub;
+}
+
+/**
+ * Returns the largest value in a histogram bucket.
+ */
+uint64_t bucket_max(int bucket) {
+    if (bucket < STATS_HISTOGRAM_SUB_COUNT) return bucket;
+
+    int shift = bucket / STATS_HISTOGRAM_SUB_COUNT - 1;
+    uint64_t sub = bucket % STATS_HISTOGRAM_SUB_COUNT;
+
+    return ((STATS_HISTOGRAM_SUB_COUNT + sub) << shift) + ((uint64_t)1 << shift) - 1;
+}
@@ -11,6 +11,7 @@
 struct task_queue {
     struct node *front;
     struct node *back;
+    int length;
     pthread_mutex_t lock;
 };
 
@@ -28,6 +29,7 @@ TaskQueue TaskQueueNew(void) {
 
     q->front = NULL;
     q->back = NULL;
+    q->length = 0;
     pthread_mutex_init(&q->lock, NULL); 
 
     return q;
@@ -69,6 +71,7 @@ void TaskQueueEnqueue(TaskQueue q, Task task) {
         q->back->next = new;
         q->back = new;
     }
+    q->length++;
 
     pthread_mutex_unlock(&q->lock);
 }
@@ -80,6 +83,7 @@ Task TaskQueueDequeue(TaskQueue q) {
     struct node *temp = q->front;
     q->front = q->front->next;
     free(temp);
+    q->length--;
 
     pthread_mutex_unlock(&q->lock);
 
@@ -95,3 +99,13 @@ bool TaskQueueIsEmpty(TaskQueue q) {
 
     return is_empty;
 }
+
+int TaskQueueLength(TaskQueue q) {
+    pthread_mutex_lock(&q->lock);
+
+    int length = q->length;
+
+    pthread_mutex_unlock(&q->lock);
+
+    return length;
+}
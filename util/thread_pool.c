@@ -9,6 +9,7 @@
 #include "thread_pool.h"
 #include "task_queue.h"
 #include "task.h"
+#include "probes.h"
 
 struct thread_pool {
     TaskQueue task_queue;
@@ -78,8 +79,18 @@ void ThreadPoolFree(ThreadPool pool) {
 }
 
 void ThreadPoolAddTask(ThreadPool pool, Task task) {
+    PROBE1(task__add, task);
     TaskQueueEnqueue(pool->task_queue, task);
+
+    // Signal under the lock, so a worker can't miss it between
+    // finding the queue empty and waiting
+    pthread_mutex_lock(&pool->lock);
     pthread_cond_signal(&pool->cond);
+    pthread_mutex_unlock(&pool->lock);
+}
+
+int ThreadPoolPending(ThreadPool pool) {
+    return TaskQueueLength(pool->task_queue);
 }
 
 void *ThreadPoolWorker(void *arg) {
@@ -94,17 +105,21 @@ void *ThreadPoolWorker(void *arg) {
             break;
         } 
 
-        if (!TaskQueueIsEmpty(pool->task_queue)) {
-            // Execute next task
-            Task task = TaskQueueDequeue(pool->task_queue);
-            TaskExecute(task);
-            TaskFree(task);
-        } else {
+        if (TaskQueueIsEmpty(pool->task_queue)) {
             // Wait until signaled to wake up
             pthread_cond_wait(&pool->cond, &pool->lock);
+            pthread_mutex_unlock(&pool->lock);
+            continue;
         }
 
+        // Execute next task (without the lock, so workers run tasks in parallel)
+        Task task = TaskQueueDequeue(pool->task_queue);
         pthread_mutex_unlock(&pool->lock);
+
+        PROBE1(task__start, task);
+        TaskExecute(task);
+        PROBE1(task__end, task);
+        TaskFree(task);
     }
 
     return NULL;
@@ -0,0 +1,55 @@
+// Token Bucket Implementation
+
+#include "token_bucket.h"
+
+void refill_bucket(TokenBucket *bucket, uint64_t now);
+
+////////////////////////////////// FUNCTIONS ///////////////////////////////////
+
+void TokenBucketInit(TokenBucket *bucket, double rate, double burst, uint64_t now) {
+    bucket->rate = rate;
+    bucket->burst = burst;
+    bucket->tokens = burst;
+    bucket->updated = now;
+}
+
+double TokenBucketTokens(TokenBucket *bucket, uint64_t now) {
+    refill_bucket(bucket, now);
+    return bucket->tokens;
+}
+
+bool TokenBucketTake(TokenBucket *bucket, double tokens, uint64_t now) {
+    refill_bucket(bucket, now);
+    if (bucket->tokens < tokens) return false;
+
+    bucket->tokens -= tokens;
+    return true;
+}
+
+void TokenBucketCharge(TokenBucket *bucket, double tokens, uint64_t now) {
+    refill_bucket(bucket, now);
+    bucket->tokens -= tokens;
+}
+
+uint64_t TokenBucketWait(TokenBucket *bucket, double tokens, uint64_t now) {
+    refill_bucket(bucket, now);
+    if (bucket->tokens >= tokens) return 0;
+
+    // Round up, so the tokens are there once the wait is over
+    double wait = (tokens - bucket->tokens) * 1000 / bucket->rate;
+    uint64_t wait_ms = (uint64_t)wait;
+    return wait_ms < wait ? wait_ms + 1 : wait_ms;
+}
+
+////////////////////////////// HELPER FUNCTIONS ////////////////////////////////
+
+/**
+ * Adds the tokens earned since the bucket was last updated, up to its burst.
+ */
+void refill_bucket(TokenBucket *bucket, uint64_t now) {
+    if (now <= bucket->updated) return;
+
+    bucket->tokens += (now - bucket->updated) * bucket->rate / 1000;
+    if (bucket->tokens > bucket->burst) bucket->tokens = bucket->burst;
+    bucket->updated = now;
+}
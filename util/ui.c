@@ -13,10 +13,14 @@ struct ui {
     WINDOW *message_win;
     char **messages;
     int message_count;
+    char status[GDMP_MESSAGE_MAX_LEN];
+    UIKeyCallback key_callback;
+    void *key_arg;
 };
 
 void scroll_messages(UI ui);
 void print_messages(UI ui);
+bool is_backspace(int ch);
 
 ////////////////////////////////// FUNCTIONS ///////////////////////////////////
 
@@ -24,6 +28,10 @@ UI UINew(void) {
     initscr();
     UI ui = malloc(sizeof(*ui));
 
+    // Read the input a key at a time, echoing it ourselves
+    cbreak();
+    noecho();
+
     ui->input_win = newwin(
         UI_INPUT_WIN_HEIGHT, 
         UI_INPUT_WIN_WIDTH, 
@@ -38,8 +46,13 @@ UI UINew(void) {
         UI_MESSAGE_WIN_START_X
     );
 
+    keypad(ui->input_win, TRUE);
+
     ui->messages = malloc(MESSAGE_MAX_COUNT * sizeof(char *));
     ui->message_count = 0;
+    ui->status[0] = '\0';
+    ui->key_callback = NULL;
+    ui->key_arg = NULL;
 
     for (int i = 0; i < MESSAGE_MAX_COUNT; i++) {
         ui->messages[i] = malloc(GDMP_MESSAGE_MAX_LEN * sizeof(char));
@@ -88,8 +101,47 @@ void UIDisplayInput(UI ui, char *prompt, char *input, size_t input_size) {
     mvwprintw(ui->input_win, 1, 1, "%s", prompt);
     wrefresh(ui->input_win);
 
-    // Capture input
-    wgetnstr(ui->input_win, input, input_size - 1); 
+    // Capture input, a key at a time
+    size_t len = 0;
+    input[0] = '\0';
+
+    while (true) {
+        int ch = wgetch(ui->input_win);
+        if (ch == ERR || ch == '\n' || ch == KEY_ENTER) break;
+
+        if (is_backspace(ch)) {
+            if (len == 0) continue;
+            len--;
+            int y, x;
+            getyx(ui->input_win, y, x);
+            mvwaddch(ui->input_win, y, x - 1, ' ');
+            wmove(ui->input_win, y, x - 1);
+        } else if (isprint(ch) && len < input_size - 1) {
+            input[len++] = ch;
+            waddch(ui->input_win, ch);
+        } else {
+            continue;
+        }
+
+        input[len] = '\0';
+        wrefresh(ui->input_win);
+
+        if (ui->key_callback != NULL) ui->key_callback(input, ui->key_arg);
+    }
+
+    input[len] = '\0';
+}
+
+void UISetKeyCallback(UI ui, UIKeyCallback callback, void *arg) {
+    ui->key_callback = callback;
+    ui->key_arg = arg;
+}
+
+void UISetStatus(UI ui, char *status) {
+    snprintf(ui->status, sizeof(ui->status), "%s", status == NULL ? "" : status);
+
+    // Print messages (and the status)
+    print_messages(ui);
 }
 
 void UIClearMessages(UI ui) {
@@ -124,5 +176,15 @@ void print_messages(UI ui) {
     for (int i = 0; i < ui->message_count; i++) {
         mvwprintw(ui->message_win, 1 + i, 1, "%s", ui->messages[i]);
     }
+    if (ui->status[0] != '\0') {
+        mvwprintw(ui->message_win, UI_MESSAGE_WIN_HEIGHT - 1, 2, " %s ", ui->status);
+    }
     wrefresh(ui->message_win);
 }
+
+/**
+ * Returns true if the key erases the last character.
+ */
+bool is_backspace(int ch) {
+    return ch == KEY_BACKSPACE || ch == 127 || ch == '\b';
+}